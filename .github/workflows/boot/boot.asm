@@ -12,6 +12,7 @@ MBOOT_CHECKSUM      equ -(MBOOT_HEADER_MAGIC + MBOOT_HEADER_FLAGS)
 [BITS 32]
 [GLOBAL mboot]
 [GLOBAL start]
+[GLOBAL boot_tsc]
 [EXTERN kernel_main]
 
 section .multiboot
@@ -27,11 +28,21 @@ stack_bottom:
     resb 16384          ; 16 KB stack
 stack_top:
 
+boot_tsc:
+    resd 2              ; TSC when GRUB handed over (boottime.c)
+
 section .text
 start:
     cli                  ; Disable interrupts
     mov esp, stack_top   ; Setup stack
 
+    ; Timestamp the Multiboot handoff (rdtsc clobbers eax = magic)
+    mov ecx, eax
+    rdtsc
+    mov [boot_tsc], eax
+    mov [boot_tsc + 4], edx
+    mov eax, ecx
+
     ; Push multiboot info pointers for kernel_main
     push ebx             ; Multiboot info pointer
     push eax             ; Multiboot magic
@@ -54,6 +54,7 @@ echo -e "${YELLOW}[2/5] Assembly fordítás...${NC}"
 nasm -f elf32 boot/boot.asm    -o boot/boot.o    && echo -e "  ${GREEN}✓${NC} boot.asm"
 nasm -f elf32 kernel/gdt_asm.asm -o kernel/gdt_asm.o && echo -e "  ${GREEN}✓${NC} gdt_asm.asm"
 nasm -f elf32 kernel/isr.asm   -o kernel/isr.o   && echo -e "  ${GREEN}✓${NC} isr.asm"
+nasm -f elf32 kernel/syscall_asm.asm -o kernel/syscall_asm.o && echo -e "  ${GREEN}✓${NC} syscall_asm.asm"
 
 # ──────────────────────────────────────────
 # 3. C fordítás
@@ -75,10 +76,29 @@ compile kernel/pic.c      kernel/pic.o
 compile kernel/vga.c      kernel/vga.o
 compile kernel/stdlib.c   kernel/stdlib.o
 compile kernel/exec.c     kernel/exec.o
+compile kernel/pe.c       kernel/pe.o
+compile kernel/kmem.c     kernel/kmem.o
+compile kernel/boottime.c kernel/boottime.o
+compile kernel/initcall.c kernel/initcall.o
+compile kernel/syscall.c  kernel/syscall.o
+compile kernel/kdata.c    kernel/kdata.o
+compile kernel/imgcache.c kernel/imgcache.o
+compile kernel/cmdline.c  kernel/cmdline.o
+compile drivers/ata.c     drivers/ata.o
+compile drivers/ahci.c    drivers/ahci.o
+compile drivers/virtio_blk.c drivers/virtio_blk.o
+compile drivers/ramdisk.c drivers/ramdisk.o
+compile drivers/blkdev.c  drivers/blkdev.o
+compile drivers/pci.c     drivers/pci.o
+compile drivers/serial.c  drivers/serial.o
 compile drivers/keyboard.c drivers/keyboard.o
 compile drivers/mouse.c   drivers/mouse.o
 compile drivers/timer.c   drivers/timer.o
 compile fs/fat.c          fs/fat.o
+compile fs/bcache.c       fs/bcache.o
+compile fs/dcache.c       fs/dcache.o
+compile fs/diridx.c       fs/diridx.o
+compile fs/ramfs.c        fs/ramfs.o
 compile shell/shell.c     shell/shell.o
 
 # ──────────────────────────────────────────
@@ -91,6 +111,7 @@ $LD -m32 -T kernel.ld -ffreestanding -nostdlib -o myos.bin \
     boot/boot.o \
     kernel/gdt_asm.o \
     kernel/isr.o \
+    kernel/syscall_asm.o \
     kernel/kernel.o \
     kernel/gdt.o \
     kernel/idt.o \
@@ -98,18 +119,37 @@ $LD -m32 -T kernel.ld -ffreestanding -nostdlib -o myos.bin \
     kernel/vga.o \
     kernel/stdlib.o \
     kernel/exec.o \
+    kernel/pe.o \
+    kernel/kmem.o \
+    kernel/boottime.o \
+    kernel/initcall.o \
+    kernel/syscall.o \
+    kernel/kdata.o \
+    kernel/imgcache.o \
+    kernel/cmdline.o \
+    drivers/ata.o \
+    drivers/ahci.o \
+    drivers/virtio_blk.o \
+    drivers/ramdisk.o \
+    drivers/blkdev.o \
+    drivers/pci.o \
+    drivers/serial.o \
     drivers/keyboard.o \
     drivers/mouse.o \
     drivers/timer.o \
     fs/fat.o \
+    fs/bcache.o \
+    fs/dcache.o \
+    fs/diridx.o \
+    fs/ramfs.o \
     shell/shell.o \
     -lgcc 2>/dev/null || \
 $LD -m32 -T kernel.ld -ffreestanding -nostdlib -o myos.bin \
-    boot/boot.o kernel/gdt_asm.o kernel/isr.o \
+    boot/boot.o kernel/gdt_asm.o kernel/isr.o kernel/syscall_asm.o \
     kernel/kernel.o kernel/gdt.o kernel/idt.o kernel/pic.o \
-    kernel/vga.o kernel/stdlib.o kernel/exec.o \
-    drivers/keyboard.o drivers/mouse.o drivers/timer.o \
-    fs/fat.o shell/shell.o
+    kernel/vga.o kernel/stdlib.o kernel/exec.o kernel/pe.o kernel/kmem.o kernel/boottime.o kernel/initcall.o kernel/syscall.o kernel/kdata.o kernel/imgcache.o kernel/cmdline.o \
+    drivers/ata.o drivers/ahci.o drivers/virtio_blk.o drivers/ramdisk.o drivers/blkdev.o drivers/pci.o drivers/serial.o drivers/keyboard.o drivers/mouse.o drivers/timer.o \
+    fs/fat.o fs/bcache.o fs/dcache.o fs/diridx.o fs/ramfs.o shell/shell.o
 
 echo -e "  ${GREEN}✓${NC} myos.bin kész ($(du -sh myos.bin | cut -f1))"
 
@@ -144,7 +184,28 @@ menuentry "MyOS v0.1 (safe mode)" {
     multiboot /boot/myos.bin nosmp
     boot
 }
+
+menuentry "MyOS v0.1 (diagnostics: serial console, trace)" {
+    multiboot /boot/myos.bin console=both trace=init,exec autorun="boottime;cache"
+    boot
+}
+EOF
+
+# Opcionális RAM disk: root.img (FAT képfájl) vagy root.tar boot modulként
+for rd in root.img root.tar; do
+    if [ -f "$rd" ]; then
+        cp "$rd" isodir/boot/
+        cat >> isodir/boot/grub/grub.cfg << EOF
+
+menuentry "MyOS v0.1 (RAM disk: $rd)" {
+    multiboot /boot/myos.bin
+    module /boot/$rd
+    boot
+}
 EOF
+        echo -e "  ${GREEN}✓${NC} RAM disk modul: $rd"
+    fi
+done
 
 grub-mkrescue -o myos.iso isodir 2>/dev/null
 echo -e "  ${GREEN}✓${NC} myos.iso kész ($(du -sh myos.iso | cut -f1))"
@@ -0,0 +1,478 @@
+// ahci.c - AHCI SATA driver with native command queuing
+//
+// The controller is found on the PCI bus (class 01:06) and driven through
+// its memory-mapped registers (ABAR, BAR5). Every port with an ATA disk
+// gets a command list, a FIS receive area and one command table per slot,
+// all in static memory (no paging: addresses are physical).
+//
+// Disks that support NCQ take READ/WRITE FPDMA QUEUED in all of their
+// command slots at once; others get READ/WRITE DMA EXT, which the HBA runs
+// one after another from the same slots. The port registers with the
+// block layer's queued interface: start() fills a free slot, and poll()
+// reaps finished slots from PxSACT/PxCI, halting until the port IRQ fires.
+// The IRQ handler itself only acknowledges, so completions are always
+// delivered outside interrupt context.
+
+#include "ahci.h"
+#include "../kernel/kernel.h"
+#include "../kernel/idt.h"
+#include "../kernel/vga.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "timer.h"
+
+#define PCI_SUBCLASS_SATA   0x06
+#define AHCI_PROG_IF        0x01
+
+// HBA registers (offsets from ABAR)
+#define HBA_CAP             0x00
+#define HBA_GHC             0x04
+#define HBA_IS              0x08
+#define HBA_PI              0x0C
+#define HBA_CAP2            0x24
+#define HBA_BOHC            0x28
+#define HBA_PORT(n)         (0x100 + (n) * 0x80)
+
+#define HBA_CAP_NCS(c)      ((((c) >> 8) & 0x1F) + 1)
+#define HBA_CAP_SNCQ        (1u << 30)
+#define HBA_CAP2_BOH        0x01
+#define HBA_BOHC_BOS        0x01
+#define HBA_BOHC_OOS        0x02
+#define HBA_GHC_IE          0x02
+#define HBA_GHC_AE          (1u << 31)
+
+// Port registers (offsets from HBA_PORT(n))
+#define PX_CLB              0x00
+#define PX_CLBU             0x04
+#define PX_FB               0x08
+#define PX_FBU              0x0C
+#define PX_IS               0x10
+#define PX_IE               0x14
+#define PX_CMD              0x18
+#define PX_TFD              0x20
+#define PX_SIG              0x24
+#define PX_SSTS             0x28
+#define PX_SERR             0x30
+#define PX_SACT             0x34
+#define PX_CI               0x38
+
+#define PX_CMD_ST           0x0001
+#define PX_CMD_SUD          0x0002
+#define PX_CMD_POD          0x0004
+#define PX_CMD_FRE          0x0010
+#define PX_CMD_FR           0x4000
+#define PX_CMD_CR           0x8000
+
+#define PX_IS_DHRS          0x00000001  // D2H register FIS
+#define PX_IS_PSS           0x00000002  // PIO setup FIS
+#define PX_IS_SDBS          0x00000008  // Set device bits FIS (NCQ done)
+#define PX_IS_DPS           0x00000020  // PRD with I bit done
+#define PX_IS_ERRORS        0x78000000  // TFES | HBFS | HBDS | IFS
+
+#define PX_SSTS_DET_OK      3           // Device present, PHY up
+#define SATA_SIG_ATA        0x00000101
+
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define FIS_TYPE_REG_H2D    0x27
+#define FIS_H2D_CMD         0x80        // Command (not control) update
+
+#define AHCI_SLOTS          32
+#define AHCI_PRDT_ENTRIES   8
+#define AHCI_PRD_MAX        0x400000    // 4 MB per descriptor
+#define AHCI_MAX_COUNT      65536       // Sectors per command (8 x 4 MB)
+#define AHCI_SPIN_TIMEOUT   1000000
+#define AHCI_IRQ_TIMEOUT_MS 3000        // Milliseconds
+
+// Command list entry
+typedef struct {
+    uint16_t flags;         // CFL (FIS dwords) | W (0x40) | ...
+    uint16_t prdtl;         // PRDT entries
+    volatile uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define AHCI_CMD_WRITE      0x0040
+
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;           // Byte count - 1 (bits 0-21), bit 31 = IRQ
+} __attribute__((packed)) ahci_prd_t;
+
+// Host to device register FIS
+typedef struct {
+    uint8_t type, flags, command, feature_lo;
+    uint8_t lba0, lba1, lba2, device;
+    uint8_t lba3, lba4, lba5, feature_hi;
+    uint8_t count_lo, count_hi, icc, control;
+    uint8_t reserved[4];
+} __attribute__((packed)) fis_h2d_t;
+
+typedef struct {
+    uint8_t    cfis[64];
+    uint8_t    acmd[16];
+    uint8_t    reserved[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+typedef struct {
+    uint32_t         regs;          // Port register base (absolute)
+    uint32_t         slots;         // Usable command slots
+    bool             ncq;
+    volatile uint32_t irq_status;   // PxIS bits collected by the IRQ handler
+    uint32_t         issued;        // Slots with a command outstanding
+    blk_transfer_t*  xfer[AHCI_SLOTS];
+    blkdev_t*        dev;
+} ahci_port_t;
+
+// Per-port DMA structures (alignment required by the HBA)
+static ahci_cmd_header_t ahci_cmd_list[AHCI_MAX_PORTS][AHCI_SLOTS] __attribute__((aligned(1024)));
+static uint8_t           ahci_fis[AHCI_MAX_PORTS][256] __attribute__((aligned(256)));
+static ahci_cmd_table_t  ahci_tables[AHCI_MAX_PORTS][AHCI_SLOTS] __attribute__((aligned(128)));
+
+static ahci_port_t   ahci_ports[AHCI_MAX_PORTS];
+static uint32_t      ahci_num_ports = 0;
+static uint32_t      ahci_abar = 0;
+static uint16_t      ahci_ident[256];
+
+static bool          ahci_have_irq = false;
+static volatile bool ahci_irq_pending = false;
+
+static inline uint32_t mmio_read(uint32_t addr) {
+    return *(volatile uint32_t*)(uintptr_t)addr;
+}
+
+static inline void mmio_write(uint32_t addr, uint32_t val) {
+    *(volatile uint32_t*)(uintptr_t)addr = val;
+}
+
+static inline uint32_t port_read(ahci_port_t* p, uint32_t reg) {
+    return mmio_read(p->regs + reg);
+}
+
+static inline void port_write(ahci_port_t* p, uint32_t reg, uint32_t val) {
+    mmio_write(p->regs + reg, val);
+}
+
+// Acknowledge everything; the waiting thread reaps the slots
+static void ahci_irq_handler(registers_t* regs) {
+    (void)regs;
+    uint32_t is = mmio_read(ahci_abar + HBA_IS);
+    for (uint32_t i = 0; i < ahci_num_ports; i++) {
+        ahci_port_t* p = &ahci_ports[i];
+        uint32_t pis = port_read(p, PX_IS);
+        p->irq_status |= pis;
+        port_write(p, PX_IS, pis);
+    }
+    mmio_write(ahci_abar + HBA_IS, is);
+    ahci_irq_pending = true;
+}
+
+// Wait until (reg & mask) == 0; false on timeout
+static bool port_wait_clear(ahci_port_t* p, uint32_t reg, uint32_t mask) {
+    for (uint32_t timeout = AHCI_SPIN_TIMEOUT; timeout; timeout--)
+        if (!(port_read(p, reg) & mask)) return true;
+    return false;
+}
+
+static bool port_stop(ahci_port_t* p) {
+    port_write(p, PX_CMD, port_read(p, PX_CMD) & ~PX_CMD_ST);
+    if (!port_wait_clear(p, PX_CMD, PX_CMD_CR)) return false;
+    port_write(p, PX_CMD, port_read(p, PX_CMD) & ~PX_CMD_FRE);
+    return port_wait_clear(p, PX_CMD, PX_CMD_FR);
+}
+
+// Give up on a port that was set up but is not used: stop it and detach
+// its buffers, which the next port takes over. Always returns false.
+static bool port_release(ahci_port_t* p) {
+    port_write(p, PX_IE, 0);
+    if (!port_stop(p)) return false;    // Still running: leave the bases alone
+    port_write(p, PX_CLB, 0);
+    port_write(p, PX_FB,  0);
+    port_write(p, PX_IS,  0xFFFFFFFF);
+    return false;
+}
+
+static bool port_start(ahci_port_t* p) {
+    if (!port_wait_clear(p, PX_CMD, PX_CMD_CR)) return false;
+    port_write(p, PX_CMD, port_read(p, PX_CMD) | PX_CMD_FRE);
+    port_write(p, PX_CMD, port_read(p, PX_CMD) | PX_CMD_ST);
+    return true;
+}
+
+// Fill slot `slot`'s command table with a FIS and a PRDT for `buf`
+static void ahci_build(ahci_port_t* p, uint32_t slot, uint8_t cmd, uint32_t lba,
+                       uint32_t count, uint8_t* buf, uint32_t bytes, bool write) {
+    uint32_t pi = p - ahci_ports;
+    ahci_cmd_table_t* t = &ahci_tables[pi][slot];
+    ahci_cmd_header_t* h = &ahci_cmd_list[pi][slot];
+    memset(t, 0, sizeof(ahci_cmd_table_t));
+
+    fis_h2d_t* fis = (fis_h2d_t*)t->cfis;
+    fis->type    = FIS_TYPE_REG_H2D;
+    fis->flags   = FIS_H2D_CMD;
+    fis->command = cmd;
+    fis->lba0    = lba & 0xFF;
+    fis->lba1    = (lba >> 8) & 0xFF;
+    fis->lba2    = (lba >> 16) & 0xFF;
+    fis->lba3    = (lba >> 24) & 0xFF;
+    fis->device  = 0x40;                // LBA mode
+
+    if (cmd == ATA_CMD_READ_FPDMA || cmd == ATA_CMD_WRITE_FPDMA) {
+        // Queued: count goes in FEATURES, the tag in COUNT
+        fis->feature_lo = count & 0xFF;
+        fis->feature_hi = (count >> 8) & 0xFF;
+        fis->count_lo   = slot << 3;
+    } else {
+        fis->count_lo = count & 0xFF;
+        fis->count_hi = (count >> 8) & 0xFF;
+    }
+
+    uint32_t n = 0;
+    uint32_t addr = (uint32_t)(uintptr_t)buf;
+    while (bytes) {
+        uint32_t chunk = bytes < AHCI_PRD_MAX ? bytes : AHCI_PRD_MAX;
+        t->prdt[n].dba = addr;
+        t->prdt[n].dbc = chunk - 1;
+        addr  += chunk;
+        bytes -= chunk;
+        n++;
+    }
+
+    h->flags = sizeof(fis_h2d_t) / 4 | (write ? AHCI_CMD_WRITE : 0);
+    h->prdtl = n;
+    h->prdbc = 0;
+}
+
+// Fail everything outstanding and restart the port after an error
+static void ahci_recover(ahci_port_t* p) {
+    port_stop(p);
+    port_write(p, PX_SERR, 0xFFFFFFFF);
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    p->irq_status = 0;
+    port_start(p);
+
+    uint32_t failed = p->issued;
+    p->issued = 0;
+    for (uint32_t s = 0; s < AHCI_SLOTS; s++) {
+        if (!(failed & (1u << s))) continue;
+        blk_transfer_t* x = p->xfer[s];
+        p->xfer[s] = NULL;
+        blk_transfer_done(x, false);
+    }
+    vga_print("[AHCI] ");
+    vga_print(p->dev->name);
+    vga_print(": command error, port restarted\n");
+}
+
+// Complete finished slots; returns true if any completed (or failed)
+static bool ahci_reap(ahci_port_t* p) {
+    if ((p->irq_status | port_read(p, PX_IS)) & PX_IS_ERRORS) {
+        ahci_recover(p);
+        return true;
+    }
+
+    uint32_t done = p->issued & ~(port_read(p, PX_SACT) | port_read(p, PX_CI));
+    if (!done) return false;
+
+    p->issued &= ~done;
+    for (uint32_t s = 0; s < AHCI_SLOTS; s++) {
+        if (!(done & (1u << s))) continue;
+        blk_transfer_t* x = p->xfer[s];
+        p->xfer[s] = NULL;
+        blk_transfer_done(x, true);
+    }
+    return true;
+}
+
+static bool ahci_blk_start(blkdev_t* dev, blk_transfer_t* x) {
+    ahci_port_t* p = dev->priv;
+    if (x->count == 0 || x->count > AHCI_MAX_COUNT) return false;
+
+    uint32_t slot = 0;
+    while (slot < p->slots && (p->issued & (1u << slot))) slot++;
+    if (slot == p->slots) return false;
+
+    uint8_t cmd;
+    if (x->write) cmd = p->ncq ? ATA_CMD_WRITE_FPDMA : ATA_CMD_WRITE_DMA_EXT;
+    else          cmd = p->ncq ? ATA_CMD_READ_FPDMA : ATA_CMD_READ_DMA_EXT;
+    ahci_build(p, slot, cmd, x->lba, x->count, x->buf, x->count * BLK_SECTOR_SIZE, x->write);
+
+    p->xfer[slot] = x;
+    p->issued |= 1u << slot;
+    if (p->ncq) port_write(p, PX_SACT, 1u << slot);
+    port_write(p, PX_CI, 1u << slot);
+    return true;
+}
+
+// Reap completions; sleep until the port interrupts if there are none
+static void ahci_blk_poll(blkdev_t* dev) {
+    ahci_port_t* p = dev->priv;
+    bool use_irq = ahci_have_irq && interrupts_enabled();
+    uint32_t start = timer_get_ticks();
+    uint32_t spins = 0;
+
+    for (;;) {
+        if (ahci_reap(p)) return;
+        if (use_irq) {
+            if (timer_get_ticks() - start > timer_ms_to_ticks(AHCI_IRQ_TIMEOUT_MS)) break;
+            __asm__ volatile ("cli");
+            if (!ahci_irq_pending) __asm__ volatile ("sti; hlt");  // No lost wakeup
+            ahci_irq_pending = false;
+            __asm__ volatile ("sti");
+        } else if (++spins > AHCI_SPIN_TIMEOUT) {
+            break;
+        }
+    }
+    if (p->issued) ahci_recover(p);     // Timed out
+}
+
+static const blkdev_ops_t ahci_ops = {
+    .start = ahci_blk_start,
+    .poll  = ahci_blk_poll,
+};
+
+// IDENTIFY DEVICE in slot 0, polled (the port is still idle)
+static bool ahci_identify(ahci_port_t* p) {
+    ahci_build(p, 0, ATA_CMD_IDENTIFY, 0, 0, (uint8_t*)ahci_ident, sizeof(ahci_ident), false);
+    ((fis_h2d_t*)ahci_tables[p - ahci_ports][0].cfis)->device = 0;
+
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    port_write(p, PX_CI, 1);
+    if (!port_wait_clear(p, PX_CI, 1)) return false;
+    if (port_read(p, PX_IS) & PX_IS_ERRORS) return false;
+    return !(port_read(p, PX_TFD) & (ATA_SR_ERR | ATA_SR_BSY | ATA_SR_DRQ));
+}
+
+// Bring up port `n`; false if there is no usable ATA disk on it
+static bool ahci_port_init(uint32_t n, uint32_t cap) {
+    ahci_port_t* p = &ahci_ports[ahci_num_ports];
+    uint32_t pi = ahci_num_ports;
+    memset(p, 0, sizeof(*p));
+    p->regs = ahci_abar + HBA_PORT(n);
+
+    if ((port_read(p, PX_SSTS) & 0x0F) != PX_SSTS_DET_OK) return false;
+    if (port_read(p, PX_SIG) != SATA_SIG_ATA) return false;   // ATAPI, PM...
+    if (!port_stop(p)) return false;
+
+    memset(ahci_cmd_list[pi], 0, sizeof(ahci_cmd_list[pi]));
+    memset(ahci_fis[pi], 0, sizeof(ahci_fis[pi]));
+    for (uint32_t s = 0; s < AHCI_SLOTS; s++)
+        ahci_cmd_list[pi][s].ctba = (uint32_t)(uintptr_t)&ahci_tables[pi][s];
+
+    port_write(p, PX_CLB,  (uint32_t)(uintptr_t)ahci_cmd_list[pi]);
+    port_write(p, PX_CLBU, 0);
+    port_write(p, PX_FB,   (uint32_t)(uintptr_t)ahci_fis[pi]);
+    port_write(p, PX_FBU,  0);
+    port_write(p, PX_SERR, 0xFFFFFFFF);
+    port_write(p, PX_IS,   0xFFFFFFFF);
+    port_write(p, PX_IE,   0);
+    port_write(p, PX_CMD,  port_read(p, PX_CMD) | PX_CMD_POD | PX_CMD_SUD);
+    if (!port_start(p) || !ahci_identify(p)) return port_release(p);
+
+    // Capacity: 48-bit words 100-103 (clamped to 32 bits), else 60-61
+    uint32_t sectors = ahci_ident[60] | ((uint32_t)ahci_ident[61] << 16);
+    if (ahci_ident[83] & 0x0400) {
+        if (ahci_ident[102] || ahci_ident[103])
+            sectors = 0xFFFFFFFF;
+        else if (ahci_ident[100] | ahci_ident[101])
+            sectors = ahci_ident[100] | ((uint32_t)ahci_ident[101] << 16);
+    } else {
+        return port_release(p);     // READ DMA EXT / FPDMA need the 48-bit set
+    }
+    if (!sectors) return port_release(p);
+
+    // NCQ: HBA and drive must both support it; depth is word 75 + 1
+    p->slots = HBA_CAP_NCS(cap);
+    p->ncq = (cap & HBA_CAP_SNCQ) && (ahci_ident[76] & 0x0100);
+    if (p->ncq) {
+        uint32_t depth = (ahci_ident[75] & 0x1F) + 1;
+        if (depth < p->slots) p->slots = depth;
+    }
+
+    port_write(p, PX_IS, 0xFFFFFFFF);
+    port_write(p, PX_IE, PX_IS_DHRS | PX_IS_PSS | PX_IS_SDBS | PX_IS_DPS | PX_IS_ERRORS);
+
+    char name[4] = { 's', 'd', (char)('a' + ahci_num_ports), '\0' };
+    p->dev = blkdev_register(name, sectors, AHCI_MAX_COUNT, &ahci_ops, p);
+    if (!p->dev) return port_release(p);
+    ahci_num_ports++;
+
+    char model[41];
+    for (int i = 0; i < 20; i++) {
+        model[i * 2]     = ahci_ident[27 + i] >> 8;
+        model[i * 2 + 1] = ahci_ident[27 + i] & 0xFF;
+    }
+    model[40] = '\0';
+    for (int i = 39; i >= 0 && model[i] == ' '; i--) model[i] = '\0';
+
+    vga_print("[AHCI] ");
+    vga_print(name);
+    vga_print(": ");
+    vga_print(model);
+    vga_print(", ");
+    vga_print_dec(sectors / 2048);
+    vga_print(p->ncq ? " MB, NCQ depth " : " MB, DMA, slots ");
+    vga_print_dec(p->slots);
+    vga_print("\n");
+    return true;
+}
+
+// Take the HBA over from the firmware if it supports the handoff
+static void ahci_bios_handoff(void) {
+    if (!(mmio_read(ahci_abar + HBA_CAP2) & HBA_CAP2_BOH)) return;
+    mmio_write(ahci_abar + HBA_BOHC, mmio_read(ahci_abar + HBA_BOHC) | HBA_BOHC_OOS);
+    for (uint32_t timeout = AHCI_SPIN_TIMEOUT; timeout; timeout--)
+        if (!(mmio_read(ahci_abar + HBA_BOHC) & HBA_BOHC_BOS)) break;
+}
+
+bool ahci_init(void) {
+    pci_device_t* hba = NULL;
+    for (uint32_t i = 0; i < pci_count() && !hba; i++) {
+        pci_device_t* d = pci_get(i);
+        if (d->class_code == PCI_CLASS_STORAGE && d->subclass == PCI_SUBCLASS_SATA &&
+            d->prog_if == AHCI_PROG_IF)
+            hba = d;
+    }
+    if (!hba || (hba->bar[5] & 1)) {
+        vga_print("[AHCI] No AHCI controller\n");
+        return false;
+    }
+
+    pci_enable_master(hba);
+    ahci_abar = hba->bar[5] & 0xFFFFFFF0;
+    ahci_bios_handoff();
+    mmio_write(ahci_abar + HBA_GHC, mmio_read(ahci_abar + HBA_GHC) | HBA_GHC_AE);
+
+    uint32_t cap = mmio_read(ahci_abar + HBA_CAP);
+    uint32_t implemented = mmio_read(ahci_abar + HBA_PI);
+    for (uint32_t n = 0; n < 32 && ahci_num_ports < AHCI_MAX_PORTS; n++)
+        if (implemented & (1u << n)) ahci_port_init(n, cap);
+
+    if (!ahci_num_ports) {
+        vga_print("[AHCI] No SATA disks\n");
+        return false;
+    }
+
+    if (hba->irq_line < 16) {
+        irq_install_handler(hba->irq_line, ahci_irq_handler);
+        irq_clear_mask(hba->irq_line);
+        if (hba->irq_line >= 8) irq_clear_mask(2);   // Cascade
+        ahci_have_irq = true;
+    }
+    mmio_write(ahci_abar + HBA_IS, 0xFFFFFFFF);
+    mmio_write(ahci_abar + HBA_GHC, mmio_read(ahci_abar + HBA_GHC) | HBA_GHC_IE);
+    return true;
+}
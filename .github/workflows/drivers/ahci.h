@@ -0,0 +1,10 @@
+// ahci.h - AHCI SATA driver with native command queuing
+#ifndef AHCI_H
+#define AHCI_H
+#include "../kernel/kernel.h"
+
+#define AHCI_MAX_PORTS      4       // Ports the driver will bring up
+
+// Probe the PCI AHCI controller and register each SATA disk ("sda"...)
+bool ahci_init(void);
+#endif
@@ -0,0 +1,491 @@
+// ata.c - ATA PIO disk driver (primary channel, master drive)
+//
+// The drive is probed with IDENTIFY and switched to READ MULTIPLE with the
+// largest block size it supports. Data moves with `rep insw` straight into
+// the caller's buffer. Once interrupts are enabled each DRQ block is
+// signalled by IRQ14 and the CPU halts while the drive seeks; before that
+// (early boot, IF=0) the driver polls the status register instead.
+//
+// Drives that support the 48-bit feature set get the EXT commands whenever
+// a transfer needs them (beyond LBA 2^28 or more than 256 sectors), so one
+// command can move up to 65536 sectors. LBAs stay 32-bit in the kernel,
+// which covers 2 TB.
+//
+// Writes mirror reads (WRITE MULTIPLE / WRITE DMA); FLUSH CACHE commits
+// the drive's write cache when the filesystem syncs.
+//
+// If the PCI IDE controller supports bus mastering (BAR4), transfers use DMA:
+// a PRD table is built from a scatter-gather list, the controller copies
+// the data itself, and IRQ14 signals completion. PIO remains the fallback.
+
+#include "ata.h"
+#include "../kernel/kernel.h"
+#include "../kernel/idt.h"
+#include "../kernel/vga.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "timer.h"
+
+// ATA PIO ports (Primary channel)
+#define ATA_DATA        0x1F0
+#define ATA_ERROR       0x1F1
+#define ATA_SECT_COUNT  0x1F2
+#define ATA_LBA_LO      0x1F3
+#define ATA_LBA_MID     0x1F4
+#define ATA_LBA_HI      0x1F5
+#define ATA_DRIVE       0x1F6
+#define ATA_STATUS      0x1F7
+#define ATA_CMD         0x1F7
+#define ATA_CTRL        0x3F6   // Device control (write) / alt status (read)
+
+#define ATA_STATUS_BSY  0x80
+#define ATA_STATUS_RDY  0x40
+#define ATA_STATUS_DF   0x20
+#define ATA_STATUS_DRQ  0x08
+#define ATA_STATUS_ERR  0x01
+
+#define ATA_CTRL_NIEN   0x02    // Mask INTRQ
+
+#define ATA_CMD_READ            0x20
+#define ATA_CMD_READ_EXT        0x24
+#define ATA_CMD_WRITE           0x30
+#define ATA_CMD_WRITE_EXT       0x34
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_READ_MULTIPLE_EXT 0x29
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_READ_MULTIPLE   0xC4
+#define ATA_CMD_WRITE_MULTIPLE  0xC5
+#define ATA_CMD_SET_MULTIPLE    0xC6
+#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define ATA_IRQ             14
+#define ATA_POLL_TIMEOUT    1000000
+#define ATA_IRQ_TIMEOUT_MS  3000    // Milliseconds
+#define ATA_MAX_MULTIPLE    128     // Largest READ MULTIPLE block
+#define ATA_MAX_LBA28       0x10000000
+#define ATA_MAX_COUNT28     256     // Sectors per LBA28 command
+#define ATA_MAX_COUNT48     65536   // Sectors per LBA48 command
+
+// Bus-master IDE registers (offsets from BAR4, primary channel)
+#define BM_CMD              0x00
+#define BM_STATUS           0x02
+#define BM_PRDT             0x04
+
+#define BM_CMD_START        0x01
+#define BM_CMD_READ         0x08    // Device -> memory
+#define BM_STATUS_ACTIVE    0x01
+#define BM_STATUS_ERR       0x02
+#define BM_STATUS_IRQ       0x04
+
+// Physical Region Descriptor: one memory region of a DMA transfer
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;         // 0 = 64 KB
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+#define ATA_PRD_EOT         0x8000
+#define ATA_PRD_MAX         512     // 64 KB each: one 65536-sector command
+
+// Table must not cross a 64 KB boundary: align it to its own size
+static ata_prd_t ata_prdt[ATA_PRD_MAX] __attribute__((aligned(sizeof(ata_prd_t) * ATA_PRD_MAX)));
+static uint16_t  ata_bmide = 0;     // Bus-master base port, 0 = PIO only
+
+static uint16_t ata_ident[256];
+static char     ata_model[41];
+static uint32_t ata_sectors = 0;
+static uint32_t ata_multiple = 0;  // Sectors per DRQ block, 0 = READ SECTORS
+static bool     ata_lba48 = false;  // 48-bit feature set supported
+
+static volatile bool    ata_irq_pending = false;
+static volatile uint8_t ata_irq_status = 0;
+
+static void ata_irq_handler(registers_t* regs) {
+    (void)regs;
+    ata_irq_status = inb(ATA_STATUS);   // Reading status acknowledges INTRQ
+    ata_irq_pending = true;
+}
+
+// ~400 ns: four reads of the alternate status register
+static void ata_delay400(void) {
+    for (int i = 0; i < 4; i++) inb(ATA_CTRL);
+}
+
+// Poll until BSY clears; returns the final status, or 0xFF on timeout
+static uint8_t ata_poll(void) {
+    for (uint32_t timeout = ATA_POLL_TIMEOUT; timeout; timeout--) {
+        uint8_t s = inb(ATA_STATUS);
+        if (!(s & ATA_STATUS_BSY)) return s;
+    }
+    return 0xFF;
+}
+
+// Wait for ATA drive to be ready
+static bool ata_wait(void) {
+    uint32_t timeout = 100000;
+    while (timeout--) {
+        uint8_t s = inb(ATA_STATUS);
+        if (s & ATA_STATUS_ERR) return false;
+        if (!(s & ATA_STATUS_BSY) && (s & ATA_STATUS_RDY)) return true;
+    }
+    return false;
+}
+
+// Sleep until IRQ14 reports the next block; returns the status it read
+static uint8_t ata_wait_irq(void) {
+    uint32_t start = timer_get_ticks();
+    for (;;) {
+        __asm__ volatile ("cli");
+        if (ata_irq_pending) break;
+        if (timer_get_ticks() - start > timer_ms_to_ticks(ATA_IRQ_TIMEOUT_MS)) {
+            __asm__ volatile ("sti");
+            return 0xFF;
+        }
+        __asm__ volatile ("sti; hlt");  // sti shadow: no wakeup is lost
+    }
+    ata_irq_pending = false;
+    __asm__ volatile ("sti");
+    return ata_irq_status;
+}
+
+// Wait until the drive has a data block ready
+static bool ata_wait_drq(bool use_irq) {
+    uint8_t s = use_irq ? ata_wait_irq() : ata_poll();
+    if (s == 0xFF || (s & (ATA_STATUS_ERR | ATA_STATUS_DF))) return false;
+    return (s & ATA_STATUS_DRQ) != 0;
+}
+
+// Does this transfer need the 48-bit commands?
+static bool ata_need_lba48(uint32_t lba, uint32_t count) {
+    return count > ATA_MAX_COUNT28 || lba + count > ATA_MAX_LBA28;
+}
+
+static bool ata_check_range(uint32_t lba, uint32_t count) {
+    if (count == 0 || count > ATA_MAX_COUNT48) return false;
+    if (lba + count < lba) return false;
+    return !ata_need_lba48(lba, count) || ata_lba48;
+}
+
+// Program the task file and issue `cmd`. A count of 256 (LBA28) or
+// 65536 (LBA48) is encoded as 0.
+static void ata_issue(uint8_t cmd, uint32_t lba, uint32_t count, bool lba48) {
+    if (lba48) {
+        // High-order bytes first, then the low-order bytes
+        outb(ATA_DRIVE,      0x40);
+        outb(ATA_SECT_COUNT, (count >> 8) & 0xFF);
+        outb(ATA_LBA_LO,     (lba >> 24) & 0xFF);
+        outb(ATA_LBA_MID,    0);    // LBA bits 32-47 (unused)
+        outb(ATA_LBA_HI,     0);
+        outb(ATA_SECT_COUNT, count & 0xFF);
+        outb(ATA_LBA_LO,     (lba & 0xFF));
+        outb(ATA_LBA_MID,    (lba >> 8) & 0xFF);
+        outb(ATA_LBA_HI,     (lba >> 16) & 0xFF);
+    } else {
+        outb(ATA_DRIVE,      0xE0 | ((lba >> 24) & 0x0F));
+        outb(ATA_ERROR,      0x00);
+        outb(ATA_SECT_COUNT, count & 0xFF);
+        outb(ATA_LBA_LO,     (lba & 0xFF));
+        outb(ATA_LBA_MID,    (lba >> 8) & 0xFF);
+        outb(ATA_LBA_HI,     (lba >> 16) & 0xFF);
+    }
+    outb(ATA_CMD, cmd);
+}
+
+// Read sectors via PIO (READ MULTIPLE when enabled, EXT when needed)
+bool ata_read_sectors(uint32_t lba, uint32_t count, uint8_t* buf) {
+    if (!ata_check_range(lba, count)) return false;
+    if (!ata_wait()) return false;
+
+    bool use_irq = interrupts_enabled();
+    bool lba48 = ata_need_lba48(lba, count);
+    uint32_t block = ata_multiple ? ata_multiple : 1;
+    uint8_t cmd;
+    if (ata_multiple) cmd = lba48 ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE;
+    else              cmd = lba48 ? ATA_CMD_READ_EXT : ATA_CMD_READ;
+
+    ata_irq_pending = false;
+    ata_issue(cmd, lba, count, lba48);
+
+    uint32_t left = count;
+    while (left) {
+        uint32_t n = left < block ? left : block;
+        if (!ata_wait_drq(use_irq)) return false;
+        insw(ATA_DATA, buf, n * 256);
+        buf  += n * 512;
+        left -= n;
+    }
+    return true;
+}
+
+// Write sectors via PIO. The first block is sent as soon as DRQ is set;
+// after each block the drive interrupts, and the last interrupt reports
+// the result.
+bool ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buf) {
+    if (!ata_check_range(lba, count)) return false;
+    if (!ata_wait()) return false;
+
+    bool use_irq = interrupts_enabled();
+    bool lba48 = ata_need_lba48(lba, count);
+    uint32_t block = ata_multiple ? ata_multiple : 1;
+    uint8_t cmd;
+    if (ata_multiple) cmd = lba48 ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE;
+    else              cmd = lba48 ? ATA_CMD_WRITE_EXT : ATA_CMD_WRITE;
+
+    ata_irq_pending = false;
+    ata_issue(cmd, lba, count, lba48);
+    if (!ata_wait_drq(false)) return false;
+
+    uint32_t left = count;
+    while (left) {
+        uint32_t n = left < block ? left : block;
+        outsw(ATA_DATA, buf, n * 256);
+        buf  += n * 512;
+        left -= n;
+
+        uint8_t st = use_irq ? ata_wait_irq() : ata_poll();
+        if (st == 0xFF || (st & (ATA_STATUS_ERR | ATA_STATUS_DF))) return false;
+        if (left && !(st & ATA_STATUS_DRQ)) return false;
+    }
+    return true;
+}
+
+// Commit the drive's write cache
+bool ata_flush(void) {
+    if (!ata_wait()) return false;
+    bool use_irq = interrupts_enabled();
+    ata_irq_pending = false;
+    outb(ATA_DRIVE, 0xE0);
+    outb(ATA_CMD, ata_lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+    uint8_t st = use_irq ? ata_wait_irq() : ata_poll();
+    return st != 0xFF && !(st & (ATA_STATUS_ERR | ATA_STATUS_DF));
+}
+
+// Fill the PRD table; no region may cross a 64 KB boundary.
+// Returns the number of descriptors, 0 if the list does not fit.
+static uint32_t ata_build_prdt(const ata_sg_t* sg, uint32_t nsg) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nsg; i++) {
+        uint32_t addr = sg[i].addr;
+        uint32_t len  = sg[i].len;
+        while (len) {
+            uint32_t chunk = 0x10000 - (addr & 0xFFFF);
+            if (chunk > len) chunk = len;
+            if (n == ATA_PRD_MAX) return 0;
+            ata_prdt[n].addr  = addr;
+            ata_prdt[n].bytes = (uint16_t)chunk;
+            ata_prdt[n].flags = 0;
+            n++;
+            addr += chunk;
+            len  -= chunk;
+        }
+    }
+    if (n) ata_prdt[n - 1].flags = ATA_PRD_EOT;
+    return n;
+}
+
+bool ata_dma_available(void) {
+    return ata_bmide != 0;
+}
+
+// READ DMA / WRITE DMA (EXT when needed) of `count` sectors through a
+// scatter-gather list of physical memory regions (total length must be
+// count * 512). Returns an ATA_DMA_ code.
+int ata_dma_transfer(uint32_t lba, uint32_t count, const ata_sg_t* sg, uint32_t nsg,
+                     bool write) {
+    if (!ata_bmide || !ata_check_range(lba, count)) return ATA_DMA_SKIPPED;
+    if (!ata_build_prdt(sg, nsg)) return ATA_DMA_SKIPPED;
+    if (!ata_wait()) return ATA_DMA_FAILED;
+
+    bool use_irq = interrupts_enabled();
+    bool lba48 = ata_need_lba48(lba, count);
+    uint8_t dir = write ? 0 : BM_CMD_READ;
+    uint8_t cmd;
+    if (write) cmd = lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA;
+    else       cmd = lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA;
+
+    outb(ata_bmide + BM_CMD, 0);
+    outl(ata_bmide + BM_PRDT, (uint32_t)(uintptr_t)ata_prdt);
+    outb(ata_bmide + BM_STATUS, inb(ata_bmide + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_IRQ);
+    outb(ata_bmide + BM_CMD, dir);
+
+    ata_irq_pending = false;
+    ata_issue(cmd, lba, count, lba48);
+    outb(ata_bmide + BM_CMD, dir | BM_CMD_START);
+
+    uint8_t s;
+    if (use_irq) {
+        s = ata_wait_irq();
+    } else {
+        uint32_t timeout = ATA_POLL_TIMEOUT;
+        while (timeout-- && !(inb(ata_bmide + BM_STATUS) & BM_STATUS_IRQ));
+        s = ata_poll();
+    }
+
+    uint8_t bms = inb(ata_bmide + BM_STATUS);
+    outb(ata_bmide + BM_CMD, 0);
+    outb(ata_bmide + BM_STATUS, bms | BM_STATUS_ERR | BM_STATUS_IRQ);
+
+    if (s != 0xFF && (s & (ATA_STATUS_ERR | ATA_STATUS_DF))) return ATA_DMA_ERROR;
+    if (bms & BM_STATUS_ERR) return ATA_DMA_ERROR;
+    if (s == 0xFF || (bms & BM_STATUS_ACTIVE)) return ATA_DMA_FAILED;
+    return ATA_DMA_OK;
+}
+
+// Locate the PCI IDE controller's bus-master registers
+static void ata_dma_init(void) {
+    if (!(ata_ident[49] & 0x0100)) return;      // Drive has no DMA
+
+    pci_device_t* ide = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, 0);
+    if (!ide || !(ide->prog_if & 0x80)) return;  // No bus-master support
+    if (!(ide->bar[4] & 1)) return;             // BAR4 must be I/O space
+
+    pci_enable_master(ide);
+    ata_bmide = ide->bar[4] & 0xFFFC;
+}
+
+// IDENTIFY DEVICE; false when there is no ATA disk on the primary master
+static bool ata_identify(void) {
+    outb(ATA_DRIVE, 0xA0);
+    ata_delay400();
+    outb(ATA_SECT_COUNT, 0);
+    outb(ATA_LBA_LO, 0);
+    outb(ATA_LBA_MID, 0);
+    outb(ATA_LBA_HI, 0);
+    outb(ATA_CMD, ATA_CMD_IDENTIFY);
+
+    uint8_t s = inb(ATA_STATUS);
+    if (s == 0 || s == 0xFF) return false;          // No drive / no controller
+
+    s = ata_poll();
+    if (s == 0xFF) return false;
+    if (inb(ATA_LBA_MID) || inb(ATA_LBA_HI)) return false;   // ATAPI or SATA
+    if (s & ATA_STATUS_ERR) return false;
+    if (!ata_wait_drq(false)) return false;
+
+    insw(ATA_DATA, ata_ident, 256);
+
+    // Model string: words 27-46, bytes swapped within each word
+    for (int i = 0; i < 20; i++) {
+        ata_model[i * 2]     = ata_ident[27 + i] >> 8;
+        ata_model[i * 2 + 1] = ata_ident[27 + i] & 0xFF;
+    }
+    ata_model[40] = '\0';
+    for (int i = 39; i >= 0 && ata_model[i] == ' '; i--) ata_model[i] = '\0';
+
+    ata_sectors = ata_ident[60] | ((uint32_t)ata_ident[61] << 16);
+
+    // 48-bit feature set: capacity in words 100-103 (clamped to 32 bits)
+    ata_lba48 = (ata_ident[83] & 0x0400) != 0;
+    if (ata_lba48) {
+        if (ata_ident[102] || ata_ident[103])
+            ata_sectors = 0xFFFFFFFF;
+        else if (ata_ident[100] | ata_ident[101])
+            ata_sectors = ata_ident[100] | ((uint32_t)ata_ident[101] << 16);
+    }
+    return ata_sectors != 0;
+}
+
+// Enable READ MULTIPLE with the drive's largest supported block
+static void ata_set_multiple(void) {
+    uint32_t max = ata_ident[47] & 0xFF;
+    uint32_t n = 1;
+    while (n * 2 <= max && n * 2 <= ATA_MAX_MULTIPLE) n *= 2;
+    if (max < 2) return;
+
+    outb(ATA_DRIVE, 0xE0);
+    outb(ATA_SECT_COUNT, (uint8_t)n);
+    outb(ATA_CMD, ATA_CMD_SET_MULTIPLE);
+    uint8_t s = ata_poll();
+    if (s != 0xFF && !(s & (ATA_STATUS_ERR | ATA_STATUS_DF)))
+        ata_multiple = n;
+}
+
+// Sectors per DMA command from one buffer: at any alignment they fit the
+// PRD table (one more descriptor than whole 64 KB pieces)
+#define ATA_DMA_CHUNK ((ATA_PRD_MAX - 1) * 128)
+
+// Move `count` sectors at `buf` by DMA, one chunk at a time. A chunk that
+// could not be done by DMA goes through PIO; only an error the hardware
+// reported turns DMA off for good.
+static bool ata_blk_transfer(uint32_t lba, uint32_t count, uint8_t* buf, bool write) {
+    if (!ata_check_range(lba, count)) return false;
+    while (count) {
+        uint32_t n = count < ATA_DMA_CHUNK ? count : ATA_DMA_CHUNK;
+        int rc = ATA_DMA_SKIPPED;
+        if (ata_bmide) {
+            // No paging: the buffer's address is its physical address
+            ata_sg_t sg = { (uint32_t)(uintptr_t)buf, n * 512 };
+            rc = ata_dma_transfer(lba, n, &sg, 1, write);
+            if (rc == ATA_DMA_ERROR) {
+                ata_bmide = 0;
+                vga_print("[ATA] DMA error, using PIO\n");
+            }
+        }
+        if (rc != ATA_DMA_OK &&
+            !(write ? ata_write_sectors(lba, n, buf) : ata_read_sectors(lba, n, buf)))
+            return false;
+        lba += n;
+        buf += n * 512;
+        count -= n;
+    }
+    return true;
+}
+
+static bool ata_blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buf) {
+    (void)dev;
+    return ata_blk_transfer(lba, count, buf, false);
+}
+
+static bool ata_blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buf) {
+    (void)dev;
+    return ata_blk_transfer(lba, count, (uint8_t*)buf, true);
+}
+
+static bool ata_blk_flush(blkdev_t* dev) {
+    (void)dev;
+    return ata_flush();
+}
+
+static const blkdev_ops_t ata_ops = {
+    .read  = ata_blk_read,
+    .write = ata_blk_write,
+    .flush = ata_blk_flush,
+};
+
+// Probe the primary master and register it as block device "hda"
+bool ata_init(void) {
+    outb(ATA_CTRL, ATA_CTRL_NIEN);      // No interrupts while probing
+    if (!ata_identify()) {
+        outb(ATA_CTRL, 0);
+        vga_print("[ATA] No disk on primary master\n");
+        return false;
+    }
+    ata_set_multiple();
+    ata_dma_init();
+
+    irq_install_handler(ATA_IRQ, ata_irq_handler);
+    irq_clear_mask(ATA_IRQ);
+    irq_clear_mask(2);                  // Cascade
+    outb(ATA_CTRL, 0);                  // Unmask INTRQ
+
+    vga_print("[ATA] hda: ");
+    vga_print(ata_model);
+    vga_print(", ");
+    vga_print_dec(ata_sectors / 2048);
+    vga_print(ata_lba48 ? " MB, LBA48, multiple=" : " MB, LBA28, multiple=");
+    vga_print_dec(ata_multiple);
+    if (ata_bmide) {
+        vga_print(", DMA at ");
+        vga_print_hex(ata_bmide);
+    }
+    vga_print("\n");
+
+    blkdev_register("hda", ata_sectors, ata_lba48 ? ATA_MAX_COUNT48 : ATA_MAX_COUNT28,
+                    &ata_ops, NULL);
+    return true;
+}
@@ -0,0 +1,25 @@
+// ata.h - ATA PIO disk driver (primary channel)
+#ifndef ATA_H
+#define ATA_H
+#include "../kernel/kernel.h"
+
+// Scatter-gather element: a physically contiguous memory region
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+} ata_sg_t;
+
+bool ata_init(void);
+bool ata_read_sectors(uint32_t lba, uint32_t count, uint8_t* buf);
+bool ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buf);
+bool ata_flush(void);
+// ata_dma_transfer() results
+#define ATA_DMA_OK      0
+#define ATA_DMA_SKIPPED 1   // Not started: no DMA, bad range, list too long for the PRD table
+#define ATA_DMA_FAILED  2   // No error reported (drive busy, timeout): retry with PIO
+#define ATA_DMA_ERROR   3   // The drive (ERR/DF) or the bus master (ERR) reported an error
+
+bool ata_dma_available(void);
+int  ata_dma_transfer(uint32_t lba, uint32_t count, const ata_sg_t* sg, uint32_t nsg,
+                      bool write);
+#endif
@@ -0,0 +1,221 @@
+// blkdev.c - Block device layer
+//
+// Drivers register a device with synchronous read/write ops. Filesystems queue
+// requests with blk_submit() and flush them with blk_run(), which works
+// like a simple elevator: the queue is kept sorted by LBA, and runs of
+// adjacent or overlapping requests are issued as one driver transfer.
+// When the callers' buffers already sit back to back in memory the data
+// lands in place and the run may grow to the device's max_transfer;
+// otherwise it goes through a bounce buffer and is capped at its size.
+// Reads and writes are never merged with each other, and writes only when
+// they touch without overlapping, so no sector is written twice.
+//
+// Devices with a command queue (ops->start) get every run started at once,
+// up to BLK_MAX_INFLIGHT, and complete them in any order. Only zero-copy
+// runs are merged for them, since the bounce buffer cannot be shared.
+
+#include "blkdev.h"
+#include "../kernel/kernel.h"
+
+static blkdev_t blk_devices[BLK_MAX_DEVICES];
+static uint32_t blk_num_devices = 0;
+static uint8_t  blk_bounce[BLK_BOUNCE_SECTORS * BLK_SECTOR_SIZE];
+
+blkdev_t* blkdev_register(const char* name, uint32_t sectors, uint32_t max_transfer,
+                          const blkdev_ops_t* ops, void* priv) {
+    if (blk_num_devices >= BLK_MAX_DEVICES) return NULL;
+
+    blkdev_t* dev = &blk_devices[blk_num_devices++];
+    memset(dev, 0, sizeof(*dev));
+    strncpy(dev->name, name, sizeof(dev->name) - 1);
+    dev->sectors      = sectors;
+    dev->max_transfer = max_transfer;
+    dev->ops          = ops;
+    dev->priv         = priv;
+    return dev;
+}
+
+blkdev_t* blkdev_get(uint32_t index) {
+    return index < blk_num_devices ? &blk_devices[index] : NULL;
+}
+
+blkdev_t* blkdev_find(const char* name) {
+    for (uint32_t i = 0; i < blk_num_devices; i++)
+        if (strcmp(blk_devices[i].name, name) == 0) return &blk_devices[i];
+    return NULL;
+}
+
+uint32_t blkdev_count(void) {
+    return blk_num_devices;
+}
+
+void blk_submit(blkdev_t* dev, blk_request_t* req) {
+    req->status = BLK_PENDING;
+    dev->requests++;
+
+    // Insertion sort by LBA (stable: equal LBAs keep submission order)
+    blk_request_t** pp = &dev->queue;
+    while (*pp && (*pp)->lba <= req->lba) pp = &(*pp)->next;
+    req->next = *pp;
+    *pp = req;
+}
+
+static void blk_complete(blk_request_t* req, bool ok) {
+    req->status = ok ? BLK_OK : BLK_ERROR;
+    if (req->done) req->done(req);
+}
+
+static void blk_complete_all(blk_request_t* reqs, bool ok) {
+    for (blk_request_t* r = reqs; r; ) {
+        blk_request_t* next = r->next;  // Callback may reuse the request
+        blk_complete(r, ok);
+        r = next;
+    }
+}
+
+// Synchronous dispatch of the run `reqs` covering sectors [lo, hi)
+static void blk_dispatch(blkdev_t* dev, blk_request_t* reqs, uint32_t lo, uint32_t hi,
+                         bool in_place) {
+    bool ok;
+    if (reqs->write) {
+        if (!dev->ops->write) {
+            ok = false;
+        } else if (in_place) {
+            ok = dev->ops->write(dev, lo, hi - lo, reqs->buf);
+        } else {
+            for (blk_request_t* r = reqs; r; r = r->next)
+                memcpy(blk_bounce + (r->lba - lo) * BLK_SECTOR_SIZE, r->buf,
+                       r->count * BLK_SECTOR_SIZE);
+            ok = dev->ops->write(dev, lo, hi - lo, blk_bounce);
+        }
+    } else if (in_place) {
+        ok = dev->ops->read(dev, lo, hi - lo, reqs->buf);
+    } else {
+        ok = dev->ops->read(dev, lo, hi - lo, blk_bounce);
+        if (ok) {
+            for (blk_request_t* r = reqs; r; r = r->next)
+                memcpy(r->buf, blk_bounce + (r->lba - lo) * BLK_SECTOR_SIZE,
+                       r->count * BLK_SECTOR_SIZE);
+        }
+    }
+    blk_complete_all(reqs, ok);
+}
+
+void blk_transfer_done(blk_transfer_t* xfer, bool ok) {
+    blkdev_t* dev = xfer->dev;
+    blk_request_t* reqs = xfer->reqs;
+    xfer->reqs = NULL;
+    xfer->busy = false;
+    dev->inflight--;
+    blk_complete_all(reqs, ok);
+}
+
+// Queued dispatch: hand the run to the driver, waiting for a free slot
+static void blk_start(blkdev_t* dev, blk_request_t* reqs, uint32_t lo, uint32_t hi) {
+    for (;;) {
+        if (dev->inflight < BLK_MAX_INFLIGHT) {
+            blk_transfer_t* x = NULL;
+            for (uint32_t i = 0; i < BLK_MAX_INFLIGHT && !x; i++)
+                if (!dev->xfers[i].busy) x = &dev->xfers[i];
+
+            x->dev   = dev;
+            x->lba   = lo;
+            x->count = hi - lo;
+            x->buf   = reqs->buf;
+            x->write = reqs->write;
+            x->reqs  = reqs;
+            x->busy  = true;
+            dev->inflight++;
+            if (dev->ops->start(dev, x)) break;
+            x->busy = false;
+            x->reqs = NULL;
+            dev->inflight--;
+        }
+        dev->ops->poll(dev);
+    }
+    if (dev->inflight > dev->max_inflight) dev->max_inflight = dev->inflight;
+}
+
+void blk_run(blkdev_t* dev) {
+    bool queued = dev->ops->start != NULL;
+
+    while (dev->queue) {
+        blk_request_t* first = dev->queue;
+        blk_request_t* last = first;
+        uint32_t lo = first->lba;
+        uint32_t hi = first->lba + first->count;
+        bool in_place = true;
+
+        // Grow the run while the next request touches or overlaps it.
+        // Zero-copy holds while every buffer sits where a single transfer
+        // would put it; once it breaks the run must fit the bounce buffer.
+        while (last->next && last->next->lba <= hi) {
+            blk_request_t* n = last->next;
+            if (n->write != first->write || (n->write && n->lba < hi)) break;
+            uint32_t n_hi = n->lba + n->count;
+            uint32_t new_hi = n_hi > hi ? n_hi : hi;
+            bool n_in_place = in_place && n->lba == hi &&
+                              n->buf == first->buf + (n->lba - lo) * BLK_SECTOR_SIZE;
+            if (!n_in_place && queued) break;
+            uint32_t limit = n_in_place ? dev->max_transfer : BLK_BOUNCE_SECTORS;
+            if (new_hi - lo > limit) break;
+            in_place = n_in_place;
+            hi = new_hi;
+            if (n != first) dev->merged++;
+            last = n;
+        }
+
+        // Detach the run; it is now owned by this transfer
+        dev->queue = last->next;
+        last->next = NULL;
+        dev->transfers++;
+
+        if (queued) blk_start(dev, first, lo, hi);
+        else        blk_dispatch(dev, first, lo, hi, in_place);
+    }
+
+    while (dev->inflight) dev->ops->poll(dev);
+}
+
+bool blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buf) {
+    blk_request_t req = {0};
+    bool ok = true;
+
+    // Split oversized reads so each piece fits one driver transfer
+    while (count && ok) {
+        uint32_t n = count < dev->max_transfer ? count : dev->max_transfer;
+        req.lba   = lba;
+        req.count = n;
+        req.buf   = buf;
+        req.write = false;
+        req.done  = NULL;
+        blk_submit(dev, &req);
+        blk_run(dev);
+        ok = req.status == BLK_OK;
+        lba += n; count -= n; buf += n * BLK_SECTOR_SIZE;
+    }
+    return ok;
+}
+
+bool blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buf) {
+    blk_request_t req = {0};
+    bool ok = true;
+
+    while (count && ok) {
+        uint32_t n = count < dev->max_transfer ? count : dev->max_transfer;
+        req.lba   = lba;
+        req.count = n;
+        req.buf   = (uint8_t*)buf;  // Only read from for a write
+        req.write = true;
+        req.done  = NULL;
+        blk_submit(dev, &req);
+        blk_run(dev);
+        ok = req.status == BLK_OK;
+        lba += n; count -= n; buf += n * BLK_SECTOR_SIZE;
+    }
+    return ok;
+}
+
+bool blk_flush(blkdev_t* dev) {
+    return dev->ops->flush ? dev->ops->flush(dev) : true;
+}
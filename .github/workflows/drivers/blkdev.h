@@ -0,0 +1,101 @@
+// blkdev.h - Block device layer (device table + request queue)
+#ifndef BLKDEV_H
+#define BLKDEV_H
+#include "../kernel/kernel.h"
+
+#define BLK_SECTOR_SIZE     512
+#define BLK_MAX_DEVICES     4
+#define BLK_BOUNCE_SECTORS  128     // Largest merge that needs a bounce (64 KB)
+#define BLK_MAX_INFLIGHT    32      // Outstanding transfers on a queued device
+
+// Request status
+#define BLK_PENDING 0
+#define BLK_OK      1
+#define BLK_ERROR   2
+
+struct blkdev;
+typedef struct blk_request blk_request_t;
+typedef void (*blk_done_t)(blk_request_t* req);
+
+struct blk_request {
+    uint32_t       lba;
+    uint32_t       count;       // Sectors
+    uint8_t*       buf;
+    bool           write;       // Disk <- buf (default: disk -> buf)
+    uint8_t        status;      // BLK_PENDING until completed
+    blk_done_t     done;        // Completion callback (may be NULL)
+    void*          ctx;         // For the callback
+    blk_request_t* next;        // Queue link (owned by the block layer)
+};
+
+// One driver command, serving a run of one or more merged requests
+typedef struct blk_transfer {
+    struct blkdev* dev;
+    uint32_t       lba;
+    uint32_t       count;
+    uint8_t*       buf;
+    bool           write;
+    blk_request_t* reqs;        // Requests it completes (NULL-terminated)
+    bool           busy;
+    uint8_t        tag;         // Free for the driver (e.g. command slot)
+} blk_transfer_t;
+
+typedef struct {
+    // Synchronous transfer of `count` sectors, count <= max_transfer
+    // (not needed by devices that provide start/poll)
+    bool (*read)(struct blkdev* dev, uint32_t lba, uint32_t count, uint8_t* buf);
+    bool (*write)(struct blkdev* dev, uint32_t lba, uint32_t count, const uint8_t* buf);
+
+    // Optional queued interface for devices that accept several commands
+    // at once. start() returns false when no command slot is free; each
+    // started transfer is finished with blk_transfer_done(), usually from
+    // the driver's IRQ handler. poll() waits for (or reaps) completions.
+    bool (*start)(struct blkdev* dev, blk_transfer_t* xfer);
+    void (*poll)(struct blkdev* dev);
+
+    // Optional: commit the drive's volatile write cache to the medium
+    bool (*flush)(struct blkdev* dev);
+
+    // Optional, memory-backed devices: address of sector `lba` (NULL past
+    // the end), so cached reads copy straight from it
+    uint8_t* (*map)(struct blkdev* dev, uint32_t lba);
+} blkdev_ops_t;
+
+typedef struct blkdev {
+    char                name[8];
+    uint32_t            sectors;        // Capacity (0 = unknown)
+    uint32_t            max_transfer;   // Sectors per driver call (up to 65536)
+    const blkdev_ops_t* ops;
+    void*               priv;           // Driver data
+    blk_request_t*      queue;          // Pending requests, sorted by LBA
+    blk_transfer_t      xfers[BLK_MAX_INFLIGHT];
+    volatile uint32_t   inflight;       // Started, not yet completed
+
+    // Statistics
+    uint32_t            requests;       // Requests submitted
+    uint32_t            merged;         // Requests folded into another transfer
+    uint32_t            transfers;      // Driver calls
+    uint32_t            max_inflight;   // Deepest queue seen
+} blkdev_t;
+
+blkdev_t* blkdev_register(const char* name, uint32_t sectors, uint32_t max_transfer,
+                          const blkdev_ops_t* ops, void* priv);
+blkdev_t* blkdev_get(uint32_t index);
+blkdev_t* blkdev_find(const char* name);
+uint32_t  blkdev_count(void);
+
+// Queue a request (count <= dev->max_transfer); nothing is transferred
+// until blk_run()
+void      blk_submit(blkdev_t* dev, blk_request_t* req);
+// Dispatch all queued requests in LBA order, merging adjacent/overlapping
+// ones of the same direction, and wait until every one of them has
+// completed
+void      blk_run(blkdev_t* dev);
+// Called by queued drivers when a started transfer finishes
+void      blk_transfer_done(blk_transfer_t* xfer, bool ok);
+// Synchronous helper: submit + run a single request
+bool      blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buf);
+bool      blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buf);
+// Flush the drive's write cache (true when the device has none)
+bool      blk_flush(blkdev_t* dev);
+#endif
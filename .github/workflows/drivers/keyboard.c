@@ -9,16 +9,22 @@
 #define KB_STATUS_PORT  0x64
 #define KB_CMD_PORT     0x64
 
-// Keyboard buffer
-#define KB_BUFFER_SIZE 256
-static char kb_buffer[KB_BUFFER_SIZE];
-static volatile uint32_t kb_buf_head = 0;
-static volatile uint32_t kb_buf_tail = 0;
-
-static bool shift_pressed = false;
-static bool caps_lock = false;
-static bool ctrl_pressed = false;
-static bool alt_pressed = false;
+// Event ring: the IRQ handler is the only writer of kb_head, the reader
+// (the shell) the only writer of kb_tail, so neither side takes a lock or
+// masks interrupts. The counters run freely and are masked on use; a
+// compiler barrier orders the slot access against publishing the counter
+// (x86 does not reorder stores with stores or loads with loads).
+#define KB_QUEUE_SIZE 128           // Power of two
+static kb_event_t        kb_ring[KB_QUEUE_SIZE];
+static volatile uint32_t kb_head = 0;
+static volatile uint32_t kb_tail = 0;
+
+static uint8_t    kb_mods = 0;
+static bool       kb_extended = false;  // Last byte was the 0xE0 prefix
+static volatile bool kb_break = false;  // Ctrl+C pressed
+static kb_stats_t kb_stats;
+
+#define kb_barrier() __asm__ volatile ("" ::: "memory")
 
 // US QWERTY scancode set 1
 static const char scancode_table[] = {
@@ -43,49 +49,72 @@ static const char scancode_shift[] = {
     0,   ' ', 0,   0,   0,   0,   0,   0,
 };
 
+
+// Character for a key press, 0 for keys without one (and Ctrl combinations)
+static char kb_translate(uint8_t keycode, uint8_t mods) {
+    if (mods & KB_MOD_CTRL) return 0;
+    if (keycode == KEY_KP_ENTER) return '\n';
+    if (keycode == KEY_KP_SLASH) return '/';
+    if (keycode >= sizeof(scancode_table)) return 0;
+    bool upper = ((mods & KB_MOD_SHIFT) != 0) ^ ((mods & KB_MOD_CAPS) != 0);
+    return upper ? scancode_shift[keycode] : scancode_table[keycode];
+}
+
 static void keyboard_irq_handler(registers_t* regs) {
+    // Nothing to read, or the byte is the mouse's (IRQ 12 takes it)
+    uint8_t status = inb(KB_STATUS_PORT);
+    if (!(status & 0x01) || (status & 0x20)) return;
+
     uint8_t scancode = inb(KB_DATA_PORT);
+    if (scancode == 0xE0) {
+        kb_extended = true;
+        return;
+    }
     bool released = (scancode & 0x80) != 0;
-    scancode &= 0x7F;
-
-    // Handle special keys
-    switch (scancode) {
-        case 0x2A: case 0x36:  // Left/Right Shift
-            shift_pressed = !released;
-            return;
-        case 0x1D:              // Ctrl
-            ctrl_pressed = !released;
-            return;
-        case 0x38:              // Alt
-            alt_pressed = !released;
+    uint8_t keycode = (scancode & 0x7F) | (kb_extended ? 0x80 : 0);
+    kb_extended = false;
+
+    // Track modifiers (left and right keys share a bit)
+    switch (keycode) {
+        case 0x2A: case 0x36:   // Left/Right Shift
+            kb_mods = released ? kb_mods & ~KB_MOD_SHIFT : kb_mods | KB_MOD_SHIFT;
+            break;
+        case 0xAA: case 0xB6:   // Fake shifts the keyboard wraps extended keys in
             return;
+        case 0x1D: case 0x9D:   // Left/Right Ctrl
+            kb_mods = released ? kb_mods & ~KB_MOD_CTRL : kb_mods | KB_MOD_CTRL;
+            break;
+        case 0x38: case 0xB8:   // Left/Right Alt
+            kb_mods = released ? kb_mods & ~KB_MOD_ALT : kb_mods | KB_MOD_ALT;
+            break;
         case 0x3A:              // Caps Lock
-            if (!released) caps_lock = !caps_lock;
-            return;
+            if (!released) kb_mods ^= KB_MOD_CAPS;
+            break;
     }
 
-    if (released) return;
+    if (keycode == KEY_C && !released && (kb_mods & KB_MOD_CTRL)) kb_break = true;
 
-    // Get character
-    char c = 0;
-    if (scancode < sizeof(scancode_table)) {
-        bool upper = shift_pressed ^ caps_lock;
-        c = upper ? scancode_shift[scancode] : scancode_table[scancode];
-    }
-
-    if (c == 0) return;
-
-    // Buffer the character
-    uint32_t next = (kb_buf_head + 1) % KB_BUFFER_SIZE;
-    if (next != kb_buf_tail) {
-        kb_buffer[kb_buf_head] = c;
-        kb_buf_head = next;
+    uint32_t head = kb_head;
+    if (head - kb_tail == KB_QUEUE_SIZE) {
+        kb_stats.dropped++;
+        return;
     }
+    kb_event_t* ev = &kb_ring[head & (KB_QUEUE_SIZE - 1)];
+    ev->tsc      = rdtsc();
+    ev->scancode = scancode;
+    ev->keycode  = keycode;
+    ev->mods     = kb_mods;
+    ev->released = released;
+    ev->ch       = released ? 0 : kb_translate(keycode, kb_mods);
+    kb_barrier();
+    kb_head = head + 1;
+    kb_stats.events++;
 }
 
 void keyboard_init(void) {
-    // Wait for controller to be ready
-    while (inb(KB_STATUS_PORT) & 0x02);
+    // Wait for controller to be ready (bounded: no controller reads 0xFF)
+    uint32_t timeout = 100000;
+    while (timeout-- && (inb(KB_STATUS_PORT) & 0x02));
 
     // Enable keyboard (clear any pending data)
     inb(KB_DATA_PORT);
@@ -94,20 +123,79 @@ void keyboard_init(void) {
     irq_clear_mask(1);
 }
 
+bool keyboard_read_event(kb_event_t* ev) {
+    uint32_t tail = kb_tail;
+    if (tail == kb_head) return false;
+    kb_barrier();
+    *ev = kb_ring[tail & (KB_QUEUE_SIZE - 1)];
+    kb_barrier();
+    kb_tail = tail + 1;
+    return true;
+}
+
+void keyboard_wait(void) {
+    // Check and sleep with interrupts off, so an event posted in between
+    // cannot be missed; the sti shadow covers the hlt
+    __asm__ volatile ("cli");
+    if (kb_tail != kb_head) {
+        __asm__ volatile ("sti");
+        return;
+    }
+    uint64_t start = rdtsc();
+    if (!kb_stats.idle_since) kb_stats.idle_since = start;
+    __asm__ volatile ("sti; hlt" ::: "memory");
+    kb_stats.idle_cycles += rdtsc() - start;
+}
+
+void keyboard_wait_event(kb_event_t* ev) {
+    while (!keyboard_read_event(ev)) keyboard_wait();
+}
+
+// Drop queued events that carry no character (releases, modifiers, arrows)
+static void kb_skip_nonchar(void) {
+    uint32_t tail;
+    while ((tail = kb_tail) != kb_head) {
+        kb_barrier();
+        if (kb_ring[tail & (KB_QUEUE_SIZE - 1)].ch) return;
+        kb_tail = tail + 1;
+    }
+}
+
+// Time from the IRQ to handing the character over
+static void kb_account(const kb_event_t* ev) {
+    uint64_t lat = rdtsc() - ev->tsc;
+    kb_stats.delivered++;
+    kb_stats.latency_total += lat;
+    if (lat > kb_stats.latency_max) kb_stats.latency_max = lat;
+}
+
 bool keyboard_has_key(void) {
-    return kb_buf_head != kb_buf_tail;
+    kb_skip_nonchar();
+    return kb_tail != kb_head;
 }
 
 char keyboard_getchar(void) {
-    while (!keyboard_has_key());
-    char c = kb_buffer[kb_buf_tail];
-    kb_buf_tail = (kb_buf_tail + 1) % KB_BUFFER_SIZE;
-    return c;
+    kb_event_t ev;
+    do {
+        keyboard_wait_event(&ev);
+    } while (!ev.ch);
+    kb_account(&ev);
+    return ev.ch;
 }
 
 char keyboard_try_getchar(void) {
-    if (!keyboard_has_key()) return 0;
-    char c = kb_buffer[kb_buf_tail];
-    kb_buf_tail = (kb_buf_tail + 1) % KB_BUFFER_SIZE;
-    return c;
+    kb_event_t ev;
+    if (!keyboard_has_key() || !keyboard_read_event(&ev)) return 0;
+    kb_account(&ev);
+    return ev.ch;
+}
+
+bool keyboard_take_break(void) {
+    if (!kb_break) return false;
+    kb_break = false;
+    return true;
+}
+
+void keyboard_get_stats(kb_stats_t* st) {
+    *st = kb_stats;
 }
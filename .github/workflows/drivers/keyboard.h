@@ -3,8 +3,64 @@
 #define KEYBOARD_H
 #include "../kernel/kernel.h"
 
+// Modifier bits in kb_event_t.mods (state after the event)
+#define KB_MOD_SHIFT    0x01
+#define KB_MOD_CTRL     0x02
+#define KB_MOD_ALT      0x04
+#define KB_MOD_CAPS     0x08
+
+// Key codes: the set 1 make code, | 0x80 for 0xE0-prefixed keys
+#define KEY_ESC         0x01
+#define KEY_C           0x2E
+#define KEY_F1          0x3B        // F1..F10 are consecutive
+#define KEY_F10         0x44
+#define KEY_F11         0x57
+#define KEY_F12         0x58
+#define KEY_KP_ENTER    0x9C
+#define KEY_KP_SLASH    0xB5
+#define KEY_HOME        0xC7
+#define KEY_UP          0xC8
+#define KEY_PGUP        0xC9
+#define KEY_LEFT        0xCB
+#define KEY_RIGHT       0xCD
+#define KEY_END         0xCF
+#define KEY_DOWN        0xD0
+#define KEY_PGDN        0xD1
+#define KEY_INSERT      0xD2
+#define KEY_DELETE      0xD3
+
+typedef struct {
+    uint64_t tsc;               // When the IRQ received it
+    uint8_t  scancode;          // Raw byte (without the 0xE0 prefix)
+    uint8_t  keycode;           // KEY_* / make code
+    uint8_t  mods;              // KB_MOD_*, state after this event
+    bool     released;
+    char     ch;                // Translated character, 0 if none
+} kb_event_t;
+
+typedef struct {
+    uint32_t events;            // Queued by the IRQ
+    uint32_t dropped;           // Queue full
+    uint32_t delivered;         // Characters handed to getchar callers
+    uint64_t latency_total;     // IRQ to delivery, TSC cycles
+    uint64_t latency_max;
+    uint64_t idle_cycles;       // Halted in keyboard_wait()
+    uint64_t idle_since;        // TSC of the first wait
+} kb_stats_t;
+
 void keyboard_init(void);
+// Next event, false if none queued
+bool keyboard_read_event(kb_event_t* ev);
+// Sleep (hlt) until the next interrupt, unless an event is already queued
+void keyboard_wait(void);
+// Block until an event arrives
+void keyboard_wait_event(kb_event_t* ev);
+// A character is queued (events without one are discarded)
 bool keyboard_has_key(void);
+// Block until a character arrives
 char keyboard_getchar(void);
 char keyboard_try_getchar(void);
+// Ctrl+C was pressed since the last call (clears it)
+bool keyboard_take_break(void);
+void keyboard_get_stats(kb_stats_t* st);
 #endif
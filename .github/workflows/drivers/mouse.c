@@ -1,10 +1,17 @@
 // mouse.c - PS/2 Mouse Driver (IRQ 12)
-// Supports standard 3-button PS/2 mouse with scroll wheel detection
+// Supports standard 3-button PS/2 mouse and the IntelliMouse wheel
+//
+// The IRQ handler drains every byte the controller has for us and only
+// sums packet deltas; the position is updated, clamped and the cursor
+// redrawn once per mouse_read_motion() call, however many packets came
+// in since. Drawing from the reader also keeps the cursor from racing
+// the console output.
 
 #include "mouse.h"
 #include "../kernel/kernel.h"
 #include "../kernel/idt.h"
 #include "../kernel/vga.h"
+#include "timer.h"
 
 #define MOUSE_STATUS    0x64    // Controller status port
 #define MOUSE_CMD       0x64    // Controller command port
@@ -15,19 +22,28 @@
 #define MOUSE_STATUS_OBF 0x01   // Output buffer full bit
 #define MOUSE_OUTBUF     0x20   // Mouse output buffer bit
 
-// Mouse state
-static volatile int32_t  mouse_x = 40;
-static volatile int32_t  mouse_y = 12;
-static volatile uint8_t  mouse_buttons = 0;
-static volatile int8_t   mouse_dx = 0;
-static volatile int8_t   mouse_dy = 0;
-
-static uint8_t mouse_cycle = 0;
-static uint8_t mouse_bytes[3];
-
 // Screen limits
 #define SCREEN_W 80
 #define SCREEN_H 25
+#define MOUSE_CELL 2            // Counts per character cell (finer control)
+#define MOUSE_DRAIN_MAX 16      // Bytes read per IRQ at most
+
+// Published state, owned by the reader
+static int32_t  mouse_fx = 40 * MOUSE_CELL;    // Position in counts
+static int32_t  mouse_fy = 12 * MOUSE_CELL;
+static uint8_t  mouse_buttons = 0;
+
+// Accumulated by the IRQ since the last read
+static volatile int32_t mouse_acc_dx = 0;
+static volatile int32_t mouse_acc_dy = 0;
+static volatile int32_t mouse_acc_wheel = 0;
+static volatile uint8_t mouse_acc_buttons = 0;
+static volatile bool    mouse_acc_new = false;
+
+static uint8_t mouse_cycle = 0;
+static uint8_t mouse_bytes[4];
+static uint8_t mouse_packet_size = 3;           // 4 with a wheel
+static mouse_stats_t mouse_stats;
 
 static void mouse_wait_write(void) {
     uint32_t timeout = 100000;
@@ -46,69 +62,148 @@ static void mouse_write(uint8_t data) {
     outb(MOUSE_DATA, data);
 }
 
-static uint8_t mouse_read(void) {
-    mouse_wait_read();
-    return inb(MOUSE_DATA);
-}
+// Setup handshake, driven by the bytes the mouse sends back on IRQ 12 so
+// init never spins on a slow (or absent) device: reset, wait for the
+// self-test result and ID, then send each setup command and wait for its
+// ACK. The sample rate sequence 200, 100, 80 is the IntelliMouse knock:
+// a wheel mouse answers the following Get ID with 3 and from then on
+// sends 4-byte packets.
+#define MOUSE_ACK       0xFA
+#define MOUSE_RESEND    0xFE
+#define MOUSE_BAT_OK    0xAA
+#define MOUSE_BAT_FAIL  0xFC
+#define MOUSE_TIMEOUT_MS 2000   // For the whole handshake
+
+typedef enum {
+    MOUSE_OFF,
+    MOUSE_RESET,                // Sent 0xFF, waiting for ACK
+    MOUSE_BAT,                  // Waiting for the self-test result
+    MOUSE_ID,                   // Waiting for the device ID
+    MOUSE_SETUP,                // Sent mouse_setup[mouse_step], waiting for ACK
+    MOUSE_SETUP_ID,             // Get ID acknowledged, waiting for the ID
+    MOUSE_READY,
+    MOUSE_FAILED,
+} mouse_state_t;
+
+#define MOUSE_GET_ID    0xF2
+#define MOUSE_ID_WHEEL  0x03
+
+static const uint8_t mouse_setup[] = {
+    0xF6,           // Set defaults
+    0xF3, 200,      // IntelliMouse knock
+    0xF3, 100,
+    0xF3, 80,
+    MOUSE_GET_ID,   // 3 = wheel enabled
+    0xF3, 100,      // Sample rate 100/sec
+    0xE8, 0x02,     // Resolution 4 counts/mm
+    0xF4,           // Enable data reporting
+};
 
-static uint8_t mouse_cmd(uint8_t cmd) {
-    mouse_write(cmd);
-    return mouse_read();
+static volatile mouse_state_t mouse_state = MOUSE_OFF;
+static uint32_t mouse_step = 0;
+static uint32_t mouse_deadline = 0;
+
+// Send the next setup command, or finish
+static void mouse_setup_next(void) {
+    if (++mouse_step < sizeof(mouse_setup)) {
+        mouse_write(mouse_setup[mouse_step]);
+        return;
+    }
+    mouse_cycle = 0;
+    mouse_state = MOUSE_READY;
 }
 
-static void mouse_irq_handler(registers_t* regs) {
-    // Read data byte
-    if (!(inb(MOUSE_STATUS) & MOUSE_OUTBUF)) return;
-    
-    uint8_t data = inb(MOUSE_DATA);
-    mouse_bytes[mouse_cycle] = data;
-
-    switch (mouse_cycle) {
-        case 0:
-            // First byte: flags - bit 3 must be set (always 1)
-            if (!(data & 0x08)) return; // Invalid packet, stay at 0
-            mouse_cycle = 1;
+// One handshake byte from the IRQ handler
+static void mouse_handshake(uint8_t data) {
+    switch (mouse_state) {
+        case MOUSE_RESET:
+            if (data == MOUSE_ACK)         mouse_state = MOUSE_BAT;
+            else if (data == MOUSE_RESEND) mouse_write(0xFF);
             break;
-        case 1:
-            mouse_cycle = 2;
+        case MOUSE_BAT:
+            if (data == MOUSE_BAT_OK)        mouse_state = MOUSE_ID;
+            else if (data == MOUSE_BAT_FAIL) mouse_state = MOUSE_FAILED;
             break;
-        case 2: {
-            mouse_cycle = 0;
-
-            // Parse mouse packet
-            uint8_t flags = mouse_bytes[0];
-            int8_t  raw_dx = (int8_t)mouse_bytes[1];
-            int8_t  raw_dy = (int8_t)mouse_bytes[2];
-
-            // Handle X sign bit (bit 4)
-            int32_t dx = raw_dx;
-            // Handle Y sign bit (bit 5) - Y is inverted on PS/2
-            int32_t dy = -raw_dy;
+        case MOUSE_ID:
+            // 0x00 for a standard mouse
+            mouse_step = 0;
+            mouse_state = MOUSE_SETUP;
+            mouse_write(mouse_setup[0]);
+            break;
+        case MOUSE_SETUP:
+            if (data == MOUSE_RESEND) {
+                mouse_write(mouse_setup[mouse_step]);
+                break;
+            }
+            if (data != MOUSE_ACK) break;
+            if (mouse_setup[mouse_step] == MOUSE_GET_ID) {
+                mouse_state = MOUSE_SETUP_ID;
+                break;
+            }
+            mouse_setup_next();
+            break;
+        case MOUSE_SETUP_ID:
+            mouse_packet_size = data == MOUSE_ID_WHEEL ? 4 : 3;
+            mouse_state = MOUSE_SETUP;
+            mouse_setup_next();
+            break;
+        default:
+            break;
+    }
+}
 
-            // Overflow flags - discard packet
-            if ((flags & 0x40) || (flags & 0x80)) break;
+// A complete packet: add its movement to the pending totals
+static void mouse_packet(void) {
+    uint8_t flags = mouse_bytes[0];
+    mouse_stats.packets++;
 
-            mouse_buttons = flags & 0x07;
-            mouse_dx = (int8_t)dx;
-            mouse_dy = (int8_t)dy;
+    // Overflow flags - discard packet
+    if (flags & 0xC0) return;
 
-            // Update position with bounds checking
-            mouse_x += dx / 2;  // Divide for finer control in text mode
-            mouse_y += dy / 2;
+    // Y is inverted on PS/2; the wheel is a signed 4-bit count
+    mouse_acc_dx += (int8_t)mouse_bytes[1];
+    mouse_acc_dy -= (int8_t)mouse_bytes[2];
+    if (mouse_packet_size == 4)
+        mouse_acc_wheel += (int8_t)(mouse_bytes[3] << 4) >> 4;
+    mouse_acc_buttons = flags & 0x07;
+    mouse_acc_new = true;
+}
 
-            if (mouse_x < 0) mouse_x = 0;
-            if (mouse_y < 0) mouse_y = 0;
-            if (mouse_x >= SCREEN_W) mouse_x = SCREEN_W - 1;
-            if (mouse_y >= SCREEN_H) mouse_y = SCREEN_H - 1;
+static void mouse_byte(uint8_t data) {
+    mouse_stats.bytes++;
+    if (mouse_state != MOUSE_READY) {
+        mouse_handshake(data);
+        return;
+    }
+    // First byte: flags - bit 3 must be set (always 1)
+    if (mouse_cycle == 0 && !(data & 0x08)) {
+        mouse_stats.resyncs++;
+        return;                     // Invalid packet, stay at 0
+    }
+    mouse_bytes[mouse_cycle++] = data;
+    if (mouse_cycle == mouse_packet_size) {
+        mouse_cycle = 0;
+        mouse_packet();
+    }
+}
 
-            // Draw mouse cursor on screen
-            vga_draw_mouse((uint32_t)mouse_x, (uint32_t)mouse_y);
+static void mouse_irq_handler(registers_t* regs) {
+    mouse_stats.irqs++;
+    // Take every byte the controller holds for the mouse, not just one
+    for (int n = 0; n < MOUSE_DRAIN_MAX; n++) {
+        uint8_t status = inb(MOUSE_STATUS);
+        if ((status & (MOUSE_STATUS_OBF | MOUSE_OUTBUF)) != (MOUSE_STATUS_OBF | MOUSE_OUTBUF))
             break;
-        }
+        mouse_byte(inb(MOUSE_DATA));
     }
 }
 
-void mouse_init(void) {
+bool mouse_start(void) {
+    // The controller answers on the keyboard's data port: keep the
+    // keyboard IRQ from taking the config byte
+    bool irq = interrupts_enabled();
+    __asm__ volatile ("cli");
+
     // Enable PS/2 mouse port
     mouse_wait_write();
     outb(MOUSE_CMD, 0xA8);  // Enable aux mouse device
@@ -125,38 +220,78 @@ void mouse_init(void) {
     mouse_wait_write();
     outb(MOUSE_DATA, status);
 
-    // Reset mouse
-    uint8_t ack = mouse_cmd(0xFF);
-    if (ack == 0xFA) {
-        mouse_read(); // Read BAT result (0xAA)
-        mouse_read(); // Device ID (0x00 for standard mouse)
-    }
+    // Install IRQ handler; the rest of the handshake runs on IRQ 12
+    irq_install_handler(12, mouse_irq_handler);
+    irq_clear_mask(12);
+    irq_clear_mask(2);  // Must also unmask cascade IRQ2
 
-    // Set defaults
-    mouse_cmd(0xF6);  // Set defaults
+    mouse_state = MOUSE_RESET;
+    mouse_deadline = timer_get_ticks() + timer_ms_to_ticks(MOUSE_TIMEOUT_MS);
+    mouse_write(0xFF);      // Reset mouse
+    if (irq) __asm__ volatile ("sti");
+    return true;
+}
 
-    // Set sample rate to 100/sec
-    mouse_cmd(0xF3);
-    mouse_cmd(100);
+initcall_state_t mouse_poll(void) {
+    if (mouse_state == MOUSE_READY) {
+        // Initial cursor draw
+        vga_draw_mouse((uint32_t)(mouse_fx / MOUSE_CELL), (uint32_t)(mouse_fy / MOUSE_CELL));
+        return INITCALL_DONE;
+    }
+    if (mouse_state == MOUSE_FAILED || (int32_t)(timer_get_ticks() - mouse_deadline) >= 0) {
+        mouse_state = MOUSE_FAILED;
+        irq_set_mask(12);
+        return INITCALL_FAILED;
+    }
+    return INITCALL_RUNNING;
+}
 
-    // Set resolution: 4 counts/mm
-    mouse_cmd(0xE8);
-    mouse_cmd(0x02);
+bool mouse_read_motion(mouse_motion_t* m) {
+    if (!mouse_acc_new) return false;
 
-    // Enable data reporting
-    mouse_cmd(0xF4);
+    // Take the totals; the IRQ must not add to them halfway through
+    bool irq = interrupts_enabled();
+    __asm__ volatile ("cli");
+    int32_t dx = mouse_acc_dx, dy = mouse_acc_dy, wheel = mouse_acc_wheel;
+    mouse_buttons = mouse_acc_buttons;
+    mouse_acc_dx = mouse_acc_dy = mouse_acc_wheel = 0;
+    mouse_acc_new = false;
+    if (irq) __asm__ volatile ("sti");
 
-    // Install IRQ handler
-    irq_install_handler(12, mouse_irq_handler);
-    irq_clear_mask(12);
-    irq_clear_mask(2);  // Must also unmask cascade IRQ2
+    // Update position with bounds checking
+    mouse_fx += dx;
+    mouse_fy += dy;
+    if (mouse_fx < 0) mouse_fx = 0;
+    if (mouse_fy < 0) mouse_fy = 0;
+    if (mouse_fx >= SCREEN_W * MOUSE_CELL) mouse_fx = SCREEN_W * MOUSE_CELL - 1;
+    if (mouse_fy >= SCREEN_H * MOUSE_CELL) mouse_fy = SCREEN_H * MOUSE_CELL - 1;
+
+    // Draw mouse cursor on screen, once for all packets taken
+    vga_draw_mouse((uint32_t)(mouse_fx / MOUSE_CELL), (uint32_t)(mouse_fy / MOUSE_CELL));
+    mouse_stats.updates++;
 
-    // Initial cursor draw
-    vga_draw_mouse(mouse_x, mouse_y);
+    if (m) {
+        m->x = mouse_fx / MOUSE_CELL;
+        m->y = mouse_fy / MOUSE_CELL;
+        m->dx = dx;
+        m->dy = dy;
+        m->wheel = wheel;
+        m->buttons = mouse_buttons;
+    }
+    return true;
 }
 
 void mouse_get_state(int32_t* x, int32_t* y, uint8_t* buttons) {
-    if (x) *x = mouse_x;
-    if (y) *y = mouse_y;
+    mouse_read_motion(NULL);
+    if (x) *x = mouse_fx / MOUSE_CELL;
+    if (y) *y = mouse_fy / MOUSE_CELL;
     if (buttons) *buttons = mouse_buttons;
 }
+
+bool mouse_has_wheel(void) {
+    return mouse_packet_size == 4;
+}
+
+void mouse_get_stats(mouse_stats_t* st) {
+    *st = mouse_stats;
+}
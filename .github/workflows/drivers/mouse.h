@@ -2,7 +2,31 @@
 #ifndef MOUSE_H
 #define MOUSE_H
 #include "../kernel/kernel.h"
+#include "../kernel/initcall.h"
 
-void mouse_init(void);
+// Movement since the previous mouse_read_motion(), all packets combined
+typedef struct {
+    int32_t x, y;               // Cursor cell after the move
+    int32_t dx, dy;             // Counts, y grows downwards
+    int32_t wheel;              // Wheel clicks, positive = scrolled down
+    uint8_t buttons;            // Bit 0 left, 1 right, 2 middle
+} mouse_motion_t;
+
+typedef struct {
+    uint32_t irqs;
+    uint32_t bytes;
+    uint32_t packets;
+    uint32_t resyncs;           // Bytes dropped to find a packet start
+    uint32_t updates;           // Coalesced moves published (cursor redraws)
+} mouse_stats_t;
+
+// Enable the aux port and send the reset; the handshake then runs on IRQ 12
+bool mouse_start(void);
+// INITCALL_DONE once the mouse reports, INITCALL_FAILED on timeout
+initcall_state_t mouse_poll(void);
+// Apply the pending movement and redraw the cursor; false if none
+bool mouse_read_motion(mouse_motion_t* m);
 void mouse_get_state(int32_t* x, int32_t* y, uint8_t* buttons);
+bool mouse_has_wheel(void);
+void mouse_get_stats(mouse_stats_t* st);
 #endif
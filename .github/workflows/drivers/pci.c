@@ -0,0 +1,93 @@
+// pci.c - PCI bus enumeration
+// Scans every bus/slot/function once at boot and keeps a small table of
+// the devices found, so drivers can look up their controller by class.
+
+#include "pci.h"
+#include "../kernel/kernel.h"
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static uint32_t pci_num_devices = 0;
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+           ((uint32_t)func << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t val) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, val);
+}
+
+uint16_t pci_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return (pci_read32(bus, slot, func, offset) >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+// Only the addressed half of the dword is written: a read-modify-write of
+// COMMAND would also write STATUS back and clear its write-1-to-clear bits
+void pci_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t val) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), val);
+}
+
+static void pci_add(uint8_t bus, uint8_t slot, uint8_t func) {
+    if (pci_num_devices >= PCI_MAX_DEVICES) return;
+
+    pci_device_t* d = &pci_devices[pci_num_devices++];
+    uint32_t id  = pci_read32(bus, slot, func, PCI_VENDOR_ID);
+    uint32_t cls = pci_read32(bus, slot, func, PCI_CLASS_REV);
+
+    d->bus = bus; d->slot = slot; d->func = func;
+    d->vendor     = id & 0xFFFF;
+    d->device     = id >> 16;
+    d->class_code = cls >> 24;
+    d->subclass   = (cls >> 16) & 0xFF;
+    d->prog_if    = (cls >> 8) & 0xFF;
+    d->irq_line   = pci_read32(bus, slot, func, PCI_INTERRUPT_LINE) & 0xFF;
+    for (int i = 0; i < 6; i++)
+        d->bar[i] = pci_read32(bus, slot, func, PCI_BAR0 + i * 4);
+}
+
+void pci_init(void) {
+    pci_num_devices = 0;
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            if (pci_read16(bus, slot, 0, PCI_VENDOR_ID) == 0xFFFF) continue;
+
+            // Only multi-function devices have functions 1-7
+            uint8_t nfunc = (pci_read32(bus, slot, 0, 0x0C) >> 16) & 0x80 ? 8 : 1;
+            for (uint8_t func = 0; func < nfunc; func++) {
+                if (pci_read16(bus, slot, func, PCI_VENDOR_ID) == 0xFFFF) continue;
+                pci_add(bus, slot, func);
+            }
+        }
+    }
+}
+
+uint32_t pci_count(void) {
+    return pci_num_devices;
+}
+
+pci_device_t* pci_get(uint32_t index) {
+    return index < pci_num_devices ? &pci_devices[index] : NULL;
+}
+
+pci_device_t* pci_find_class(uint8_t class_code, uint8_t subclass, uint32_t from) {
+    for (uint32_t i = from; i < pci_num_devices; i++)
+        if (pci_devices[i].class_code == class_code && pci_devices[i].subclass == subclass)
+            return &pci_devices[i];
+    return NULL;
+}
+
+void pci_enable_master(pci_device_t* dev) {
+    uint16_t cmd = pci_read16(dev->bus, dev->slot, dev->func, PCI_COMMAND);
+    cmd |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+    pci_write16(dev->bus, dev->slot, dev->func, PCI_COMMAND, cmd);
+}
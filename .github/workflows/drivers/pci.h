@@ -0,0 +1,44 @@
+// pci.h - PCI bus enumeration (configuration mechanism #1)
+#ifndef PCI_H
+#define PCI_H
+#include "../kernel/kernel.h"
+
+#define PCI_MAX_DEVICES     32
+
+// Configuration space offsets
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_CLASS_REV       0x08
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_INTERRUPT_LINE  0x3C
+
+#define PCI_COMMAND_IO      0x0001
+#define PCI_COMMAND_MEMORY  0x0002
+#define PCI_COMMAND_MASTER  0x0004
+
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_SUBCLASS_IDE    0x01
+
+typedef struct {
+    uint8_t  bus, slot, func;
+    uint16_t vendor, device;
+    uint8_t  class_code, subclass, prog_if;
+    uint8_t  irq_line;
+    uint32_t bar[6];
+} pci_device_t;
+
+uint32_t      pci_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void          pci_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t val);
+uint16_t      pci_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void          pci_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t val);
+
+void          pci_init(void);
+uint32_t      pci_count(void);
+pci_device_t* pci_get(uint32_t index);
+// First device with the given class/subclass at or after table index `from`
+pci_device_t* pci_find_class(uint8_t class_code, uint8_t subclass, uint32_t from);
+// Enable I/O + memory decoding and bus mastering
+void          pci_enable_master(pci_device_t* dev);
+#endif
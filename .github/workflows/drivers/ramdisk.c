@@ -0,0 +1,127 @@
+// ramdisk.c - RAM disks from GRUB boot modules
+//
+// A module line in grub.cfg makes GRUB load a file next to the kernel and
+// pass its address in the Multiboot info. A FAT image becomes a block
+// device whose sectors are the module's own memory: there is no probe, no
+// controller and no DMA, a read is a memcpy, and ops->map lets the buffer
+// cache copy straight out of it instead of keeping a second copy. A tar
+// archive is handed to the ramfs instead (see fs/ramfs.c).
+//
+// Modules live wherever GRUB put them. One that overlaps the program load
+// area would be overwritten by the first exec, so it is moved to the heap.
+
+#include "ramdisk.h"
+#include "../kernel/kernel.h"
+#include "../kernel/vga.h"
+#include "../kernel/kmem.h"
+#include "../kernel/exec.h"
+#include "../fs/ramfs.h"
+
+#define MULTIBOOT_FLAG_MODS 0x008
+
+typedef struct {
+    uint8_t*  base;
+    uint32_t  sectors;
+} ramdisk_t;
+
+static ramdisk_t rd_disks[RAMDISK_MAX_DEVICES];
+static uint32_t  rd_count = 0;
+
+static uint8_t* rd_map(blkdev_t* dev, uint32_t lba) {
+    ramdisk_t* rd = dev->priv;
+    return lba < rd->sectors ? rd->base + lba * BLK_SECTOR_SIZE : NULL;
+}
+
+static bool rd_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buf) {
+    ramdisk_t* rd = dev->priv;
+    if (lba >= rd->sectors || count > rd->sectors - lba) return false;
+    memcpy(buf, rd->base + lba * BLK_SECTOR_SIZE, count * BLK_SECTOR_SIZE);
+    return true;
+}
+
+static bool rd_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buf) {
+    ramdisk_t* rd = dev->priv;
+    if (lba >= rd->sectors || count > rd->sectors - lba) return false;
+    memcpy(rd->base + lba * BLK_SECTOR_SIZE, buf, count * BLK_SECTOR_SIZE);
+    return true;
+}
+
+static const blkdev_ops_t rd_ops = {
+    .read  = rd_read,
+    .write = rd_write,
+    .map   = rd_map,
+};
+
+blkdev_t* ramdisk_create(uint8_t* base, uint32_t size) {
+    if (rd_count == RAMDISK_MAX_DEVICES || size < BLK_SECTOR_SIZE) return NULL;
+
+    ramdisk_t* rd = &rd_disks[rd_count];
+    rd->base = base;
+    rd->sectors = size / BLK_SECTOR_SIZE;
+    char name[4] = { 'r', 'd', (char)('0' + rd_count), '\0' };
+    blkdev_t* dev = blkdev_register(name, rd->sectors, 65536, &rd_ops, rd);
+    if (dev) rd_count++;
+    return dev;
+}
+
+static multiboot_module_t* rd_modules(multiboot_info_t* mbi, uint32_t* count) {
+    if (!(mbi->flags & MULTIBOOT_FLAG_MODS) || !mbi->mods_count) {
+        *count = 0;
+        return NULL;
+    }
+    *count = mbi->mods_count;
+    return (multiboot_module_t*)(uintptr_t)mbi->mods_addr;
+}
+
+uint32_t ramdisk_modules_end(multiboot_info_t* mbi) {
+    uint32_t count, end = 0;
+    multiboot_module_t* mods = rd_modules(mbi, &count);
+    for (uint32_t i = 0; i < count; i++)
+        if (mods[i].mod_end > end) end = mods[i].mod_end;
+    return end;
+}
+
+// Boot sector of a FAT volume with 512-byte sectors
+static bool rd_is_fat(const uint8_t* p, uint32_t size) {
+    return size >= BLK_SECTOR_SIZE && p[510] == 0x55 && p[511] == 0xAA &&
+           (p[0] == 0xEB || p[0] == 0xE9) && p[11] == 0x00 && p[12] == 0x02;
+}
+
+blkdev_t* ramdisk_init(multiboot_info_t* mbi) {
+    uint32_t count;
+    multiboot_module_t* mods = rd_modules(mbi, &count);
+    blkdev_t* first = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t* base = (uint8_t*)(uintptr_t)mods[i].mod_start;
+        uint32_t size = mods[i].mod_end - mods[i].mod_start;
+
+        if (mods[i].mod_start < PROG_AREA_END &&
+            mods[i].mod_end > PROG_LOAD_ADDR) {
+            uint8_t* copy = kmalloc(size);
+            if (!copy) {
+                vga_print("[RAMDISK] Module overlaps the program area, no memory to move it\n");
+                continue;
+            }
+            memcpy(copy, base, size);
+            base = copy;
+        }
+
+        if (rd_is_fat(base, size)) {
+            blkdev_t* dev = ramdisk_create(base, size);
+            if (!dev) continue;
+            if (!first) first = dev;
+            vga_print("[RAMDISK] ");
+            vga_print(dev->name);
+            vga_print(": FAT image, ");
+        } else if (!ramfs_is_mounted() && ramfs_mount(base, size)) {
+            vga_print("[RAMDISK] ramfs: tar archive, ");
+        } else {
+            vga_print("[RAMDISK] Unknown module format, ignored\n");
+            continue;
+        }
+        vga_print_dec(size / 1024);
+        vga_print(" KB\n");
+    }
+    return first;
+}
@@ -0,0 +1,16 @@
+// ramdisk.h - RAM disks from GRUB boot modules
+#ifndef RAMDISK_H
+#define RAMDISK_H
+#include "../kernel/kernel.h"
+#include "blkdev.h"
+
+#define RAMDISK_MAX_DEVICES 2
+
+// End of the highest boot module (0 = none); the heap must start above it
+uint32_t  ramdisk_modules_end(multiboot_info_t* mbi);
+// Register FAT image modules as "rd0", "rd1" and mount the first tar
+// archive as the read-only ramfs. Returns the first RAM disk, NULL if none.
+blkdev_t* ramdisk_init(multiboot_info_t* mbi);
+// Register `size` bytes at `base` as a RAM disk (writable, lost on reboot)
+blkdev_t* ramdisk_create(uint8_t* base, uint32_t size);
+#endif
@@ -0,0 +1,61 @@
+// serial.c - 16550 UART on COM1 (debug output)
+//
+// Polled, transmit only: enough to get boot reports and logs out of QEMU
+// (-serial stdio) or onto a null-modem cable. Every call is a no-op when
+// the loopback self-test at init finds no UART.
+
+#include "serial.h"
+#include "../kernel/kernel.h"
+
+#define COM1            0x3F8
+#define UART_DATA       0       // DLAB=0: THR/RBR; DLAB=1: divisor low
+#define UART_IER        1       // DLAB=1: divisor high
+#define UART_FCR        2
+#define UART_LCR        3
+#define UART_MCR        4
+#define UART_LSR        5
+
+#define LSR_THR_EMPTY   0x20
+#define SERIAL_DIVISOR  3       // 115200 / 3 = 38400 baud
+
+static bool serial_ok = false;
+
+bool serial_init(void) {
+    outb(COM1 + UART_IER, 0x00);                    // No interrupts
+    outb(COM1 + UART_LCR, 0x80);                    // DLAB on
+    outb(COM1 + UART_DATA, SERIAL_DIVISOR & 0xFF);
+    outb(COM1 + UART_IER, SERIAL_DIVISOR >> 8);
+    outb(COM1 + UART_LCR, 0x03);                    // 8N1, DLAB off
+    outb(COM1 + UART_FCR, 0xC7);                    // FIFO on, cleared
+    outb(COM1 + UART_MCR, 0x1E);                    // Loopback self-test
+
+    outb(COM1 + UART_DATA, 0xAE);
+    if (inb(COM1 + UART_DATA) != 0xAE) return false;
+
+    outb(COM1 + UART_MCR, 0x0F);                    // Normal operation
+    serial_ok = true;
+    return true;
+}
+
+void serial_putchar(char c) {
+    if (!serial_ok) return;
+    if (c == '\n') serial_putchar('\r');
+    // Bounded wait: a wedged UART must not hang the kernel
+    for (uint32_t i = 0; i < 100000 && !(inb(COM1 + UART_LSR) & LSR_THR_EMPTY); i++);
+    outb(COM1 + UART_DATA, (uint8_t)c);
+}
+
+void serial_print(const char* str) {
+    while (*str) serial_putchar(*str++);
+}
+
+void serial_print_dec(uint32_t val) {
+    char buf[11];
+    int i = 10;
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    serial_print(&buf[i]);
+}
@@ -0,0 +1,10 @@
+// serial.h - 16550 UART on COM1 (debug output)
+#ifndef SERIAL_H
+#define SERIAL_H
+#include "../kernel/kernel.h"
+
+bool serial_init(void);         // False when no UART answers
+void serial_putchar(char c);
+void serial_print(const char* str);
+void serial_print_dec(uint32_t val);
+#endif
@@ -3,20 +3,26 @@
 #include "timer.h"
 #include "../kernel/kernel.h"
 #include "../kernel/idt.h"
+#include "../kernel/kdata.h"
 
 #define PIT_CHANNEL0    0x40
 #define PIT_CHANNEL2    0x42
 #define PIT_CMD         0x43
 #define PIT_BASE_FREQ   1193180
+#define PIT_GATE_PORT   0x61    // Bit 0: channel 2 gate, bit 5: channel 2 output
 
 static volatile uint32_t tick_count = 0;
+static uint32_t timer_hz = 0;
 
 static void timer_irq_handler(registers_t* regs) {
     tick_count++;
+    kdata_tick(tick_count);
 }
 
 void timer_init(uint32_t hz) {
     uint32_t divisor = PIT_BASE_FREQ / hz;
+    timer_hz = hz;
+    kdata_set_rate(hz);
 
     // Channel 0, lobyte/hibyte, square wave mode
     outb(PIT_CMD, 0x36);
@@ -31,7 +37,49 @@ uint32_t timer_get_ticks(void) {
     return tick_count;
 }
 
+uint32_t timer_get_hz(void) {
+    return timer_hz;
+}
+
+// The rate is a boot parameter (hz=), so nothing outside this file may
+// assume 100 ticks per second
+uint32_t timer_get_ms(void) {
+    return timer_hz ? (uint32_t)udiv64((uint64_t)tick_count * 1000, timer_hz) : 0;
+}
+
+uint32_t timer_ms_to_ticks(uint32_t ms) {
+    return (uint32_t)udiv64((uint64_t)ms * timer_hz + 999, 1000);
+}
+
 void timer_sleep(uint32_t ms) {
-    uint32_t end = tick_count + ms / 10; // 100Hz = 10ms per tick
-    while (tick_count < end) __asm__("hlt");
+    uint32_t end = tick_count + timer_ms_to_ticks(ms);
+    while ((int32_t)(tick_count - end) < 0) __asm__("hlt");
+}
+
+// TSC rate (0 = unknown), measured once against a 10 ms one-shot on PIT channel 2 (the
+// speaker channel, so it needs no IRQ and leaves the system tick alone)
+uint32_t timer_tsc_khz(void) {
+    static uint32_t khz = 0;
+    if (khz) return khz;
+
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (gate & ~0x02) | 0x01);     // Gate on, speaker off
+
+    uint32_t count = PIT_BASE_FREQ / 100;
+    outb(PIT_CMD, 0xB0);                            // Channel 2, lo/hi, mode 0
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+
+    uint64_t start = rdtsc(), now = start;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        now = rdtsc();
+        if (now - start > 0x80000000u) {            // No PIT channel 2
+            outb(PIT_GATE_PORT, gate);
+            return 0;
+        }
+    }
+    outb(PIT_GATE_PORT, gate);
+
+    khz = (uint32_t)(now - start) / 10;
+    return khz;
 }
@@ -5,5 +5,9 @@
 
 void     timer_init(uint32_t hz);
 uint32_t timer_get_ticks(void);
+uint32_t timer_get_hz(void);
+uint32_t timer_get_ms(void);                // Since timer_init()
+uint32_t timer_ms_to_ticks(uint32_t ms);    // Rounded up
 void     timer_sleep(uint32_t ms);
+uint32_t timer_tsc_khz(void);   // TSC cycles per millisecond
 #endif
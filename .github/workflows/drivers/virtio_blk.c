@@ -0,0 +1,399 @@
+// virtio_blk.c - Legacy virtio-blk PCI driver (split virtqueue)
+//
+// Paravirtualized disk for QEMU (-drive if=virtio). The device is driven
+// through the legacy I/O BAR: one split virtqueue holds descriptor chains
+// of header -> data segments -> status byte, so a whole request costs a
+// single notification instead of a trapped port access per register.
+//
+// The driver plugs into the block layer's queued interface. start() only
+// writes the chain and its available-ring slot; the new ring index is
+// published (and the device notified) once per batch, when the block layer
+// first polls. With VIRTIO_RING_F_EVENT_IDX both directions are suppressed:
+// the device's avail_event says whether a notify is needed at all, and
+// used_event asks for one interrupt when the last outstanding request
+// completes rather than one per request.
+
+#include "virtio_blk.h"
+#include "../kernel/kernel.h"
+#include "../kernel/idt.h"
+#include "../kernel/vga.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "timer.h"
+
+#define VIRTIO_VENDOR           0x1AF4
+#define VIRTIO_DEV_BLK_LEGACY   0x1001
+
+// Legacy PCI register layout (I/O BAR0, no MSI-X)
+#define VIRTIO_DEV_FEATURES     0x00
+#define VIRTIO_GUEST_FEATURES   0x04
+#define VIRTIO_QUEUE_PFN        0x08
+#define VIRTIO_QUEUE_SIZE       0x0C
+#define VIRTIO_QUEUE_SEL        0x0E
+#define VIRTIO_QUEUE_NOTIFY     0x10
+#define VIRTIO_STATUS           0x12
+#define VIRTIO_ISR              0x13
+#define VIRTIO_BLK_CAPACITY     0x14    // u64
+#define VIRTIO_BLK_SIZE_MAX     0x1C
+#define VIRTIO_BLK_SEG_MAX      0x20
+
+#define VIRTIO_STATUS_ACK       0x01
+#define VIRTIO_STATUS_DRIVER    0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED    0x80
+
+#define VIRTIO_BLK_F_SIZE_MAX   (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX    (1u << 2)
+#define VIRTIO_BLK_F_RO         (1u << 5)
+#define VIRTIO_RING_F_EVENT_IDX (1u << 29)
+
+#define VRING_DESC_F_NEXT       1
+#define VRING_DESC_F_WRITE      2
+#define VRING_USED_F_NO_NOTIFY  1
+
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_T_OUT        1
+#define VIRTIO_BLK_S_OK         0
+
+#define VQ_MAX_SIZE             256     // Largest ring we have memory for
+#define VQ_ALIGN                4096
+#define VQ_BYTES                (8192 + 4096)   // Layout for 256 entries
+#define VBLK_MAX_SEGS           8       // Data descriptors per request
+#define VBLK_MAX_COUNT          65536   // Sectors per request
+#define VBLK_SPIN_TIMEOUT       10000000
+#define VBLK_IRQ_TIMEOUT_MS     3000    // Milliseconds
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];        // Followed by used_event
+} __attribute__((packed)) vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) vring_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    vring_used_elem_t ring[];   // Followed by avail_event
+} __attribute__((packed)) vring_used_t;
+
+// Request header, read by the device
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_hdr_t;
+
+typedef struct {
+    uint16_t                io;
+    uint16_t                qsize;
+    bool                    event_idx;
+    bool                    dead;
+    bool                    read_only;
+    uint32_t                seg_bytes;      // Largest data descriptor
+    volatile vring_desc_t*  desc;
+    volatile vring_avail_t* avail;
+    volatile vring_used_t*  used;
+    volatile uint16_t*      used_event;     // Written by us
+    volatile uint16_t*      avail_event;    // Written by the device
+    uint16_t                free_head;
+    uint16_t                num_free;
+    uint16_t                avail_idx;      // Next free available-ring slot
+    uint16_t                published;      // avail->idx the device has seen
+    uint16_t                last_used;
+    blk_transfer_t*         xfer[VQ_MAX_SIZE];      // By head descriptor
+    virtio_blk_hdr_t        hdr[VQ_MAX_SIZE];
+    volatile uint8_t        status[VQ_MAX_SIZE];
+    blkdev_t*               dev;
+} vblk_t;
+
+static uint8_t  vblk_rings[VIRTIO_BLK_MAX_DEVICES][VQ_BYTES] __attribute__((aligned(VQ_ALIGN)));
+static vblk_t   vblk_devs[VIRTIO_BLK_MAX_DEVICES];
+static uint32_t vblk_count = 0;
+
+static bool          vblk_have_irq = false;
+static volatile bool vblk_irq_pending = false;
+
+// x86 only reorders a store with a later load; this orders both
+static inline void vblk_mb(void) {
+    __asm__ volatile ("lock; addl $0, (%%esp)" ::: "memory");
+}
+
+static inline void vblk_barrier(void) {
+    __asm__ volatile ("" ::: "memory");
+}
+
+// Reading the ISR register acknowledges the interrupt
+static void vblk_irq_handler(registers_t* regs) {
+    (void)regs;
+    for (uint32_t i = 0; i < vblk_count; i++)
+        inb(vblk_devs[i].io + VIRTIO_ISR);
+    vblk_irq_pending = true;
+}
+
+// Make the queued chains visible and notify the device if it wants that
+static void vblk_kick(vblk_t* vb) {
+    uint16_t old = vb->published;
+    uint16_t new = vb->avail_idx;
+    if (old == new) return;
+
+    vblk_barrier();                 // Ring entries before the index
+    vb->avail->idx = new;
+    vb->published = new;
+    vblk_mb();                      // Index before reading the event
+
+    bool notify;
+    if (vb->event_idx) {
+        uint16_t event = *vb->avail_event;
+        notify = (uint16_t)(new - event - 1) < (uint16_t)(new - old);
+    } else {
+        notify = !(vb->used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    if (notify) outw(vb->io + VIRTIO_QUEUE_NOTIFY, 0);
+}
+
+static bool vblk_blk_start(blkdev_t* dev, blk_transfer_t* x) {
+    vblk_t* vb = dev->priv;
+    if (vb->dead || (x->write && vb->read_only)) {
+        blk_transfer_done(x, false);
+        return true;
+    }
+
+    uint32_t bytes = x->count * BLK_SECTOR_SIZE;
+    uint32_t nseg = (bytes + vb->seg_bytes - 1) / vb->seg_bytes;
+    if (nseg + 2u > vb->num_free) return false;
+
+    uint16_t head = vb->free_head;
+    uint16_t d = head;
+
+    vb->hdr[head].type     = x->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    vb->hdr[head].reserved = 0;
+    vb->hdr[head].sector   = x->lba;
+    vb->status[head]       = 0xFF;
+
+    vb->desc[d].addr  = (uint32_t)(uintptr_t)&vb->hdr[head];
+    vb->desc[d].len   = sizeof(virtio_blk_hdr_t);
+    vb->desc[d].flags = VRING_DESC_F_NEXT;
+    d = vb->desc[d].next;
+
+    // Data descriptors are device-writable for reads only
+    uint16_t data_flags = x->write ? VRING_DESC_F_NEXT : VRING_DESC_F_WRITE | VRING_DESC_F_NEXT;
+    uint8_t* buf = x->buf;
+    while (bytes) {
+        uint32_t chunk = bytes < vb->seg_bytes ? bytes : vb->seg_bytes;
+        vb->desc[d].addr  = (uint32_t)(uintptr_t)buf;
+        vb->desc[d].len   = chunk;
+        vb->desc[d].flags = data_flags;
+        d = vb->desc[d].next;
+        buf   += chunk;
+        bytes -= chunk;
+    }
+
+    vb->desc[d].addr  = (uint32_t)(uintptr_t)&vb->status[head];
+    vb->desc[d].len   = 1;
+    vb->desc[d].flags = VRING_DESC_F_WRITE;
+    vb->free_head = vb->desc[d].next;
+    vb->num_free -= nseg + 2;
+
+    vb->xfer[head] = x;
+    vb->avail->ring[vb->avail_idx % vb->qsize] = head;
+    vb->avail_idx++;
+    return true;
+}
+
+// Return a finished chain to the free list
+static void vblk_free_chain(vblk_t* vb, uint16_t head) {
+    uint16_t d = head;
+    uint16_t n = 1;
+    while (vb->desc[d].flags & VRING_DESC_F_NEXT) {
+        d = vb->desc[d].next;
+        n++;
+    }
+    vb->desc[d].next = vb->free_head;
+    vb->free_head = head;
+    vb->num_free += n;
+}
+
+static bool vblk_reap(vblk_t* vb) {
+    bool any = false;
+    while (vb->last_used != vb->used->idx) {
+        vblk_barrier();             // Index before the element
+        volatile vring_used_elem_t* e = &vb->used->ring[vb->last_used % vb->qsize];
+        uint16_t head = (uint16_t)e->id;
+        vb->last_used++;
+
+        blk_transfer_t* x = vb->xfer[head];
+        bool ok = vb->status[head] == VIRTIO_BLK_S_OK;
+        vb->xfer[head] = NULL;
+        vblk_free_chain(vb, head);
+        blk_transfer_done(x, ok);
+        any = true;
+    }
+    return any;
+}
+
+// The device stopped answering: reset it and fail everything outstanding
+static void vblk_fail(vblk_t* vb) {
+    outb(vb->io + VIRTIO_STATUS, 0);
+    vb->dead = true;
+    for (uint32_t i = 0; i < vb->qsize; i++) {
+        blk_transfer_t* x = vb->xfer[i];
+        if (!x) continue;
+        vb->xfer[i] = NULL;
+        blk_transfer_done(x, false);
+    }
+    vga_print("[VIRTIO] ");
+    vga_print(vb->dev->name);
+    vga_print(": request timed out, device disabled\n");
+}
+
+static void vblk_blk_poll(blkdev_t* dev) {
+    vblk_t* vb = dev->priv;
+    if (vb->dead) return;
+    vblk_kick(vb);
+
+    bool use_irq = vblk_have_irq && interrupts_enabled();
+    uint32_t start = timer_get_ticks();
+    uint32_t spins = 0;
+
+    for (;;) {
+        if (vblk_reap(vb)) return;
+
+        // One interrupt when the last outstanding request is done
+        if (vb->event_idx) {
+            *vb->used_event = (uint16_t)(vb->published - 1);
+            vblk_mb();
+            if (vb->last_used != vb->used->idx) continue;
+        }
+
+        if (use_irq) {
+            if (timer_get_ticks() - start > timer_ms_to_ticks(VBLK_IRQ_TIMEOUT_MS)) break;
+            __asm__ volatile ("cli");
+            if (!vblk_irq_pending) __asm__ volatile ("sti; hlt");  // No lost wakeup
+            vblk_irq_pending = false;
+            __asm__ volatile ("sti");
+        } else if (++spins > VBLK_SPIN_TIMEOUT) {
+            break;
+        }
+    }
+    vblk_fail(vb);
+}
+
+static const blkdev_ops_t vblk_ops = {
+    .start = vblk_blk_start,
+    .poll  = vblk_blk_poll,
+};
+
+// Reset, negotiate features and set up virtqueue 0
+static bool vblk_setup(vblk_t* vb, uint8_t* ring) {
+    uint16_t io = vb->io;
+    outb(io + VIRTIO_STATUS, 0);
+    outb(io + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+    outb(io + VIRTIO_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+    uint32_t features = inl(io + VIRTIO_DEV_FEATURES) &
+                        (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO |
+                         VIRTIO_RING_F_EVENT_IDX);
+    outl(io + VIRTIO_GUEST_FEATURES, features);
+    vb->event_idx = (features & VIRTIO_RING_F_EVENT_IDX) != 0;
+    vb->read_only = (features & VIRTIO_BLK_F_RO) != 0;
+
+    outw(io + VIRTIO_QUEUE_SEL, 0);
+    uint16_t n = inw(io + VIRTIO_QUEUE_SIZE);
+    if (n < VBLK_MAX_SEGS + 2 || n > VQ_MAX_SIZE) return false;
+    vb->qsize = n;
+
+    // Legacy layout: descriptors, available ring, then the used ring on
+    // the next page boundary
+    memset(ring, 0, VQ_BYTES);
+    uint32_t avail_off = n * sizeof(vring_desc_t);
+    uint32_t used_off  = (avail_off + 6 + 2 * n + VQ_ALIGN - 1) & ~(VQ_ALIGN - 1);
+    vb->desc        = (vring_desc_t*)ring;
+    vb->avail       = (vring_avail_t*)(ring + avail_off);
+    vb->used        = (vring_used_t*)(ring + used_off);
+    vb->used_event  = (volatile uint16_t*)(ring + avail_off + 4 + 2 * n);
+    vb->avail_event = (volatile uint16_t*)(ring + used_off + 4 + 8 * n);
+
+    for (uint16_t i = 0; i < n; i++) vb->desc[i].next = (uint16_t)(i + 1);
+    vb->free_head = 0;
+    vb->num_free  = n;
+
+    // Data descriptor size: SIZE_MAX if the device has one, else one
+    // descriptor can take a whole request
+    uint32_t segs = VBLK_MAX_SEGS;
+    vb->seg_bytes = VBLK_MAX_COUNT * BLK_SECTOR_SIZE;
+    if (features & VIRTIO_BLK_F_SIZE_MAX) {
+        vb->seg_bytes = inl(io + VIRTIO_BLK_SIZE_MAX) & ~(BLK_SECTOR_SIZE - 1);
+        if (!vb->seg_bytes) return false;
+    }
+    if (features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t max = inl(io + VIRTIO_BLK_SEG_MAX);
+        if (max && max < segs) segs = max;
+    }
+    uint32_t max_transfer = segs * (vb->seg_bytes / BLK_SECTOR_SIZE);
+    if (!max_transfer || max_transfer > VBLK_MAX_COUNT) max_transfer = VBLK_MAX_COUNT;
+
+    outl(io + VIRTIO_QUEUE_PFN, (uint32_t)(uintptr_t)ring / VQ_ALIGN);
+    outb(io + VIRTIO_STATUS,
+         VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    uint32_t cap_lo = inl(io + VIRTIO_BLK_CAPACITY);
+    uint32_t cap_hi = inl(io + VIRTIO_BLK_CAPACITY + 4);
+    uint32_t sectors = cap_hi ? 0xFFFFFFFF : cap_lo;    // Clamped to 32 bits
+    if (!sectors) return false;
+
+    char name[4] = { 'v', 'd', (char)('a' + vblk_count), '\0' };
+    vb->dev = blkdev_register(name, sectors, max_transfer, &vblk_ops, vb);
+    if (!vb->dev) return false;
+
+    vga_print("[VIRTIO] ");
+    vga_print(name);
+    vga_print(": ");
+    vga_print_dec(sectors / 2048);
+    vga_print(" MB, queue ");
+    vga_print_dec(n);
+    vga_print(vb->event_idx ? ", event idx\n" : "\n");
+    return true;
+}
+
+bool virtio_blk_init(void) {
+    for (uint32_t i = 0; i < pci_count() && vblk_count < VIRTIO_BLK_MAX_DEVICES; i++) {
+        pci_device_t* pd = pci_get(i);
+        if (pd->vendor != VIRTIO_VENDOR || pd->device != VIRTIO_DEV_BLK_LEGACY) continue;
+        if (!(pd->bar[0] & 1)) continue;        // Legacy interface is I/O space
+
+        vblk_t* vb = &vblk_devs[vblk_count];
+        memset(vb, 0, sizeof(*vb));
+        vb->io = pd->bar[0] & 0xFFFC;
+        pci_enable_master(pd);
+
+        if (!vblk_setup(vb, vblk_rings[vblk_count])) {
+            outb(vb->io + VIRTIO_STATUS, VIRTIO_STATUS_FAILED);
+            continue;
+        }
+        vblk_count++;
+
+        if (pd->irq_line < 16) {
+            irq_install_handler(pd->irq_line, vblk_irq_handler);
+            irq_clear_mask(pd->irq_line);
+            if (pd->irq_line >= 8) irq_clear_mask(2);   // Cascade
+            vblk_have_irq = true;
+        }
+    }
+
+    if (!vblk_count) {
+        vga_print("[VIRTIO] No virtio block devices\n");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,10 @@
+// virtio_blk.h - Legacy virtio-blk PCI driver (split virtqueue)
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+#include "../kernel/kernel.h"
+
+#define VIRTIO_BLK_MAX_DEVICES  2
+
+// Probe virtio block devices and register them as "vda", "vdb"
+bool virtio_blk_init(void);
+#endif
@@ -0,0 +1,429 @@
+// bcache.c - Sector buffer cache
+//
+// Buffers are indexed by a hash of (device, LBA) and kept on an LRU list.
+// Lookups move a buffer to the head of the list; misses recycle the
+// least recently used buffer that nobody holds a reference to. When the
+// cache is not initialised (or too small) reads fall through to the disk.
+//
+// bcache_read() serves cached sectors from RAM and queues each run of
+// missing sectors as one request straight into the caller's buffer; all
+// runs go to the block layer together so a queued device (AHCI NCQ) can
+// work on them at once. Afterwards the runs are copied into the cache.
+// Runs larger than half the cache are streamed past it so one big file
+// cannot flush everything else.
+//
+// bcache_readahead() fills the cache with sectors a caller expects to need
+// soon (the FAT driver's sequential read-ahead), through a staging buffer.
+// Memory-backed devices (ops->map) skip both: misses are copied straight
+// from the device's memory.
+//
+// Writes are write-back: bcache_write() and bcache_mark_dirty() only mark
+// buffers dirty, and dirty buffers are never recycled. bcache_sync() sorts
+// them by LBA and writes each contiguous run with one request. It runs on
+// demand, from bcache_writeback() once data has been dirty for a while,
+// and whenever a quarter of the cache is dirty.
+
+#include "bcache.h"
+#include "../kernel/kernel.h"
+#include "../kernel/kmem.h"
+
+#define BCACHE_MAX_BUFS   16384                 // 8 MB of sectors
+#define BCACHE_BATCH      BLK_MAX_INFLIGHT      // Miss runs per blk_run
+#define BCACHE_STAGE_SECTORS 256                // Read-ahead/write-back staging (128 KB)
+
+static buf_t*   bc_bufs = NULL;
+static uint32_t bc_nbufs = 0;
+static buf_t**  bc_hash = NULL;
+static uint32_t bc_hash_mask = 0;
+static buf_t*   bc_lru_head = NULL;
+static buf_t*   bc_lru_tail = NULL;
+static bcache_stats_t bc_stats;
+static blk_request_t  bc_batch[BCACHE_BATCH];
+static uint8_t        bc_stage[BCACHE_STAGE_SECTORS * BLK_SECTOR_SIZE];
+static buf_t**        bc_sorted = NULL;     // bcache_sync() work array
+static uint32_t       bc_ndirty = 0;
+static uint32_t       bc_dirty_since = 0;   // bcache_writeback() time, 0 = not seen
+
+static inline uint32_t bc_bucket(blkdev_t* dev, uint32_t lba) {
+    uint32_t h = lba * 2654435761u ^ (uint32_t)(uintptr_t)dev;
+    return (h ^ (h >> 16)) & bc_hash_mask;
+}
+
+static void lru_unlink(buf_t* b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+    else             bc_lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else             bc_lru_tail = b->lru_prev;
+    b->lru_prev = b->lru_next = NULL;
+}
+
+static void lru_push_head(buf_t* b) {
+    b->lru_prev = NULL;
+    b->lru_next = bc_lru_head;
+    if (bc_lru_head) bc_lru_head->lru_prev = b;
+    else             bc_lru_tail = b;
+    bc_lru_head = b;
+}
+
+static void hash_remove(buf_t* b) {
+    buf_t** pp = &bc_hash[bc_bucket(b->dev, b->lba)];
+    while (*pp && *pp != b) pp = &(*pp)->hash_next;
+    if (*pp) *pp = b->hash_next;
+    b->hash_next = NULL;
+}
+
+uint32_t bcache_default_size(void) {
+    // An eighth of the free heap
+    uint32_t n = kmem_free_bytes() / 8 / (BLK_SECTOR_SIZE + sizeof(buf_t));
+    if (n > BCACHE_MAX_BUFS) n = BCACHE_MAX_BUFS;
+    return n;
+}
+
+bool bcache_init(uint32_t nbufs) {
+    if (nbufs < BCACHE_MIN_BUFS) return false;
+
+    uint32_t buckets = 1;
+    while (buckets < nbufs) buckets <<= 1;
+
+    bc_bufs = kmalloc(nbufs * sizeof(buf_t));
+    bc_hash = kmalloc(buckets * sizeof(buf_t*));
+    bc_sorted = kmalloc(nbufs * sizeof(buf_t*));
+    uint8_t* data = kmalloc(nbufs * BLK_SECTOR_SIZE);
+    if (!bc_bufs || !bc_hash || !bc_sorted || !data) {
+        kfree(bc_bufs); kfree(bc_hash); kfree(bc_sorted); kfree(data);
+        bc_bufs = NULL; bc_hash = NULL; bc_sorted = NULL;
+        return false;
+    }
+
+    memset(bc_bufs, 0, nbufs * sizeof(buf_t));
+    memset(bc_hash, 0, buckets * sizeof(buf_t*));
+    bc_hash_mask = buckets - 1;
+    bc_nbufs = nbufs;
+    bc_lru_head = bc_lru_tail = NULL;
+    for (uint32_t i = 0; i < nbufs; i++) {
+        bc_bufs[i].data = data + i * BLK_SECTOR_SIZE;
+        lru_push_head(&bc_bufs[i]);
+    }
+
+    memset(&bc_stats, 0, sizeof(bc_stats));
+    bc_stats.buffers = nbufs;
+    return true;
+}
+
+static buf_t* bc_lookup(blkdev_t* dev, uint32_t lba) {
+    for (buf_t* b = bc_hash[bc_bucket(dev, lba)]; b; b = b->hash_next)
+        if (b->lba == lba && b->dev == dev && b->valid) return b;
+    return NULL;
+}
+
+// Take the least recently used free, clean buffer and rebind it to
+// (dev, lba)
+static buf_t* bc_recycle(blkdev_t* dev, uint32_t lba) {
+    buf_t* b = bc_lru_tail;
+    while (b && (b->refcount || b->dirty)) b = b->lru_prev;
+    if (!b) return NULL;
+
+    if (b->dev) {
+        hash_remove(b);
+        if (b->valid) bc_stats.evictions++;
+    }
+    b->dev   = dev;
+    b->lba   = lba;
+    b->valid = false;
+    uint32_t h = bc_bucket(dev, lba);
+    b->hash_next = bc_hash[h];
+    bc_hash[h] = b;
+    return b;
+}
+
+// Reference the cached copy of a sector, or claim a buffer to fill.
+static buf_t* bc_acquire(blkdev_t* dev, uint32_t lba) {
+    buf_t* b = bc_lookup(dev, lba);
+    if (b) bc_stats.hits++;
+    else if ((b = bc_recycle(dev, lba))) bc_stats.misses++;
+    else return NULL;
+
+    b->refcount++;
+    lru_unlink(b);
+    lru_push_head(b);
+    return b;
+}
+
+// A buffer that could not be filled must not be found by later lookups
+static void bc_drop(buf_t* b) {
+    hash_remove(b);
+    b->dev = NULL;
+    b->valid = false;
+}
+
+buf_t* bcache_get(blkdev_t* dev, uint32_t lba) {
+    if (!bc_nbufs) return NULL;
+    buf_t* b = bc_acquire(dev, lba);
+    if (!b) return NULL;
+    if (!b->valid) {
+        if (!blk_read(dev, lba, 1, b->data)) {
+            bc_drop(b);
+            b->refcount--;
+            return NULL;
+        }
+        b->valid = true;
+    }
+    return b;
+}
+
+void bcache_put(buf_t* b) {
+    if (b && b->refcount) b->refcount--;
+}
+
+// Cache a sector the caller has just read from disk
+static void bc_insert(blkdev_t* dev, uint32_t lba, const uint8_t* data) {
+    buf_t* b = bc_recycle(dev, lba);
+    if (!b) return;
+    memcpy(b->data, data, BLK_SECTOR_SIZE);
+    b->valid = true;
+    lru_unlink(b);
+    lru_push_head(b);
+}
+
+// Run the queued miss requests and cache what they brought in
+static bool bc_flush_batch(blkdev_t* dev, uint32_t n) {
+    if (!n) return true;
+    blk_run(dev);
+
+    bool ok = true;
+    for (uint32_t r = 0; r < n; r++) {
+        blk_request_t* req = &bc_batch[r];
+        if (req->status != BLK_OK) { ok = false; continue; }
+        bc_stats.misses += req->count;
+        if (req->count > bc_nbufs / 2) continue;
+        for (uint32_t k = 0; k < req->count; k++)
+            bc_insert(dev, req->lba + k, req->buf + k * BLK_SECTOR_SIZE);
+    }
+    return ok;
+}
+
+bool bcache_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* out) {
+    if (!bc_nbufs) return blk_read(dev, lba, count, out);
+
+    uint32_t nreq = 0;
+    uint32_t i = 0;
+    while (i < count) {
+        buf_t* b = bc_lookup(dev, lba + i);
+        if (b) {
+            bc_stats.hits++;
+            memcpy(out + i * BLK_SECTOR_SIZE, b->data, BLK_SECTOR_SIZE);
+            lru_unlink(b);
+            lru_push_head(b);
+            i++;
+            continue;
+        }
+
+        // Run of misses: one request into the caller's buffer
+        uint32_t j = i + 1;
+        while (j < count && j - i < dev->max_transfer && !bc_lookup(dev, lba + j)) j++;
+
+        if (dev->ops->map) {
+            // Memory-backed: the data is already in RAM, do not cache it twice
+            uint8_t* src = dev->ops->map(dev, lba + i);
+            if (!src || !dev->ops->map(dev, lba + j - 1)) return false;
+            memcpy(out + i * BLK_SECTOR_SIZE, src, (j - i) * BLK_SECTOR_SIZE);
+            i = j;
+            continue;
+        }
+
+        if (nreq == BCACHE_BATCH) {
+            if (!bc_flush_batch(dev, nreq)) return false;
+            nreq = 0;
+        }
+        blk_request_t* req = &bc_batch[nreq++];
+        req->lba   = lba + i;
+        req->count = j - i;
+        req->buf   = out + i * BLK_SECTOR_SIZE;
+        req->write = false;
+        req->done  = NULL;
+        blk_submit(dev, req);
+        i = j;
+    }
+    return bc_flush_batch(dev, nreq);
+}
+
+void bcache_readahead(blkdev_t* dev, uint32_t lba, uint32_t count) {
+    // A guess must never push out more than a quarter of the cache
+    if (count > bc_nbufs / 4) count = bc_nbufs / 4;
+    if (dev->ops->map) return;      // Nothing to wait for
+
+    while (count) {
+        // Skip what is cached already
+        while (count && bc_lookup(dev, lba)) {
+            lba++;
+            count--;
+        }
+        uint32_t n = count < BCACHE_STAGE_SECTORS ? count : BCACHE_STAGE_SECTORS;
+        if (!n || !bcache_read(dev, lba, n, bc_stage)) break;
+        bc_stats.readahead += n;
+        lba += n;
+        count -= n;
+    }
+}
+
+static void bc_set_dirty(buf_t* b) {
+    if (b->dirty) return;
+    b->dirty = true;
+    bc_ndirty++;
+}
+
+void bcache_mark_dirty(buf_t* b) {
+    bc_set_dirty(b);
+    if (bc_ndirty > bc_nbufs / 4) bcache_sync(NULL);
+}
+
+bool bcache_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* in) {
+    if (!bc_nbufs) return blk_write(dev, lba, count, in);
+
+    for (uint32_t i = 0; i < count; i++) {
+        buf_t* b = bc_lookup(dev, lba + i);
+        if (!b && !(b = bc_recycle(dev, lba + i))) {
+            // Everything is dirty or held: make room, else write through
+            if (!bcache_sync(NULL) || !(b = bc_recycle(dev, lba + i)))
+                return blk_write(dev, lba + i, count - i, in + i * BLK_SECTOR_SIZE);
+        }
+        memcpy(b->data, in + i * BLK_SECTOR_SIZE, BLK_SECTOR_SIZE);
+        b->valid = true;
+        bc_set_dirty(b);
+        lru_unlink(b);
+        lru_push_head(b);
+    }
+    if (bc_ndirty > bc_nbufs / 4) return bcache_sync(NULL);
+    return true;
+}
+
+// Sort order for write-back: by device, then LBA
+static bool bc_before(const buf_t* a, const buf_t* b) {
+    if (a->dev != b->dev) return (uintptr_t)a->dev < (uintptr_t)b->dev;
+    return a->lba < b->lba;
+}
+
+static void bc_sift(buf_t** v, uint32_t i, uint32_t n) {
+    for (;;) {
+        uint32_t c = 2 * i + 1;
+        if (c >= n) return;
+        if (c + 1 < n && bc_before(v[c], v[c + 1])) c++;
+        if (!bc_before(v[i], v[c])) return;
+        buf_t* t = v[i]; v[i] = v[c]; v[c] = t;
+        i = c;
+    }
+}
+
+// Heapsort: no recursion, no extra memory
+static void bc_sort(buf_t** v, uint32_t n) {
+    for (uint32_t i = n / 2; i-- > 0; ) bc_sift(v, i, n);
+    for (uint32_t end = n; end-- > 1; ) {
+        buf_t* t = v[0]; v[0] = v[end]; v[end] = t;
+        bc_sift(v, 0, end);
+    }
+}
+
+// Write the sorted dirty buffers v[0..n), all of one device, staged in
+// bc_stage: one request per contiguous run
+static bool bc_write_batch(buf_t** v, uint32_t n) {
+    blkdev_t* dev = v[0]->dev;
+    uint32_t nreq = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        memcpy(bc_stage + i * BLK_SECTOR_SIZE, v[i]->data, BLK_SECTOR_SIZE);
+        blk_request_t* prev = nreq ? &bc_batch[nreq - 1] : NULL;
+        if (prev && v[i]->lba == prev->lba + prev->count && prev->count < dev->max_transfer) {
+            prev->count++;
+            continue;
+        }
+        blk_request_t* req = &bc_batch[nreq++];
+        req->lba   = v[i]->lba;
+        req->count = 1;
+        req->buf   = bc_stage + i * BLK_SECTOR_SIZE;
+        req->write = true;
+        req->done  = NULL;
+    }
+    for (uint32_t r = 0; r < nreq; r++) blk_submit(dev, &bc_batch[r]);
+    blk_run(dev);
+
+    bool ok = true;
+    for (uint32_t r = 0; r < nreq; r++) {
+        if (bc_batch[r].status != BLK_OK) ok = false;
+        else bc_stats.written += bc_batch[r].count;
+    }
+    if (!ok) return false;
+    for (uint32_t i = 0; i < n; i++) {
+        v[i]->dirty = false;
+        bc_ndirty--;
+    }
+    return true;
+}
+
+bool bcache_sync(blkdev_t* dev) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < bc_nbufs; i++) {
+        buf_t* b = &bc_bufs[i];
+        if (b->dirty && (!dev || b->dev == dev)) bc_sorted[n++] = b;
+    }
+    if (!n) return true;
+    bc_sort(bc_sorted, n);
+
+    // A batch ends at a device change, when the staging buffer is full or
+    // when it would need more requests than bc_batch holds. Requests break
+    // where bc_write_batch() breaks them.
+    bool ok = true;
+    uint32_t first = 0, nreq = 0, req_len = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        buf_t* b = bc_sorted[i];
+        buf_t* p = i ? bc_sorted[i - 1] : NULL;
+        bool new_req = i == first || b->dev != p->dev || b->lba != p->lba + 1 ||
+                       req_len == b->dev->max_transfer;
+        if (i > first && (b->dev != bc_sorted[first]->dev || i - first == BCACHE_STAGE_SECTORS ||
+                          (new_req && nreq == BCACHE_BATCH))) {
+            if (!bc_write_batch(bc_sorted + first, i - first)) ok = false;
+            first = i;
+            nreq = 0;
+            new_req = true;
+        }
+        if (new_req) {
+            nreq++;
+            req_len = 0;
+        }
+        req_len++;
+    }
+    if (!bc_write_batch(bc_sorted + first, n - first)) ok = false;
+
+    // Commit the drives' write caches too
+    blkdev_t* last = NULL;
+    for (uint32_t i = 0; i < n; i++) {
+        if (bc_sorted[i]->dev == last) continue;
+        last = bc_sorted[i]->dev;
+        if (!blk_flush(last)) ok = false;
+    }
+    if (!bc_ndirty) bc_dirty_since = 0;
+    return ok;
+}
+
+void bcache_writeback(uint32_t now) {
+    if (!bc_ndirty) {
+        bc_dirty_since = 0;
+        return;
+    }
+    if (!bc_dirty_since) {
+        bc_dirty_since = now | 1;
+        return;
+    }
+    if (now - bc_dirty_since >= BCACHE_WRITEBACK_MS) bcache_sync(NULL);
+}
+
+void bcache_invalidate(blkdev_t* dev) {
+    bcache_sync(dev);
+    for (uint32_t i = 0; i < bc_nbufs; i++) {
+        buf_t* b = &bc_bufs[i];
+        if (b->dev == dev && !b->refcount && !b->dirty) bc_drop(b);
+    }
+}
+
+void bcache_get_stats(bcache_stats_t* st) {
+    *st = bc_stats;
+    st->dirty = bc_ndirty;
+}
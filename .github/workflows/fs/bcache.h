@@ -0,0 +1,68 @@
+// bcache.h - Sector buffer cache
+#ifndef BCACHE_H
+#define BCACHE_H
+#include "../kernel/kernel.h"
+#include "../drivers/blkdev.h"
+
+typedef struct buf {
+    blkdev_t*   dev;
+    uint32_t    lba;
+    uint32_t    refcount;
+    bool        valid;          // Data is current (matches the disk unless dirty)
+    bool        dirty;          // Modified, not yet written back
+    struct buf* hash_next;      // Hash chain
+    struct buf* lru_prev;       // LRU list: head = most recently used
+    struct buf* lru_next;
+    uint8_t*    data;           // BLK_SECTOR_SIZE bytes
+} buf_t;
+
+typedef struct {
+    uint32_t buffers;           // Cache size in sectors
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t readahead;         // Sectors requested by bcache_readahead()
+    uint32_t dirty;             // Buffers waiting for write-back
+    uint32_t written;           // Sectors written back
+} bcache_stats_t;
+
+// Dirty data is written back after this long (milliseconds)
+#define BCACHE_WRITEBACK_MS     5000
+
+#define BCACHE_MIN_BUFS   256           // Smallest cache bcache_init() accepts
+
+// Allocate `nbufs` sector buffers from the kernel heap
+bool   bcache_init(uint32_t nbufs);
+// Pick a buffer count for the heap currently free
+uint32_t bcache_default_size(void);
+
+// Return a referenced, valid buffer for (dev, lba), reading it on a miss.
+// NULL on I/O error or when every buffer is in use.
+buf_t* bcache_get(blkdev_t* dev, uint32_t lba);
+void   bcache_put(buf_t* b);
+
+// Copy `count` sectors through the cache; each run of misses is read with
+// one transfer into `out`
+bool   bcache_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* out);
+
+// Bring `count` sectors into the cache without copying them anywhere.
+// Best effort: errors are ignored, the later read reports them.
+void   bcache_readahead(blkdev_t* dev, uint32_t lba, uint32_t count);
+
+// Write `count` sectors through the cache; they reach the disk at the next
+// sync (write-back). False only when a forced write-back failed.
+bool   bcache_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* in);
+// The caller changed b->data of a buffer it holds from bcache_get()
+void   bcache_mark_dirty(buf_t* b);
+// Write back dirty sectors of `dev` (NULL = all devices) in LBA order, one
+// request per contiguous run, then flush the drive's write cache
+bool   bcache_sync(blkdev_t* dev);
+// Call periodically with the current time in milliseconds: syncs once
+// dirty data is BCACHE_WRITEBACK_MS old
+void   bcache_writeback(uint32_t now);
+
+// Write back, then drop all cached sectors of a device (unreferenced
+// buffers only)
+void   bcache_invalidate(blkdev_t* dev);
+void   bcache_get_stats(bcache_stats_t* st);
+#endif
@@ -0,0 +1,134 @@
+// dcache.c - Directory entry cache
+//
+// Maps (parent directory cluster, 8.3 name) to a copy of the directory
+// entry, so resolving a path that was seen before needs no disk access.
+// Names that were looked up and not found are cached too (negative
+// entries), which makes repeated misses, e.g. PATH-style probing, free.
+// A fixed pool of entries is indexed by a hash table and recycled in
+// least recently used order.
+
+#include "dcache.h"
+#include "../kernel/kernel.h"
+
+#define DCACHE_BUCKETS  128     // Power of two
+
+typedef struct dentry {
+    uint32_t        parent;
+    char            name[11];
+    bool            used;
+    bool            negative;
+    fat_dir_entry_t entry;
+    uint32_t        slot;       // Entry number within the parent
+    struct dentry*  hash_next;
+    struct dentry*  lru_prev;   // Head = most recently used
+    struct dentry*  lru_next;
+} dentry_t;
+
+static dentry_t  dc_pool[DCACHE_ENTRIES];
+static dentry_t* dc_hash[DCACHE_BUCKETS];
+static dentry_t* dc_lru_head = NULL;
+static dentry_t* dc_lru_tail = NULL;
+static bool      dc_ready = false;
+static dcache_stats_t dc_stats;
+
+// FNV-1a over the name, mixed with the parent cluster
+static uint32_t dc_bucket(uint32_t parent, const char* name83) {
+    uint32_t h = 2166136261u ^ parent;
+    for (int i = 0; i < 11; i++) {
+        h ^= (uint8_t)name83[i];
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 16)) & (DCACHE_BUCKETS - 1);
+}
+
+static void lru_unlink(dentry_t* d) {
+    if (d->lru_prev) d->lru_prev->lru_next = d->lru_next;
+    else             dc_lru_head = d->lru_next;
+    if (d->lru_next) d->lru_next->lru_prev = d->lru_prev;
+    else             dc_lru_tail = d->lru_prev;
+    d->lru_prev = d->lru_next = NULL;
+}
+
+static void lru_push_head(dentry_t* d) {
+    d->lru_prev = NULL;
+    d->lru_next = dc_lru_head;
+    if (dc_lru_head) dc_lru_head->lru_prev = d;
+    else             dc_lru_tail = d;
+    dc_lru_head = d;
+}
+
+static void hash_remove(dentry_t* d) {
+    dentry_t** pp = &dc_hash[dc_bucket(d->parent, d->name)];
+    while (*pp && *pp != d) pp = &(*pp)->hash_next;
+    if (*pp) *pp = d->hash_next;
+    d->hash_next = NULL;
+}
+
+void dcache_invalidate(void) {
+    memset(dc_pool, 0, sizeof(dc_pool));
+    memset(dc_hash, 0, sizeof(dc_hash));
+    dc_lru_head = dc_lru_tail = NULL;
+    for (uint32_t i = 0; i < DCACHE_ENTRIES; i++) lru_push_head(&dc_pool[i]);
+    dc_stats.entries = 0;
+    dc_ready = true;
+}
+
+static dentry_t* dc_find(uint32_t parent, const char* name83) {
+    for (dentry_t* d = dc_hash[dc_bucket(parent, name83)]; d; d = d->hash_next)
+        if (d->parent == parent && memcmp(d->name, name83, 11) == 0) return d;
+    return NULL;
+}
+
+int dcache_lookup(uint32_t parent, const char* name83, fat_dir_entry_t* out, uint32_t* slot) {
+    if (!dc_ready) dcache_invalidate();
+
+    dentry_t* d = dc_find(parent, name83);
+    if (!d) {
+        dc_stats.misses++;
+        return DCACHE_MISS;
+    }
+
+    lru_unlink(d);
+    lru_push_head(d);
+    if (d->negative) {
+        dc_stats.negative_hits++;
+        return DCACHE_NEGATIVE;
+    }
+    dc_stats.hits++;
+    *out = d->entry;
+    if (slot) *slot = d->slot;
+    return DCACHE_HIT;
+}
+
+void dcache_insert(uint32_t parent, const char* name83, const fat_dir_entry_t* entry,
+                   uint32_t slot) {
+    if (!dc_ready) dcache_invalidate();
+
+    dentry_t* d = dc_find(parent, name83);
+    if (!d) {
+        // Recycle the least recently used entry
+        d = dc_lru_tail;
+        if (d->used) {
+            hash_remove(d);
+            dc_stats.evictions++;
+        } else {
+            dc_stats.entries++;
+        }
+        d->parent = parent;
+        memcpy(d->name, name83, 11);
+        d->used = true;
+        uint32_t h = dc_bucket(parent, name83);
+        d->hash_next = dc_hash[h];
+        dc_hash[h] = d;
+    }
+
+    d->negative = entry == NULL;
+    if (entry) d->entry = *entry;
+    d->slot = slot;
+    lru_unlink(d);
+    lru_push_head(d);
+}
+
+void dcache_get_stats(dcache_stats_t* st) {
+    *st = dc_stats;
+}
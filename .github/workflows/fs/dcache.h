@@ -0,0 +1,31 @@
+// dcache.h - Directory entry cache
+#ifndef DCACHE_H
+#define DCACHE_H
+#include "../kernel/kernel.h"
+#include "fat.h"
+
+#define DCACHE_ENTRIES  256
+
+#define DCACHE_MISS     0       // Not cached: scan the directory
+#define DCACHE_HIT      1       // Cached entry copied out
+#define DCACHE_NEGATIVE 2       // Cached as "does not exist"
+
+typedef struct {
+    uint32_t entries;
+    uint32_t hits;
+    uint32_t negative_hits;
+    uint32_t misses;
+    uint32_t evictions;
+} dcache_stats_t;
+
+// Look up `name83` in the directory whose first cluster is `parent`
+// (0 = root); on a hit also returns the entry's slot (may be NULL)
+int  dcache_lookup(uint32_t parent, const char* name83, fat_dir_entry_t* out, uint32_t* slot);
+// Remember the result of a directory scan or an entry that was written;
+// `entry` NULL = not found
+void dcache_insert(uint32_t parent, const char* name83, const fat_dir_entry_t* entry,
+                   uint32_t slot);
+// Forget everything (new mount, directory changed)
+void dcache_invalidate(void);
+void dcache_get_stats(dcache_stats_t* st);
+#endif
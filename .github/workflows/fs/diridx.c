@@ -0,0 +1,217 @@
+// diridx.c - In-memory directory index
+//
+// A directory is read once and its live entries are kept in memory, in
+// directory order, together with the slot (32-byte entry number) each one
+// occupies on disk. A hash table over the 8.3 names makes a lookup one
+// bucket probe and an 11-byte compare, with no disk access; listing the
+// directory is a copy. The root directory is indexed at mount and pinned,
+// other directories are indexed the first time they are searched and
+// recycled in least recently used order.
+//
+// Entries are sorted by slot, so writers can update a single slot with
+// diridx_update() instead of invalidating the whole directory.
+
+#include "diridx.h"
+#include "../kernel/kernel.h"
+#include "../kernel/kmem.h"
+
+typedef struct {
+    fat_dir_entry_t entry;
+    uint32_t        slot;
+    uint32_t        hash;
+    uint32_t        next;       // Next record in the bucket + 1, 0 = end
+} diridx_rec_t;
+
+struct diridx {
+    uint32_t      dir;
+    bool          used;
+    bool          pinned;
+    uint32_t      last_use;
+    uint32_t      count;
+    uint32_t      cap;          // Records and buckets allocated (power of two)
+    diridx_rec_t* recs;
+    uint32_t*     buckets;      // First record + 1, 0 = empty
+};
+
+static diridx_t       di_dirs[DIRIDX_MAX_DIRS];
+static uint32_t       di_clock = 0;
+static diridx_stats_t di_stats;
+
+// FNV-1a over the 8.3 name
+static uint32_t di_hash(const char* name83) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 11; i++) {
+        h ^= (uint8_t)name83[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void di_free(diridx_t* idx) {
+    if (idx->used) {
+        di_stats.dirs--;
+        di_stats.entries -= idx->count;
+    }
+    kfree(idx->recs);
+    kfree(idx->buckets);
+    memset(idx, 0, sizeof(diridx_t));
+}
+
+// Rebuild the bucket chains after records moved
+static void di_rehash(diridx_t* idx) {
+    memset(idx->buckets, 0, idx->cap * sizeof(uint32_t));
+    for (uint32_t i = 0; i < idx->count; i++) {
+        uint32_t b = idx->recs[i].hash & (idx->cap - 1);
+        idx->recs[i].next = idx->buckets[b];
+        idx->buckets[b] = i + 1;
+    }
+}
+
+// Make room for one more record
+static bool di_reserve(diridx_t* idx) {
+    if (idx->count < idx->cap) return true;
+    if (idx->count >= DIRIDX_MAX_ENTRIES) return false;
+
+    uint32_t cap = idx->cap ? idx->cap * 2 : 64;
+    diridx_rec_t* recs = kmalloc(cap * sizeof(diridx_rec_t));
+    uint32_t* buckets  = kmalloc(cap * sizeof(uint32_t));
+    if (!recs || !buckets) {
+        kfree(recs);
+        kfree(buckets);
+        return false;
+    }
+    if (idx->count) memcpy(recs, idx->recs, idx->count * sizeof(diridx_rec_t));
+    kfree(idx->recs);
+    kfree(idx->buckets);
+    idx->recs = recs;
+    idx->buckets = buckets;
+    idx->cap = cap;
+    di_rehash(idx);
+    return true;
+}
+
+// First record whose slot is >= `slot`
+static uint32_t di_find_slot(diridx_t* idx, uint32_t slot) {
+    uint32_t lo = 0, hi = idx->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (idx->recs[mid].slot < slot) lo = mid + 1;
+        else                            hi = mid;
+    }
+    return lo;
+}
+
+diridx_t* diridx_get(uint32_t dir) {
+    for (uint32_t i = 0; i < DIRIDX_MAX_DIRS; i++) {
+        if (di_dirs[i].used && di_dirs[i].dir == dir) {
+            di_dirs[i].last_use = ++di_clock;
+            return &di_dirs[i];
+        }
+    }
+    return NULL;
+}
+
+diridx_t* diridx_create(uint32_t dir, bool pinned) {
+    diridx_drop(dir);
+
+    diridx_t* victim = NULL;
+    for (uint32_t i = 0; i < DIRIDX_MAX_DIRS; i++) {
+        diridx_t* d = &di_dirs[i];
+        if (!d->used) { victim = d; break; }
+        if (!d->pinned && (!victim || d->last_use < victim->last_use)) victim = d;
+    }
+    if (!victim) return NULL;
+    if (victim->used) di_stats.evictions++;
+    di_free(victim);
+
+    victim->dir = dir;
+    victim->used = true;
+    victim->pinned = pinned;
+    victim->last_use = ++di_clock;
+    di_stats.dirs++;
+    di_stats.builds++;
+    return victim;
+}
+
+bool diridx_add(diridx_t* idx, uint32_t slot, const fat_dir_entry_t* entry) {
+    if (!di_reserve(idx)) return false;
+
+    diridx_rec_t* r = &idx->recs[idx->count];
+    r->entry = *entry;
+    r->slot = slot;
+    r->hash = di_hash(entry->name);
+    uint32_t b = r->hash & (idx->cap - 1);
+    r->next = idx->buckets[b];
+    idx->buckets[b] = ++idx->count;
+    di_stats.entries++;
+    return true;
+}
+
+void diridx_drop(uint32_t dir) {
+    for (uint32_t i = 0; i < DIRIDX_MAX_DIRS; i++)
+        if (di_dirs[i].used && di_dirs[i].dir == dir) di_free(&di_dirs[i]);
+}
+
+bool diridx_lookup(diridx_t* idx, const char* name83, fat_dir_entry_t* out, uint32_t* slot) {
+    di_stats.lookups++;
+    if (!idx->cap) return false;
+
+    uint32_t h = di_hash(name83);
+    for (uint32_t i = idx->buckets[h & (idx->cap - 1)]; i; i = idx->recs[i - 1].next) {
+        diridx_rec_t* r = &idx->recs[i - 1];
+        if (r->hash == h && memcmp(r->entry.name, name83, 11) == 0) {
+            if (out) *out = r->entry;
+            if (slot) *slot = r->slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t diridx_list(diridx_t* idx, fat_dir_entry_t* out, uint32_t max, uint8_t skip_attrs) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < idx->count && n < max; i++)
+        if (!(idx->recs[i].entry.attrs & skip_attrs)) out[n++] = idx->recs[i].entry;
+    return n;
+}
+
+void diridx_update(uint32_t dir, uint32_t slot, const fat_dir_entry_t* entry) {
+    diridx_t* idx = diridx_get(dir);
+    if (!idx) return;
+
+    bool live = entry && entry->name[0] != 0x00 && (uint8_t)entry->name[0] != 0xE5 &&
+                !(entry->attrs & FAT_ATTR_VOLID);
+    uint32_t i = di_find_slot(idx, slot);
+    bool present = i < idx->count && idx->recs[i].slot == slot;
+
+    if (!live) {
+        if (!present) return;
+        for (uint32_t j = i; j + 1 < idx->count; j++) idx->recs[j] = idx->recs[j + 1];
+        idx->count--;
+        di_stats.entries--;
+    } else if (present) {
+        idx->recs[i].entry = *entry;
+        idx->recs[i].hash = di_hash(entry->name);
+    } else {
+        if (!di_reserve(idx)) {
+            // Cannot keep the index complete: fall back to scanning
+            diridx_drop(dir);
+            return;
+        }
+        for (uint32_t j = idx->count; j > i; j--) idx->recs[j] = idx->recs[j - 1];
+        idx->recs[i].entry = *entry;
+        idx->recs[i].slot = slot;
+        idx->recs[i].hash = di_hash(entry->name);
+        idx->count++;
+        di_stats.entries++;
+    }
+    di_rehash(idx);
+}
+
+void diridx_invalidate(void) {
+    for (uint32_t i = 0; i < DIRIDX_MAX_DIRS; i++) di_free(&di_dirs[i]);
+}
+
+void diridx_get_stats(diridx_stats_t* st) {
+    *st = di_stats;
+}
@@ -0,0 +1,39 @@
+// diridx.h - In-memory directory index
+#ifndef DIRIDX_H
+#define DIRIDX_H
+#include "../kernel/kernel.h"
+#include "fat.h"
+
+#define DIRIDX_MAX_DIRS     8       // Indexed directories kept at once
+#define DIRIDX_MAX_ENTRIES  8192    // Larger directories are scanned instead
+
+typedef struct diridx diridx_t;
+
+typedef struct {
+    uint32_t dirs;
+    uint32_t entries;
+    uint32_t lookups;
+    uint32_t builds;
+    uint32_t evictions;
+} diridx_stats_t;
+
+// Index of directory `dir` (first cluster, 0 = root), NULL if not built
+diridx_t* diridx_get(uint32_t dir);
+// Start an empty index for `dir`, evicting the least recently used
+// unpinned one if needed. Fill it with diridx_add().
+diridx_t* diridx_create(uint32_t dir, bool pinned);
+// Append the entry stored in directory slot `slot` (32-byte entry number)
+bool      diridx_add(diridx_t* idx, uint32_t slot, const fat_dir_entry_t* entry);
+// Forget the index of `dir` (build failed, directory removed)
+void      diridx_drop(uint32_t dir);
+// Find `name83`; copies the entry and its slot out. No disk access.
+bool      diridx_lookup(diridx_t* idx, const char* name83, fat_dir_entry_t* out, uint32_t* slot);
+// Copy out entries in directory order, skipping any with `skip_attrs` set
+uint32_t  diridx_list(diridx_t* idx, fat_dir_entry_t* out, uint32_t max, uint8_t skip_attrs);
+// Directory slot `slot` of `dir` now holds `entry` (deleted or NULL =
+// removed). No-op when `dir` is not indexed.
+void      diridx_update(uint32_t dir, uint32_t slot, const fat_dir_entry_t* entry);
+// Drop every index (new mount)
+void      diridx_invalidate(void);
+void      diridx_get_stats(diridx_stats_t* st);
+#endif
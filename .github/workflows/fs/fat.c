@@ -1,147 +1,550 @@
-// fat.c - FAT12/FAT16 Filesystem Driver
-// Uses LBA28 ATA PIO for disk access
+// fat.c - FAT12/FAT16/FAT32 Filesystem Driver
+// Disk access goes through the buffer cache (fs/bcache.c) on top of the
+// block device layer (drivers/blkdev.c)
+//
+// The whole FAT is mirrored in a heap buffer that fills in one sector at a
+// time as entries are looked up. When a file is first read its cluster
+// chain is converted into an extent list, (start cluster, length) runs,
+// which is kept in a small LRU cache keyed by the start cluster. Reads at
+// any offset then cost O(extents), and each extent reaches the cache (and
+// the disk) as one contiguous sector range. File handles (fat_open) keep
+// their place in the extent list and prefetch a growing window ahead of
+// sequential readers.
+//
+// Paths are resolved one component at a time. Each directory is read once
+// into an in-memory index (fs/diridx.c), the root directory at mount, so
+// lookups and listings need no disk access; directories too large to index
+// are scanned through the dentry cache (fs/dcache.c) instead.
+// Subdirectories, like the FAT32 root directory, are cluster chains read
+// through the same extent map. The FSInfo sector's free count and
+// next-free hint are loaded at mount so free-space queries need no FAT
+// scan.
 
 #include "fat.h"
 #include "../kernel/kernel.h"
 #include "../kernel/vga.h"
+#include "../kernel/kmem.h"
+#include "../drivers/blkdev.h"
+#include "bcache.h"
+#include "dcache.h"
+#include "diridx.h"
 
-// ATA PIO ports (Primary channel)
-#define ATA_DATA        0x1F0
-#define ATA_ERROR       0x1F1
-#define ATA_SECT_COUNT  0x1F2
-#define ATA_LBA_LO      0x1F3
-#define ATA_LBA_MID     0x1F4
-#define ATA_LBA_HI      0x1F5
-#define ATA_DRIVE       0x1F6
-#define ATA_STATUS      0x1F7
-#define ATA_CMD         0x1F7
-
-#define ATA_STATUS_BSY  0x80
-#define ATA_STATUS_RDY  0x40
-#define ATA_STATUS_DRQ  0x08
-#define ATA_STATUS_ERR  0x01
-#define ATA_CMD_READ    0x20
+// A run of physically contiguous clusters
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+} fat_extent_t;
+
+// Extent list of one cluster chain
+typedef struct {
+    uint32_t      first_cluster;    // Key; 0 = slot unused
+    uint32_t      clusters;         // Total clusters in the chain
+    uint32_t      num_extents;
+    fat_extent_t* extents;
+    uint32_t      last_use;
+} fat_extmap_t;
+
+#define FAT_EXTMAP_CACHE 16
 
 static fat_bpb_t bpb;
 static bool fat_mounted = false;
-static uint8_t fat_table[512 * 18]; // FAT12: max 18 sectors
-static uint32_t fat_root_dir_lba;
+static uint32_t fat_lba;
+static uint32_t fat_sectors_per_fat;
+static uint32_t fat_root_dir_lba;       // FAT12/16: fixed root directory
+static uint32_t fat_root_sectors;
+static uint32_t fat_root_cluster;       // FAT32: root directory chain
 static uint32_t fat_data_lba;
+static uint32_t fat_cluster_count;
+static uint32_t fat_fsinfo_lba;         // 0 = no FSInfo
+static uint32_t fat_free_count;         // FAT_FSINFO_UNKNOWN until known
+static uint32_t fat_next_free;
 static uint8_t fat_type = 0;
+static blkdev_t* fat_dev = NULL;
+
+// FAT table cache: fat_table holds fat_sectors_per_fat sectors, fat_loaded
+// has one bit per sector. NULL when the heap could not hold it, in which
+// case entries are read through the buffer cache (and the volume is
+// read-only). Sectors changed by writes are marked in fat_dirty until
+// fat_flush_table() copies them to every FAT in the buffer cache.
+static uint8_t*  fat_table = NULL;
+static uint32_t* fat_loaded = NULL;
+static uint32_t* fat_dirty = NULL;
+
+static fat_extmap_t fat_extmaps[FAT_EXTMAP_CACHE];
+static uint32_t     fat_extmap_clock = 0;
+
+// Told about every directory entry change, NULL loc = new mount
+static void (*fat_change_hook)(const fat_loc_t* loc) = NULL;
+
+// Read-ahead window of a file handle: starts at a few times the read size
+// and doubles on every sequential read, up to fat_ra_max (0 = off)
+#define FAT_RA_MIN  (16 * 1024)
+static uint32_t fat_ra_max = FAT_RA_DEFAULT;
+
+// Directories are scanned this many sectors per transfer
+#define FAT_DIR_BATCH 8
+static uint8_t dir_buf[512 * FAT_DIR_BATCH];
+
+// Partial sectors at the ends of a read
+static uint8_t fat_sector_buf[512];
+
+static diridx_t* fat_dir_index(uint32_t dir);
 
-// Wait for ATA drive to be ready
-static bool ata_wait(void) {
-    uint32_t timeout = 100000;
-    while (timeout--) {
-        uint8_t s = inb(ATA_STATUS);
-        if (s & ATA_STATUS_ERR) return false;
-        if (!(s & ATA_STATUS_BSY) && (s & ATA_STATUS_RDY)) return true;
+bool fat_init(void) {
+    blkdev_t* dev = blkdev_get(0);
+    if (!dev) {
+        vga_print("[FAT] No block device\n");
+        return false;
     }
-    return false;
+    return fat_mount(dev);
 }
 
-// Read sectors via LBA28 PIO
-bool ata_read_sectors(uint32_t lba, uint8_t count, uint8_t* buf) {
-    if (!ata_wait()) return false;
+static void fat_extmap_clear(void) {
+    for (uint32_t i = 0; i < FAT_EXTMAP_CACHE; i++) {
+        kfree(fat_extmaps[i].extents);
+        memset(&fat_extmaps[i], 0, sizeof(fat_extmap_t));
+    }
+}
 
-    outb(ATA_DRIVE,      0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_ERROR,      0x00);
-    outb(ATA_SECT_COUNT, count);
-    outb(ATA_LBA_LO,     (lba & 0xFF));
-    outb(ATA_LBA_MID,    (lba >> 8) & 0xFF);
-    outb(ATA_LBA_HI,     (lba >> 16) & 0xFF);
-    outb(ATA_CMD,        ATA_CMD_READ);
+// Read the FAT32 free cluster hints; values that cannot be right are
+// treated as unknown
+static void fat_load_fsinfo(uint32_t sector) {
+    fat_fsinfo_t fsi;
+    if (!bcache_read(fat_dev, sector, 1, (uint8_t*)&fsi)) return;
+    if (fsi.lead_sig != FAT_FSINFO_LEAD_SIG || fsi.struct_sig != FAT_FSINFO_STRUCT_SIG ||
+        fsi.trail_sig != FAT_FSINFO_TRAIL_SIG)
+        return;
 
-    for (int s = 0; s < count; s++) {
-        // Wait for DRQ
-        uint32_t timeout = 100000;
-        while (timeout--) {
-            uint8_t st = inb(ATA_STATUS);
-            if (st & ATA_STATUS_ERR) return false;
-            if (st & ATA_STATUS_DRQ) break;
-        }
-        // Read 256 words
-        for (int i = 0; i < 256; i++) {
-            uint16_t data = inw(ATA_DATA);
-            buf[s * 512 + i * 2]     = data & 0xFF;
-            buf[s * 512 + i * 2 + 1] = (data >> 8) & 0xFF;
-        }
-    }
-    return true;
+    fat_fsinfo_lba = sector;
+    if (fsi.free_count <= fat_cluster_count) fat_free_count = fsi.free_count;
+    if (fsi.next_free >= 2 && fsi.next_free < fat_cluster_count + 2)
+        fat_next_free = fsi.next_free;
 }
 
-bool fat_init(void) {
+bool fat_mount(blkdev_t* dev) {
     uint8_t boot_sector[512];
 
-    if (!ata_read_sectors(0, 1, boot_sector)) {
-        vga_print("[FAT] ATA read failed\n");
+    if (fat_mounted) fat_sync();
+    fat_mounted = false;
+    fat_dev = dev;
+    if (fat_change_hook) fat_change_hook(NULL);
+    fat_extmap_clear();
+    dcache_invalidate();
+    diridx_invalidate();
+    kfree(fat_table);
+    kfree(fat_loaded);
+    kfree(fat_dirty);
+    fat_table = NULL;
+    fat_loaded = NULL;
+    fat_dirty = NULL;
+
+    bcache_invalidate(dev);
+    if (!bcache_read(fat_dev, 0, 1, boot_sector)) {
+        vga_print("[FAT] Disk read failed\n");
         return false;
     }
 
     memcpy(&bpb, boot_sector, sizeof(fat_bpb_t));
+    fat32_bpb_ext_t ext;
+    memcpy(&ext, boot_sector + sizeof(fat_bpb_t), sizeof(ext));
 
     // Validate
-    if (bpb.bytes_per_sector != 512) {
+    fat_sectors_per_fat = bpb.sectors_per_fat ? bpb.sectors_per_fat : ext.sectors_per_fat32;
+    if (bpb.bytes_per_sector != 512 || bpb.sectors_per_cluster == 0 ||
+        bpb.num_fats == 0 || fat_sectors_per_fat == 0) {
         vga_print("[FAT] Invalid BPB\n");
         return false;
     }
 
     // Calculate locations
-    uint32_t fat_lba = bpb.reserved_sectors;
-    fat_root_dir_lba = fat_lba + (bpb.num_fats * bpb.sectors_per_fat);
-    uint32_t root_dir_sectors = (bpb.root_entry_count * 32 + 511) / 512;
-    fat_data_lba = fat_root_dir_lba + root_dir_sectors;
+    fat_lba = bpb.reserved_sectors;
+    fat_root_dir_lba = fat_lba + bpb.num_fats * fat_sectors_per_fat;
+    fat_root_sectors = (bpb.root_entry_count * 32 + 511) / 512;
+    fat_data_lba = fat_root_dir_lba + fat_root_sectors;
 
     uint32_t total_sectors = bpb.total_sectors16 ? bpb.total_sectors16 : bpb.total_sectors32;
+    if (total_sectors <= fat_data_lba) {
+        vga_print("[FAT] Invalid BPB\n");
+        return false;
+    }
     uint32_t data_sectors = total_sectors - fat_data_lba;
-    uint32_t cluster_count = data_sectors / bpb.sectors_per_cluster;
+    fat_cluster_count = data_sectors / bpb.sectors_per_cluster;
 
-    if (cluster_count < 4085)       fat_type = 12;
-    else if (cluster_count < 65525) fat_type = 16;
-    else                            fat_type = 32;
+    if (fat_cluster_count < 4085)       fat_type = 12;
+    else if (fat_cluster_count < 65525) fat_type = 16;
+    else                                fat_type = 32;
 
-    // Load FAT table
-    uint8_t fat_sectors = (fat_type == 12) ? 
-        (bpb.sectors_per_fat < 18 ? bpb.sectors_per_fat : 18) : 
-        (bpb.sectors_per_fat < 36 ? bpb.sectors_per_fat : 36);
-    
-    ata_read_sectors(fat_lba, fat_sectors, fat_table);
+    // The FAT must be large enough for every cluster entry
+    uint32_t fat_bytes = fat_type == 12 ? (fat_cluster_count + 2) * 3 / 2
+                                        : (fat_cluster_count + 2) * (fat_type / 8);
+    if (fat_bytes > fat_sectors_per_fat * 512) {
+        vga_print("[FAT] Invalid BPB\n");
+        return false;
+    }
+
+    fat_root_cluster = 0;
+    fat_fsinfo_lba = 0;
+    fat_free_count = FAT_FSINFO_UNKNOWN;
+    fat_next_free = FAT_FSINFO_UNKNOWN;
+    if (fat_type == 32) {
+        fat_root_cluster = ext.root_cluster;
+        if (bpb.sectors_per_fat || fat_root_cluster < 2 ||
+            fat_root_cluster >= fat_cluster_count + 2) {
+            vga_print("[FAT] Invalid FAT32 BPB\n");
+            return false;
+        }
+        if (ext.fs_info_sector && ext.fs_info_sector < bpb.reserved_sectors)
+            fat_load_fsinfo(ext.fs_info_sector);
+    }
+
+    // FAT table cache, filled on demand
+    uint32_t words = (fat_sectors_per_fat + 31) / 32;
+    fat_table  = kmalloc(fat_sectors_per_fat * 512);
+    fat_loaded = kmalloc(words * sizeof(uint32_t));
+    fat_dirty  = kmalloc(words * sizeof(uint32_t));
+    if (!fat_table || !fat_loaded || !fat_dirty) {
+        kfree(fat_table);
+        kfree(fat_loaded);
+        kfree(fat_dirty);
+        fat_table = NULL;
+        fat_loaded = NULL;
+        fat_dirty = NULL;
+    } else {
+        memset(fat_loaded, 0, words * sizeof(uint32_t));
+        memset(fat_dirty, 0, words * sizeof(uint32_t));
+    }
 
     fat_mounted = true;
+
+    // Index the root directory now so the first lookup is free
+    fat_dir_index(0);
     return true;
 }
 
-static uint32_t fat_next_cluster(uint32_t cluster) {
+// Byte `off` of the first FAT, or -1 on a read error
+static int fat_byte(uint32_t off) {
+    uint32_t s = off / 512;
+    if (s >= fat_sectors_per_fat) return -1;
+
+    if (fat_table) {
+        if (!(fat_loaded[s / 32] & (1u << (s % 32)))) {
+            if (!bcache_read(fat_dev, fat_lba + s, 1, fat_table + s * 512)) return -1;
+            fat_loaded[s / 32] |= 1u << (s % 32);
+        }
+        return fat_table[off];
+    }
+
+    buf_t* b = bcache_get(fat_dev, fat_lba + s);
+    if (!b) return -1;
+    int v = b->data[off % 512];
+    bcache_put(b);
+    return v;
+}
+
+// Raw FAT entry of `cluster`; false on a read error
+static bool fat_get_entry(uint32_t cluster, uint32_t* val) {
     if (fat_type == 12) {
         uint32_t offset = cluster + (cluster / 2);
-        uint16_t val = *(uint16_t*)&fat_table[offset];
-        if (cluster & 1) val >>= 4;
-        else             val &= 0x0FFF;
-        return (val >= 0xFF8) ? FAT_EOF : val;
-    } else {
-        uint16_t val = *(uint16_t*)&fat_table[cluster * 2];
-        return (val >= 0xFFF8) ? FAT_EOF : val;
+        int lo = fat_byte(offset), hi = fat_byte(offset + 1);
+        if (lo < 0 || hi < 0) return false;
+        uint32_t v = (uint32_t)(lo | (hi << 8));
+        *val = (cluster & 1) ? v >> 4 : v & 0x0FFF;
+        return true;
+    }
+
+    uint32_t width = fat_type / 8;
+    uint32_t v = 0;
+    for (int i = (int)width - 1; i >= 0; i--) {
+        int b = fat_byte(cluster * width + i);
+        if (b < 0) return false;
+        v = (v << 8) | (uint32_t)b;
     }
+    *val = v & 0x0FFFFFFF;              // FAT32: top four bits are reserved
+    return true;
 }
 
-static bool fat_read_cluster(uint32_t cluster, uint8_t* buf) {
-    uint32_t lba = fat_data_lba + (cluster - 2) * bpb.sectors_per_cluster;
-    return ata_read_sectors(lba, bpb.sectors_per_cluster, buf);
+// Next cluster in the chain; FAT_EOF at the end, on bad or out-of-range
+// entries and on read errors
+static uint32_t fat_next_cluster(uint32_t cluster) {
+    uint32_t val;
+    if (!fat_get_entry(cluster, &val)) return FAT_EOF;
+    if (val < 2 || val >= fat_cluster_count + 2) return FAT_EOF;
+    return val;
 }
 
-// List directory entries
-uint32_t fat_list_dir(fat_dir_entry_t* entries, uint32_t max) {
-    if (!fat_mounted) return 0;
+static uint32_t fat_cluster_lba(uint32_t cluster) {
+    return fat_data_lba + (cluster - 2) * bpb.sectors_per_cluster;
+}
 
-    uint8_t sector[512];
-    uint32_t count = 0;
-    uint32_t root_sectors = (bpb.root_entry_count * 32 + 511) / 512;
+// Walk the chain from `cluster`, calling out the runs. With `out` NULL
+// only counts them. Returns the number of extents.
+static uint32_t fat_walk_extents(uint32_t cluster, fat_extent_t* out, uint32_t* clusters) {
+    uint32_t n = 0;
+    uint32_t total = 0;
+    while (cluster != FAT_EOF && total < fat_cluster_count) {
+        uint32_t first = cluster;
+        uint32_t len = 0;
+        do {
+            len++;
+            cluster = fat_next_cluster(cluster);
+        } while (cluster == first + len && total + len < fat_cluster_count);
+
+        if (out) {
+            out[n].start = first;
+            out[n].count = len;
+        }
+        n++;
+        total += len;
+    }
+    if (clusters) *clusters = total;
+    return n;
+}
 
-    for (uint32_t s = 0; s < root_sectors && count < max; s++) {
-        if (!ata_read_sectors(fat_root_dir_lba + s, 1, sector)) break;
+// Extent list for the chain starting at `cluster`, from the cache or
+// built now (least recently used slot is replaced)
+static fat_extmap_t* fat_get_extents(uint32_t cluster) {
+    if (cluster < 2 || cluster >= fat_cluster_count + 2) return NULL;
 
-        fat_dir_entry_t* entry = (fat_dir_entry_t*)sector;
-        for (uint32_t i = 0; i < 16 && count < max; i++, entry++) {
+    fat_extmap_t* victim = &fat_extmaps[0];
+    for (uint32_t i = 0; i < FAT_EXTMAP_CACHE; i++) {
+        fat_extmap_t* m = &fat_extmaps[i];
+        if (m->first_cluster == cluster) {
+            m->last_use = ++fat_extmap_clock;
+            return m;
+        }
+        if (m->last_use < victim->last_use) victim = m;
+    }
+
+    uint32_t clusters;
+    uint32_t n = fat_walk_extents(cluster, NULL, &clusters);
+    fat_extent_t* ext = kmalloc(n * sizeof(fat_extent_t));
+    if (!ext) return NULL;
+    fat_walk_extents(cluster, ext, NULL);
+
+    kfree(victim->extents);
+    victim->first_cluster = cluster;
+    victim->clusters      = clusters;
+    victim->num_extents   = n;
+    victim->extents       = ext;
+    victim->last_use      = ++fat_extmap_clock;
+    return victim;
+}
+
+// Read `len` bytes at byte `offset` of the mapped chain. Whole sectors
+// of each extent go to the cache as one read (so their misses reach the
+// disk as a single transfer); partial sectors go through fat_sector_buf.
+// `pos` (may be NULL) is where the search for the extent holding `offset`
+// starts, and is left at the extent where the read ended, so sequential
+// reads through a handle never walk the extent list from the start.
+static uint32_t fat_read_extents(fat_extmap_t* m, uint32_t offset, uint8_t* buf, uint32_t len,
+                                 fat_extpos_t* pos) {
+    uint32_t spc = bpb.sectors_per_cluster;
+    uint32_t sector = offset / 512;                 // Sector within the chain
+    uint32_t skip = offset % 512;
+    uint32_t done = 0;
+
+    // Find the extent holding `sector`
+    uint32_t e = 0;
+    uint32_t ext_first = 0;                         // First sector of extent e
+    if (pos && pos->extent < m->num_extents && pos->first_sector <= sector) {
+        e = pos->extent;
+        ext_first = pos->first_sector;
+    }
+    while (e < m->num_extents && sector >= ext_first + m->extents[e].count * spc) {
+        ext_first += m->extents[e].count * spc;
+        e++;
+    }
+
+    while (done < len && e < m->num_extents) {
+        uint32_t ext_sectors = m->extents[e].count * spc;
+        uint32_t lba = fat_cluster_lba(m->extents[e].start) + (sector - ext_first);
+        uint32_t avail = ext_first + ext_sectors - sector;
+
+        if (skip || len - done < 512) {
+            // Partial sector
+            if (!bcache_read(fat_dev, lba, 1, fat_sector_buf)) break;
+            uint32_t n = 512 - skip;
+            if (n > len - done) n = len - done;
+            memcpy(buf + done, fat_sector_buf + skip, n);
+            done += n;
+            skip = 0;
+            sector++;
+        } else {
+            uint32_t n = (len - done) / 512;
+            if (n > avail) n = avail;
+            if (!bcache_read(fat_dev, lba, n, buf + done)) break;
+            done += n * 512;
+            sector += n;
+        }
+
+        if (sector >= ext_first + ext_sectors) {
+            ext_first += ext_sectors;
+            e++;
+        }
+    }
+    if (pos) {
+        pos->extent = e;
+        pos->first_sector = ext_first;
+    }
+    return done;
+}
+
+static uint32_t fat_entry_cluster(const fat_dir_entry_t* entry) {
+    uint32_t c = entry->start_cluster_lo;
+    if (fat_type == 32) c |= (uint32_t)entry->start_cluster_hi << 16;
+    return c;
+}
+
+// Directories are named by their first cluster; 0 is the root (which is
+// also what ".." holds in a first-level subdirectory)
+static uint32_t fat_dir_key(uint32_t cluster) {
+    return cluster == fat_root_cluster ? 0 : cluster;
+}
+
+// Length of directory `dir` in sectors
+static uint32_t fat_dir_sectors(uint32_t dir) {
+    if (dir == 0 && fat_type != 32) return fat_root_sectors;
+    fat_extmap_t* m = fat_get_extents(dir ? dir : fat_root_cluster);
+    return m ? m->clusters * bpb.sectors_per_cluster : 0;
+}
+
+// Read up to FAT_DIR_BATCH sectors of directory `dir` starting at sector
+// `s` into dir_buf through the buffer cache. Returns the number of sectors
+// read, 0 past the end of the directory or on error.
+static uint32_t fat_read_dir_batch(uint32_t dir, uint32_t s) {
+    uint32_t total = fat_dir_sectors(dir);
+    if (s >= total) return 0;
+    uint32_t n = total - s;
+    if (n > FAT_DIR_BATCH) n = FAT_DIR_BATCH;
+
+    if (dir == 0 && fat_type != 32)
+        return bcache_read(fat_dev, fat_root_dir_lba + s, n, dir_buf) ? n : 0;
+    fat_extmap_t* m = fat_get_extents(dir ? dir : fat_root_cluster);
+    return fat_read_extents(m, s * 512, dir_buf, n * 512, NULL) == n * 512 ? n : 0;
+}
+
+// Index of directory `dir`, built with one scan on first use. NULL when
+// the directory cannot be indexed (too large, heap full, read error);
+// callers then scan it.
+static diridx_t* fat_dir_index(uint32_t dir) {
+    diridx_t* idx = diridx_get(dir);
+    if (idx) return idx;
+    uint32_t total = fat_dir_sectors(dir);
+    if (total > DIRIDX_MAX_ENTRIES / 16) return NULL;
+    idx = diridx_create(dir, dir == 0);
+    if (!idx) return NULL;
+
+    for (uint32_t s = 0; s < total; ) {
+        uint32_t n = fat_read_dir_batch(dir, s);
+        if (!n) goto fail;
+
+        fat_dir_entry_t* entry = (fat_dir_entry_t*)dir_buf;
+        for (uint32_t i = 0; i < n * 16; i++, entry++) {
+            if (entry->name[0] == 0x00) return idx;         // End of dir
+            if ((uint8_t)entry->name[0] == 0xE5) continue;  // Deleted
+            if (entry->attrs & FAT_ATTR_VOLID) continue;    // Label, LFN
+            if (!diridx_add(idx, s * 16 + i, entry)) goto fail;
+        }
+        s += n;
+    }
+    return idx;
+
+fail:
+    diridx_drop(dir);
+    return NULL;
+}
+
+// Find `name83` in directory `dir`: from its index, or by a scan through
+// the dentry cache. `slot` (may be NULL) receives the entry's number.
+static bool fat_dir_find(uint32_t dir, const char* name83, fat_dir_entry_t* out, uint32_t* slot) {
+    diridx_t* idx = fat_dir_index(dir);
+    if (idx) return diridx_lookup(idx, name83, out, slot);
+
+    int hit = dcache_lookup(dir, name83, out, slot);
+    if (hit != DCACHE_MISS) return hit == DCACHE_HIT;
+
+    for (uint32_t s = 0; ; ) {
+        uint32_t n = fat_read_dir_batch(dir, s);
+        if (!n) break;
+        s += n;
+
+        fat_dir_entry_t* entry = (fat_dir_entry_t*)dir_buf;
+        for (uint32_t i = 0; i < n * 16; i++, entry++) {
+            if (entry->name[0] == 0x00) goto missing;
+            if ((uint8_t)entry->name[0] == 0xE5) continue;
+            if (entry->attrs & FAT_ATTR_VOLID) continue;
+
+            if (memcmp(entry->name, name83, 11) == 0) {
+                *out = *entry;
+                if (slot) *slot = (s - n) * 16 + i;
+                dcache_insert(dir, name83, entry, (s - n) * 16 + i);
+                return true;
+            }
+        }
+    }
+missing:
+    dcache_insert(dir, name83, NULL, 0);
+    return false;
+}
+
+// Resolve `path` ("/BIN/TOOL.EXE", "bin/tool.exe"; "." and ".." work).
+// Returns true with *is_root set for the root directory itself. `loc`
+// (may be NULL) receives where the entry is stored.
+static bool fat_resolve(const char* path, fat_dir_entry_t* out, bool* is_root, fat_loc_t* loc) {
+    uint32_t dir = 0;
+    bool at_root = true;
+
+    while (*path) {
+        while (*path == '/') path++;
+        if (!*path) break;
+
+        // Next component
+        char comp[13];
+        uint32_t len = 0;
+        while (path[len] && path[len] != '/') len++;
+        if (len >= sizeof(comp)) return false;      // Not an 8.3 name
+        memcpy(comp, path, len);
+        comp[len] = '\0';
+        path += len;
+
+        if (strcmp(comp, ".") == 0) continue;
+
+        if (!at_root && !(out->attrs & FAT_ATTR_SUBDIR)) return false;
+        char name83[11];
+        if (strcmp(comp, "..") == 0) {
+            if (at_root) continue;
+            memcpy(name83, "..         ", 11);
+        } else {
+            fat_name_to_83(comp, name83);
+        }
+
+        uint32_t slot;
+        if (!fat_dir_find(dir, name83, out, &slot)) return false;
+        if (loc) {
+            loc->dir = dir;
+            loc->slot = slot;
+        }
+        dir = fat_dir_key(fat_entry_cluster(out));
+        at_root = (out->attrs & FAT_ATTR_SUBDIR) && dir == 0;
+    }
+
+    *is_root = at_root;
+    return true;
+}
+
+// List entries of directory `dir`
+static uint32_t fat_list_cluster(uint32_t dir, fat_dir_entry_t* entries, uint32_t max) {
+    diridx_t* idx = fat_dir_index(dir);
+    if (idx) return diridx_list(idx, entries, max, 0x0F);
+
+    uint32_t count = 0;
+    for (uint32_t s = 0; count < max; ) {
+        uint32_t n = fat_read_dir_batch(dir, s);
+        if (!n) break;
+        s += n;
+
+        fat_dir_entry_t* entry = (fat_dir_entry_t*)dir_buf;
+        for (uint32_t i = 0; i < n * 16 && count < max; i++, entry++) {
             if (entry->name[0] == 0x00) goto done;        // End of dir
             if ((uint8_t)entry->name[0] == 0xE5) continue; // Deleted
             if (entry->attrs & 0x08) continue;             // Volume label
@@ -153,43 +556,153 @@ done:
     return count;
 }
 
-// Read a file by name (8.3 format, uppercase, space-padded)
-uint32_t fat_read_file(const char* name83, uint8_t* buf, uint32_t buf_size) {
+// List root directory entries
+uint32_t fat_list_dir(fat_dir_entry_t* entries, uint32_t max) {
     if (!fat_mounted) return 0;
+    return fat_list_cluster(0, entries, max);
+}
 
-    uint8_t sector[512];
-    uint32_t root_sectors = (bpb.root_entry_count * 32 + 511) / 512;
+uint32_t fat_list_path(const char* path, fat_dir_entry_t* entries, uint32_t max) {
+    if (!fat_mounted) return 0;
+    fat_dir_entry_t e;
+    bool is_root;
+    if (!fat_resolve(path, &e, &is_root, NULL)) return 0;
+    if (is_root) return fat_list_cluster(0, entries, max);
+    if (!(e.attrs & FAT_ATTR_SUBDIR)) return 0;
+    return fat_list_cluster(fat_dir_key(fat_entry_cluster(&e)), entries, max);
+}
 
-    for (uint32_t s = 0; s < root_sectors; s++) {
-        if (!ata_read_sectors(fat_root_dir_lba + s, 1, sector)) break;
+bool fat_stat(const char* path, fat_dir_entry_t* out, bool* is_dir) {
+    if (!fat_mounted) return false;
+    bool is_root;
+    if (!fat_resolve(path, out, &is_root, NULL)) return false;
+    if (is_root) memset(out, 0, sizeof(*out));
+    *is_dir = is_root || (out->attrs & FAT_ATTR_SUBDIR);
+    return true;
+}
 
-        fat_dir_entry_t* entry = (fat_dir_entry_t*)sector;
-        for (uint32_t i = 0; i < 16; i++, entry++) {
-            if (entry->name[0] == 0x00) return 0;
-            if ((uint8_t)entry->name[0] == 0xE5) continue;
-            if (entry->attrs & 0x08) continue;
+// Read the file described by `entry`
+static uint32_t fat_read_entry(const fat_dir_entry_t* entry, uint8_t* buf, uint32_t buf_size) {
+    if (entry->attrs & FAT_ATTR_SUBDIR) return 0;
+    uint32_t len = entry->file_size < buf_size ? entry->file_size : buf_size;
+    if (len == 0) return 0;
+    fat_extmap_t* m = fat_get_extents(fat_entry_cluster(entry));
+    return m ? fat_read_extents(m, 0, buf, len, NULL) : 0;
+}
 
-            if (memcmp(entry->name, name83, 11) == 0) {
-                // Found! Read clusters
-                uint32_t cluster = entry->start_cluster_lo;
-                uint32_t bytes_read = 0;
-                uint32_t file_size = entry->file_size;
-                uint8_t cluster_buf[512 * 8]; // max 8 sect/cluster
-
-                while (cluster != FAT_EOF && bytes_read < buf_size && bytes_read < file_size) {
-                    fat_read_cluster(cluster, cluster_buf);
-                    uint32_t chunk = bpb.sectors_per_cluster * 512;
-                    if (bytes_read + chunk > buf_size) chunk = buf_size - bytes_read;
-                    if (bytes_read + chunk > file_size) chunk = file_size - bytes_read;
-                    memcpy(buf + bytes_read, cluster_buf, chunk);
-                    bytes_read += chunk;
-                    cluster = fat_next_cluster(cluster);
-                }
-                return bytes_read;
-            }
+// Read a file by name (8.3 format, uppercase, space-padded) from the root
+uint32_t fat_read_file(const char* name83, uint8_t* buf, uint32_t buf_size) {
+    if (!fat_mounted) return 0;
+    fat_dir_entry_t entry;
+    if (!fat_dir_find(0, name83, &entry, NULL)) return 0;
+    return fat_read_entry(&entry, buf, buf_size);
+}
+
+uint32_t fat_read_path(const char* path, uint8_t* buf, uint32_t buf_size) {
+    if (!fat_mounted) return 0;
+    fat_dir_entry_t entry;
+    bool is_root;
+    if (!fat_resolve(path, &entry, &is_root, NULL) || is_root) return 0;
+    return fat_read_entry(&entry, buf, buf_size);
+}
+
+// Prefetch bytes [offset, offset + len) of the mapped chain into the
+// buffer cache, one request per extent. `pos` is a search hint as for
+// fat_read_extents() but is not updated.
+static void fat_readahead(fat_extmap_t* m, uint32_t offset, uint32_t len, fat_extpos_t pos) {
+    uint32_t spc = bpb.sectors_per_cluster;
+    uint32_t sector = offset / 512;
+    uint32_t end = (offset + len + 511) / 512;
+
+    uint32_t e = 0, ext_first = 0;
+    if (pos.extent < m->num_extents && pos.first_sector <= sector) {
+        e = pos.extent;
+        ext_first = pos.first_sector;
+    }
+    for (; e < m->num_extents && sector < end; e++) {
+        uint32_t ext_sectors = m->extents[e].count * spc;
+        if (sector < ext_first + ext_sectors) {
+            uint32_t n = ext_first + ext_sectors - sector;
+            if (n > end - sector) n = end - sector;
+            bcache_readahead(fat_dev, fat_cluster_lba(m->extents[e].start) + (sector - ext_first), n);
+            sector += n;
         }
+        ext_first += ext_sectors;
     }
-    return 0; // Not found
+}
+
+bool fat_locate(const char* path, fat_dir_entry_t* out, fat_loc_t* loc) {
+    if (!fat_mounted) return false;
+    bool is_root;
+    return fat_resolve(path, out, &is_root, loc) && !is_root;
+}
+
+void fat_set_readahead(uint32_t max_bytes) {
+    fat_ra_max = max_bytes && max_bytes < FAT_RA_MIN ? FAT_RA_MIN : max_bytes;
+}
+
+void fat_set_change_hook(void (*hook)(const fat_loc_t* loc)) {
+    fat_change_hook = hook;
+}
+
+bool fat_open(const char* path, fat_file_t* f) {
+    memset(f, 0, sizeof(*f));
+    if (!fat_mounted) return false;
+    fat_dir_entry_t entry;
+    bool is_root;
+    fat_loc_t loc;
+    if (!fat_resolve(path, &entry, &is_root, &loc) || is_root) return false;
+    if (entry.attrs & FAT_ATTR_SUBDIR) return false;
+    f->loc = loc;
+
+    f->first_cluster = fat_entry_cluster(&entry);
+    f->size = entry.file_size;
+    f->open = true;
+    return true;
+}
+
+uint32_t fat_read(fat_file_t* f, void* buf, uint32_t len) {
+    if (!f->open || !fat_mounted || f->offset >= f->size) return 0;
+    if (len > f->size - f->offset) len = f->size - f->offset;
+
+    // The map may have been recycled since the last call; rebuilding it
+    // gives the same extents, so the cached position stays valid
+    fat_extmap_t* m = fat_get_extents(f->first_cluster);
+    if (!m) return 0;
+
+    // A read that starts where the last one ended is sequential
+    if (f->offset == f->ra_next && fat_ra_max) {
+        uint32_t w = f->ra_window ? f->ra_window * 2 : len < fat_ra_max / 4 ? len * 4 : fat_ra_max;
+        f->ra_window = w < FAT_RA_MIN ? FAT_RA_MIN : w > fat_ra_max ? fat_ra_max : w;
+    } else {
+        f->ra_window = 0;
+        f->ra_end = f->offset;
+    }
+
+    uint32_t n = fat_read_extents(m, f->offset, buf, len, &f->pos);
+    f->offset += n;
+    f->ra_next = f->offset;
+    if (n < len || !f->ra_window) return n;
+
+    // Once less than half a window is left ahead of the reader, prefetch
+    // another window past what is already cached
+    uint32_t from = f->ra_end > f->offset ? f->ra_end : f->offset;
+    if (from - f->offset < f->ra_window / 2 && from < f->size) {
+        uint32_t to = f->size - from > f->ra_window ? from + f->ra_window : f->size;
+        fat_readahead(m, from, to - from, f->pos);
+        f->ra_end = to;
+    }
+    return n;
+}
+
+bool fat_seek(fat_file_t* f, uint32_t offset) {
+    if (!f->open || offset > f->size) return false;
+    f->offset = offset;     // fat_read_extents() restarts the search if needed
+    return true;
+}
+
+void fat_close(fat_file_t* f) {
+    f->open = false;
 }
 
 // Convert "FILENAME.EXT" to 8.3 padded format
@@ -215,3 +728,482 @@ void fat_name_to_83(const char* name, char* out) {
 bool fat_is_mounted(void) {
     return fat_mounted;
 }
+
+// Number of free clusters, counted by a FAT scan the first time it is
+// needed on volumes without a usable FSInfo count
+static uint32_t fat_count_free(void) {
+    if (fat_free_count != FAT_FSINFO_UNKNOWN) return fat_free_count;
+
+    uint32_t free = 0;
+    for (uint32_t c = 2; c < fat_cluster_count + 2; c++) {
+        uint32_t val;
+        if (!fat_get_entry(c, &val)) return 0;
+        if (val == 0) free++;
+    }
+    fat_free_count = free;
+    return free;
+}
+
+bool fat_get_info(fat_info_t* info) {
+    if (!fat_mounted) return false;
+    info->fat_type      = fat_type;
+    info->cluster_bytes = bpb.sectors_per_cluster * 512;
+    info->clusters      = fat_cluster_count;
+    info->free_clusters = fat_count_free();
+    return true;
+}
+
+// ──────────────────────────── write support ───────────────────────────────
+
+static void fat_extmap_drop(uint32_t cluster) {
+    for (uint32_t i = 0; i < FAT_EXTMAP_CACHE; i++) {
+        if (fat_extmaps[i].first_cluster != cluster) continue;
+        kfree(fat_extmaps[i].extents);
+        memset(&fat_extmaps[i], 0, sizeof(fat_extmap_t));
+    }
+}
+
+static bool fat_set_byte(uint32_t off, uint8_t v) {
+    if (fat_byte(off) < 0) return false;    // Loads the sector
+    fat_table[off] = v;
+    uint32_t s = off / 512;
+    fat_dirty[s / 32] |= 1u << (s % 32);
+    return true;
+}
+
+// Change the FAT entry of `cluster` in fat_table (FAT_EOF ends a chain)
+static bool fat_set_entry(uint32_t cluster, uint32_t val) {
+    if (fat_type == 12) {
+        uint32_t offset = cluster + (cluster / 2);
+        int lo = fat_byte(offset), hi = fat_byte(offset + 1);
+        if (lo < 0 || hi < 0) return false;
+        uint32_t v = (uint32_t)(lo | (hi << 8));
+        if (cluster & 1) v = (v & 0x000F) | ((val & 0x0FFF) << 4);
+        else             v = (v & 0xF000) | (val & 0x0FFF);
+        return fat_set_byte(offset, v & 0xFF) && fat_set_byte(offset + 1, v >> 8);
+    }
+
+    uint32_t width = fat_type / 8;
+    if (fat_type == 32) {
+        // Keep the reserved top four bits
+        int top = fat_byte(cluster * 4 + 3);
+        if (top < 0) return false;
+        val = (val & 0x0FFFFFFF) | ((uint32_t)(top & 0xF0) << 24);
+    }
+    for (uint32_t i = 0; i < width; i++)
+        if (!fat_set_byte(cluster * width + i, (val >> (i * 8)) & 0xFF)) return false;
+    return true;
+}
+
+// Copy the changed FAT sectors into every FAT copy through the buffer cache
+static bool fat_flush_table(void) {
+    uint32_t words = (fat_sectors_per_fat + 31) / 32;
+    bool ok = true;
+    for (uint32_t w = 0; w < words; w++) {
+        while (fat_dirty[w]) {
+            uint32_t bit = 0;
+            while (!(fat_dirty[w] & (1u << bit))) bit++;
+            fat_dirty[w] &= ~(1u << bit);
+
+            uint32_t s = w * 32 + bit;
+            for (uint32_t f = 0; f < bpb.num_fats; f++)
+                if (!bcache_write(fat_dev, fat_lba + f * fat_sectors_per_fat + s, 1,
+                                  fat_table + s * 512))
+                    ok = false;
+        }
+    }
+    return ok;
+}
+
+// Find free clusters for `want`, starting at the next-free hint: the first
+// free run at least `want` long, else the longest run seen. Returns the
+// run length used (0 = disk full) and its first cluster in *start.
+static uint32_t fat_find_free_run(uint32_t want, uint32_t* start) {
+    uint32_t end = fat_cluster_count + 2;
+    uint32_t c = fat_next_free >= 2 && fat_next_free < end ? fat_next_free : 2;
+    uint32_t best = 0, best_start = 0;
+    uint32_t run = 0, run_start = 0;
+
+    for (uint32_t i = 0; i < fat_cluster_count; i++, c++) {
+        if (c == end) {
+            c = 2;
+            run = 0;            // Runs do not wrap around
+        }
+        uint32_t val;
+        if (!fat_get_entry(c, &val)) return 0;
+        if (val != 0) {
+            run = 0;
+            continue;
+        }
+        if (!run) run_start = c;
+        if (++run > best) {
+            best = run;
+            best_start = run_start;
+        }
+        if (run == want) break;
+    }
+    *start = best_start;
+    return best;
+}
+
+// Free clusters right after `cluster`, up to `want`
+static uint32_t fat_free_after(uint32_t cluster, uint32_t want) {
+    uint32_t n = 0;
+    while (n < want && cluster + 1 + n < fat_cluster_count + 2) {
+        uint32_t val;
+        if (!fat_get_entry(cluster + 1 + n, &val) || val != 0) break;
+        n++;
+    }
+    return n;
+}
+
+// Free `n` clusters from `start` without touching the free count
+static void fat_clear_run(uint32_t start, uint32_t n) {
+    for (uint32_t k = 0; k < n; k++) fat_set_entry(start + k, 0);
+}
+
+// Allocate `count` clusters and link them after `tail` (0 = start a new
+// chain). The chain is grown in place while the clusters after its end
+// are free, then from the first free run long enough for the rest, so
+// files stay in as few extents as possible. Returns the first new cluster,
+// 0 when the disk is too full or on an I/O error; then nothing is left
+// allocated and `tail` ends the chain again.
+static uint32_t fat_alloc_chain(uint32_t tail, uint32_t count) {
+    if (fat_count_free() < count) return 0;
+
+    uint32_t old_tail = tail, old_free = fat_free_count;
+    uint32_t first = 0;
+    while (count) {
+        uint32_t start = tail + 1;
+        uint32_t n = tail ? fat_free_after(tail, count) : 0;
+        if (!n) n = fat_find_free_run(count, &start);
+        if (!n) {
+            // The free count was only a hint and too high: recount later
+            old_free = FAT_FSINFO_UNKNOWN;
+            goto fail;
+        }
+
+        for (uint32_t k = 0; k < n; k++) {
+            if (!fat_set_entry(start + k, k + 1 < n ? start + k + 1 : FAT_EOF)) {
+                fat_clear_run(start, k);
+                goto fail;
+            }
+        }
+        if (tail && !fat_set_entry(tail, start)) {
+            fat_clear_run(start, n);
+            goto fail;
+        }
+
+        if (!first) first = start;
+        tail = start + n - 1;
+        count -= n;
+        fat_free_count -= n;
+        fat_next_free = tail + 1 < fat_cluster_count + 2 ? tail + 1 : 2;
+    }
+    return first;
+
+fail:
+    // Runs linked so far end in FAT_EOF; free them and cut the chain back
+    for (uint32_t i = 0; first && first != FAT_EOF && i < fat_cluster_count; i++) {
+        uint32_t next = fat_next_cluster(first);
+        fat_set_entry(first, 0);
+        first = next;
+    }
+    if (old_tail) fat_set_entry(old_tail, FAT_EOF);
+    fat_free_count = old_free;
+    return 0;
+}
+
+// Free the chain starting at `cluster`
+static bool fat_free_chain(uint32_t cluster) {
+    fat_extmap_drop(cluster);
+    for (uint32_t i = 0; cluster != FAT_EOF && i < fat_cluster_count; i++) {
+        uint32_t next = fat_next_cluster(cluster);
+        if (!fat_set_entry(cluster, 0)) return false;
+        if (fat_free_count != FAT_FSINFO_UNKNOWN) fat_free_count++;
+        cluster = next;
+    }
+    return true;
+}
+
+// Sector `s` of a mapped chain as an LBA (0 = past the end)
+static uint32_t fat_extent_lba(fat_extmap_t* m, uint32_t s) {
+    uint32_t spc = bpb.sectors_per_cluster;
+    for (uint32_t e = 0; e < m->num_extents; e++) {
+        uint32_t n = m->extents[e].count * spc;
+        if (s < n) return fat_cluster_lba(m->extents[e].start) + s;
+        s -= n;
+    }
+    return 0;
+}
+
+// Last cluster of a mapped chain
+static uint32_t fat_extent_last(fat_extmap_t* m) {
+    fat_extent_t* e = &m->extents[m->num_extents - 1];
+    return e->start + e->count - 1;
+}
+
+// LBA of the sector holding entry `slot` of directory `dir` (0 = none)
+static uint32_t fat_dir_slot_lba(uint32_t dir, uint32_t slot) {
+    uint32_t s = slot / 16;
+    if (dir == 0 && fat_type != 32) return s < fat_root_sectors ? fat_root_dir_lba + s : 0;
+    fat_extmap_t* m = fat_get_extents(dir ? dir : fat_root_cluster);
+    return m ? fat_extent_lba(m, s) : 0;
+}
+
+// Store a directory entry and keep the index and dentry cache in step
+static bool fat_put_dirent(fat_loc_t loc, const fat_dir_entry_t* entry) {
+    uint32_t lba = fat_dir_slot_lba(loc.dir, loc.slot);
+    buf_t* b = lba ? bcache_get(fat_dev, lba) : NULL;
+    if (!b) return false;
+    memcpy(b->data + (loc.slot % 16) * sizeof(fat_dir_entry_t), entry, sizeof(fat_dir_entry_t));
+    bcache_mark_dirty(b);
+    bcache_put(b);
+
+    diridx_update(loc.dir, loc.slot, entry);
+    dcache_insert(loc.dir, entry->name, entry, loc.slot);
+    if (fat_change_hook) fat_change_hook(&loc);
+    return true;
+}
+
+// Write back the size and first cluster of an open file
+static bool fat_update_dirent(fat_file_t* f) {
+    uint32_t lba = fat_dir_slot_lba(f->loc.dir, f->loc.slot);
+    buf_t* b = lba ? bcache_get(fat_dev, lba) : NULL;
+    if (!b) return false;
+    fat_dir_entry_t entry;
+    memcpy(&entry, b->data + (f->loc.slot % 16) * sizeof(entry), sizeof(entry));
+    bcache_put(b);
+
+    entry.file_size        = f->size;
+    entry.start_cluster_lo = f->first_cluster & 0xFFFF;
+    entry.start_cluster_hi = fat_type == 32 ? f->first_cluster >> 16 : 0;
+    entry.attrs           |= FAT_ATTR_ARCHIVE;
+    return fat_put_dirent(f->loc, &entry);
+}
+
+// A free entry of directory `dir` (deleted or never used). Subdirectories
+// and the FAT32 root grow by a zeroed cluster when full; the fixed FAT12/16
+// root cannot.
+static bool fat_dir_alloc_slot(uint32_t dir, uint32_t* slot) {
+    uint32_t s = 0;
+    for (;;) {
+        uint32_t n = fat_read_dir_batch(dir, s);
+        if (!n) break;
+        fat_dir_entry_t* entry = (fat_dir_entry_t*)dir_buf;
+        for (uint32_t i = 0; i < n * 16; i++, entry++) {
+            if (entry->name[0] == 0x00 || (uint8_t)entry->name[0] == 0xE5) {
+                *slot = s * 16 + i;
+                return true;
+            }
+        }
+        s += n;
+    }
+    if (s != fat_dir_sectors(dir) || (dir == 0 && fat_type != 32)) return false;
+
+    uint32_t first = dir ? dir : fat_root_cluster;
+    fat_extmap_t* m = fat_get_extents(first);
+    if (!m) return false;
+    uint32_t c = fat_alloc_chain(fat_extent_last(m), 1);
+    if (!c) return false;
+    fat_extmap_drop(first);
+
+    memset(fat_sector_buf, 0, sizeof(fat_sector_buf));
+    for (uint32_t i = 0; i < bpb.sectors_per_cluster; i++)
+        if (!bcache_write(fat_dev, fat_cluster_lba(c) + i, 1, fat_sector_buf)) return false;
+    *slot = s * 16;
+    return true;
+}
+
+// 8.3 name check: 1-8 name characters, optional dot and 1-3 more
+static bool fat_valid_name(const char* name) {
+    uint32_t base = 0, ext = 0;
+    bool dot = false;
+    for (const char* p = name; *p; p++) {
+        if (*p == '.') {
+            if (dot) return false;
+            dot = true;
+        } else if (*p <= ' ' || *p == '/' || *p == '\\' || *p == '*' || *p == '?') {
+            return false;
+        } else if (dot) {
+            ext++;
+        } else {
+            base++;
+        }
+    }
+    return base >= 1 && base <= 8 && ext <= 3 && (!dot || ext > 0);
+}
+
+bool fat_create(const char* path, fat_file_t* f) {
+    memset(f, 0, sizeof(*f));
+    if (!fat_mounted || !fat_table) return false;
+
+    // Split into the parent directory and the new name
+    const char* name = path;
+    for (const char* p = path; *p; p++)
+        if (*p == '/') name = p + 1;
+    if (!fat_valid_name(name)) return false;
+
+    char parent[128];
+    uint32_t plen = (uint32_t)(name - path);
+    if (plen >= sizeof(parent)) return false;
+    memcpy(parent, path, plen);
+    parent[plen] = '\0';
+
+    fat_dir_entry_t entry;
+    bool is_root;
+    if (!fat_resolve(parent, &entry, &is_root, NULL)) return false;
+    if (!is_root && !(entry.attrs & FAT_ATTR_SUBDIR)) return false;
+    uint32_t dir = is_root ? 0 : fat_dir_key(fat_entry_cluster(&entry));
+
+    char name83[11];
+    fat_name_to_83(name, name83);
+    fat_loc_t loc = { dir, 0 };
+    if (fat_dir_find(dir, name83, &entry, &loc.slot)) {
+        // Existing file: truncate
+        if (entry.attrs & (FAT_ATTR_SUBDIR | FAT_ATTR_VOLID | FAT_ATTR_READONLY)) return false;
+        f->loc = loc;
+        f->first_cluster = fat_entry_cluster(&entry);
+        f->size = entry.file_size;
+        f->open = true;
+        if (!fat_truncate(f, 0)) {
+            f->open = false;
+            return false;
+        }
+        return true;
+    }
+
+    if (!fat_dir_alloc_slot(dir, &loc.slot)) return false;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.name, name83, 11);
+    entry.attrs = FAT_ATTR_ARCHIVE;
+    if (!fat_put_dirent(loc, &entry) || !fat_flush_table()) return false;
+
+    f->loc = loc;
+    f->open = true;
+    return true;
+}
+
+// Write `len` bytes at byte `offset` of the mapped chain: whole sectors go
+// to the cache in one call per extent, partial ones are merged with the
+// sector's current contents
+static uint32_t fat_write_extents(fat_extmap_t* m, uint32_t offset, const uint8_t* buf,
+                                  uint32_t len) {
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t lba = fat_extent_lba(m, pos / 512);
+        if (!lba) break;
+
+        uint32_t skip = pos % 512;
+        if (skip || len - done < 512) {
+            uint32_t n = 512 - skip;
+            if (n > len - done) n = len - done;
+            buf_t* b = bcache_get(fat_dev, lba);
+            if (!b) break;
+            memcpy(b->data + skip, buf + done, n);
+            bcache_mark_dirty(b);
+            bcache_put(b);
+            done += n;
+            continue;
+        }
+
+        // Whole sectors up to the end of this extent
+        uint32_t n = (len - done) / 512;
+        uint32_t s = pos / 512;
+        uint32_t k = 1;
+        while (k < n && fat_extent_lba(m, s + k) == lba + k) k++;
+        if (!bcache_write(fat_dev, lba, k, buf + done)) break;
+        done += k * 512;
+    }
+    return done;
+}
+
+uint32_t fat_write(fat_file_t* f, const void* buf, uint32_t len) {
+    if (!f->open || !fat_mounted || !fat_table || !len) return 0;
+    if (len > 0xFFFFFFFF - f->offset) len = 0xFFFFFFFF - f->offset;
+
+    // Grow the chain to cover the new end
+    uint32_t cluster_bytes = bpb.sectors_per_cluster * 512;
+    uint32_t end = f->offset + len;
+    uint32_t need = end / cluster_bytes + (end % cluster_bytes != 0);
+    fat_extmap_t* m = f->first_cluster ? fat_get_extents(f->first_cluster) : NULL;
+    if (f->first_cluster && !m) return 0;
+    uint32_t have = m ? m->clusters : 0;
+    if (need > have) {
+        uint32_t c = fat_alloc_chain(m ? fat_extent_last(m) : 0, need - have);
+        if (!c) {
+            // The chain is back as it was, but rebuild the map to be sure
+            if (f->first_cluster) fat_extmap_drop(f->first_cluster);
+            fat_flush_table();
+            return 0;
+        }
+        if (!f->first_cluster) f->first_cluster = c;
+        fat_extmap_drop(f->first_cluster);
+        m = fat_get_extents(f->first_cluster);
+        if (!m) return 0;
+    }
+
+    uint32_t n = fat_write_extents(m, f->offset, buf, len);
+    f->offset += n;
+    if (f->offset > f->size) f->size = f->offset;
+    if (!fat_update_dirent(f) || !fat_flush_table()) return 0;
+    return n;
+}
+
+bool fat_truncate(fat_file_t* f, uint32_t size) {
+    if (!f->open || !fat_mounted || !fat_table || size > f->size) return false;
+
+    uint32_t cluster_bytes = bpb.sectors_per_cluster * 512;
+    uint32_t keep = size / cluster_bytes + (size % cluster_bytes != 0);
+    if (f->first_cluster) {
+        fat_extmap_t* m = fat_get_extents(f->first_cluster);
+        if (!m) return false;
+        if (keep == 0) {
+            if (!fat_free_chain(f->first_cluster)) return false;
+            f->first_cluster = 0;
+        } else if (keep < m->clusters) {
+            // Cut after cluster number keep - 1
+            uint32_t last = 0;
+            for (uint32_t e = 0, skip = keep - 1; e < m->num_extents; e++) {
+                if (skip < m->extents[e].count) {
+                    last = m->extents[e].start + skip;
+                    break;
+                }
+                skip -= m->extents[e].count;
+            }
+            uint32_t rest = fat_next_cluster(last);
+            fat_extmap_drop(f->first_cluster);
+            if (!fat_set_entry(last, FAT_EOF) || (rest != FAT_EOF && !fat_free_chain(rest)))
+                return false;
+        }
+    }
+
+    f->size = size;
+    if (f->offset > size) f->offset = size;
+    memset(&f->pos, 0, sizeof(f->pos));
+    f->ra_next = f->ra_end = f->ra_window = 0;
+    return fat_update_dirent(f) && fat_flush_table();
+}
+
+bool fat_sync(void) {
+    if (!fat_mounted) return false;
+    bool ok = true;
+    if (fat_table && !fat_flush_table()) ok = false;
+
+    // Keep the FSInfo hints in step so the next mount needs no FAT scan
+    if (fat_fsinfo_lba && fat_free_count != FAT_FSINFO_UNKNOWN) {
+        buf_t* b = bcache_get(fat_dev, fat_fsinfo_lba);
+        if (b) {
+            fat_fsinfo_t* fsi = (fat_fsinfo_t*)b->data;
+            if (fsi->free_count != fat_free_count || fsi->next_free != fat_next_free) {
+                fsi->free_count = fat_free_count;
+                fsi->next_free  = fat_next_free;
+                bcache_mark_dirty(b);
+            }
+            bcache_put(b);
+        }
+    }
+    if (!bcache_sync(fat_dev)) ok = false;
+    return ok;
+}
@@ -1,9 +1,12 @@
-// fat.h - FAT12/FAT16 Filesystem
+// fat.h - FAT12/FAT16/FAT32 Filesystem
 #ifndef FAT_H
 #define FAT_H
 #include "../kernel/kernel.h"
+#include "../drivers/blkdev.h"
 
-#define FAT_EOF 0xFFFF
+#define FAT_EOF 0x0FFFFFFF
+
+#define FAT_RA_DEFAULT  (128 * 1024)    // Largest read-ahead window per handle
 
 // BIOS Parameter Block (BPB)
 typedef struct {
@@ -23,6 +26,33 @@ typedef struct {
     uint32_t total_sectors32;
 } __attribute__((packed)) fat_bpb_t;
 
+// FAT32 extension, follows fat_bpb_t at offset 36 (sectors_per_fat is 0)
+typedef struct {
+    uint32_t sectors_per_fat32;
+    uint16_t ext_flags;
+    uint16_t fs_version;
+    uint32_t root_cluster;
+    uint16_t fs_info_sector;
+    uint16_t backup_boot_sector;
+    uint8_t  reserved[12];
+} __attribute__((packed)) fat32_bpb_ext_t;
+
+// FAT32 FSInfo sector: free cluster hints
+typedef struct {
+    uint32_t lead_sig;          // FAT_FSINFO_LEAD_SIG
+    uint8_t  reserved1[480];
+    uint32_t struct_sig;        // FAT_FSINFO_STRUCT_SIG
+    uint32_t free_count;        // 0xFFFFFFFF = unknown
+    uint32_t next_free;         // Where to start looking, 0xFFFFFFFF = unknown
+    uint8_t  reserved2[12];
+    uint32_t trail_sig;         // FAT_FSINFO_TRAIL_SIG
+} __attribute__((packed)) fat_fsinfo_t;
+
+#define FAT_FSINFO_LEAD_SIG    0x41615252
+#define FAT_FSINFO_STRUCT_SIG  0x61417272
+#define FAT_FSINFO_TRAIL_SIG   0xAA550000
+#define FAT_FSINFO_UNKNOWN     0xFFFFFFFF
+
 // 32-byte directory entry
 typedef struct {
     char     name[11];         // 8.3 format
@@ -46,10 +76,81 @@ typedef struct {
 #define FAT_ATTR_SUBDIR    0x10
 #define FAT_ATTR_ARCHIVE   0x20
 
+// Volume summary for free-space queries
+typedef struct {
+    uint8_t  fat_type;          // 12, 16 or 32
+    uint32_t cluster_bytes;
+    uint32_t clusters;          // Data clusters on the volume
+    uint32_t free_clusters;
+} fat_info_t;
+
+// Position within an extent list (see fat.c)
+typedef struct {
+    uint32_t extent;            // Extent holding the position
+    uint32_t first_sector;      // Its first sector within the file
+} fat_extpos_t;
+
+// Where a directory entry is stored: directory (first cluster, 0 = root)
+// and entry number within it
+typedef struct {
+    uint32_t dir;
+    uint32_t slot;
+} fat_loc_t;
+
+// Open file handle. Reads continue at `offset`; `pos` caches the extent
+// (run of clusters) holding it, so sequential reads cost O(1) each.
+// Sequential reads also grow a read-ahead window that is prefetched into
+// the buffer cache past the end of each read.
+typedef struct {
+    bool         open;
+    fat_loc_t    loc;           // Directory entry, updated by writes
+    uint32_t     first_cluster; // 0 = empty file
+    uint32_t     size;
+    uint32_t     offset;        // Current byte position
+    fat_extpos_t pos;
+    uint32_t     ra_next;       // Offset a sequential read would start at
+    uint32_t     ra_window;     // Read-ahead bytes, 0 = random access
+    uint32_t     ra_end;        // Prefetched up to this offset
+} fat_file_t;
+
 bool     fat_init(void);
+bool     fat_mount(blkdev_t* dev);
 bool     fat_is_mounted(void);
+bool     fat_get_info(fat_info_t* info);
 uint32_t fat_list_dir(fat_dir_entry_t* entries, uint32_t max);
 uint32_t fat_read_file(const char* name83, uint8_t* buf, uint32_t buf_size);
+
+// Path based access: "/BIN/TOOL.EXE", components separated by '/'
+bool     fat_stat(const char* path, fat_dir_entry_t* out, bool* is_dir);
+uint32_t fat_list_path(const char* path, fat_dir_entry_t* entries, uint32_t max);
+uint32_t fat_read_path(const char* path, uint8_t* buf, uint32_t buf_size);
 void     fat_name_to_83(const char* name, char* out);
-bool     ata_read_sectors(uint32_t lba, uint8_t count, uint8_t* buf);
+
+// Entry of a file or directory and where it is stored (false for the
+// root directory itself). Served from the directory index when possible.
+bool     fat_locate(const char* path, fat_dir_entry_t* out, fat_loc_t* loc);
+// Call `hook` whenever a directory entry is rewritten (file created,
+// written or truncated), and with NULL when a volume is mounted. Caches of
+// file contents outside the filesystem use it to drop stale copies.
+void     fat_set_change_hook(void (*hook)(const fat_loc_t* loc));
+
+// File handles: open a file by path, then read it in chunks of any size
+bool     fat_open(const char* path, fat_file_t* f);
+// Cap the read-ahead window of sequential readers (0 = no read-ahead)
+void     fat_set_readahead(uint32_t max_bytes);
+uint32_t fat_read(fat_file_t* f, void* buf, uint32_t len);   // Bytes read, 0 at EOF
+bool     fat_seek(fat_file_t* f, uint32_t offset);           // Offset from the start
+void     fat_close(fat_file_t* f);
+
+// Writing. Data and FAT changes go to the write-back buffer cache and
+// reach the disk on fat_sync() or the periodic write-back.
+// Create `path` in an existing directory (an existing file is truncated)
+bool     fat_create(const char* path, fat_file_t* f);
+// Write at the handle's offset, growing the file; bytes written (0 = error
+// or disk full)
+uint32_t fat_write(fat_file_t* f, const void* buf, uint32_t len);
+// Shrink the file to `size` bytes, freeing clusters past it
+bool     fat_truncate(fat_file_t* f, uint32_t size);
+// Write back FAT, FSInfo, directory and data sectors
+bool     fat_sync(void);
 #endif
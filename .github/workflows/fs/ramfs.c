@@ -0,0 +1,214 @@
+// ramfs.c - Read-only filesystem over a tar archive in memory
+//
+// A tar archive loaded as a boot module is indexed once: every member's
+// path (upper-cased, without a leading "./" or "/") and the address of its
+// data inside the archive. Lookups compare paths, reads hand out pointers
+// into the archive, so nothing is ever copied. Only regular files and
+// directories are kept; links and device nodes are skipped.
+
+#include "ramfs.h"
+#include "../kernel/kernel.h"
+#include "../kernel/kmem.h"
+#include "../kernel/vga.h"
+
+// ustar header (512 bytes, numbers in octal ASCII)
+typedef struct {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char link[100];
+    char magic[6];              // "ustar"
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed)) tar_header_t;
+
+typedef struct {
+    char           path[RAMFS_PATH];
+    const uint8_t* data;
+    uint32_t       size;
+    bool           dir;
+} ramfs_node_t;
+
+static ramfs_node_t* rf_nodes = NULL;
+static uint32_t      rf_count = 0;
+static bool          rf_mounted = false;
+
+static uint32_t rf_octal(const char* s, uint32_t len) {
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < len && s[i] >= '0' && s[i] <= '7'; i++) v = v * 8 + (s[i] - '0');
+    return v;
+}
+
+// Canonical form of `in` into out[RAMFS_PATH]: upper case, no empty or "."
+// components, no leading or trailing slash. False when too long.
+static bool rf_normalize(const char* in, char* out) {
+    uint32_t n = 0;
+    while (*in) {
+        while (*in == '/') in++;
+        if (in[0] == '.' && (in[1] == '/' || in[1] == '\0')) {
+            in++;
+            continue;
+        }
+        if (!*in) break;
+        if (n) {
+            if (n + 1 >= RAMFS_PATH) return false;
+            out[n++] = '/';
+        }
+        while (*in && *in != '/') {
+            if (n + 1 >= RAMFS_PATH) return false;
+            char c = *in++;
+            out[n++] = c >= 'a' && c <= 'z' ? c - 32 : c;
+        }
+    }
+    out[n] = '\0';
+    return true;
+}
+
+bool ramfs_mount(const uint8_t* base, uint32_t size) {
+    if (size < 512 || memcmp(((const tar_header_t*)base)->magic, "ustar", 5) != 0) return false;
+
+    // Count members first so the index is one allocation
+    uint32_t count = 0;
+    for (uint32_t off = 0; off + 512 <= size && count < RAMFS_MAX_FILES; ) {
+        const tar_header_t* h = (const tar_header_t*)(base + off);
+        if (!h->name[0]) break;                     // End of archive
+        count++;
+        off += 512 + ((rf_octal(h->size, sizeof(h->size)) + 511) & ~511u);
+    }
+
+    ramfs_node_t* nodes = kmalloc((count ? count : 1) * sizeof(ramfs_node_t));
+    if (!nodes) return false;
+
+    uint32_t n = 0;
+    for (uint32_t off = 0, i = 0; i < count; i++) {
+        const tar_header_t* h = (const tar_header_t*)(base + off);
+        uint32_t len = rf_octal(h->size, sizeof(h->size));
+        off += 512;
+        const uint8_t* data = base + off;
+        off += (len + 511) & ~511u;
+        if (off > size && h->type != '5') break;    // Truncated archive
+
+        bool dir = h->type == '5';
+        if (!dir && h->type != '0' && h->type != '\0') continue;
+
+        // ustar splits long names into prefix + "/" + name
+        char full[256 + 1];
+        uint32_t p = 0;
+        for (uint32_t k = 0; k < sizeof(h->prefix) && h->prefix[k]; k++) full[p++] = h->prefix[k];
+        if (p) full[p++] = '/';
+        for (uint32_t k = 0; k < sizeof(h->name) && h->name[k]; k++) full[p++] = h->name[k];
+        full[p] = '\0';
+
+        ramfs_node_t* node = &nodes[n];
+        if (!rf_normalize(full, node->path) || !node->path[0]) continue;
+        node->data = data;
+        node->size = dir ? 0 : len;
+        node->dir  = dir;
+        n++;
+    }
+
+    kfree(rf_nodes);
+    rf_nodes = nodes;
+    rf_count = n;
+    rf_mounted = true;
+    return true;
+}
+
+bool ramfs_is_mounted(void) {
+    return rf_mounted;
+}
+
+static ramfs_node_t* rf_find(const char* path) {
+    for (uint32_t i = 0; i < rf_count; i++)
+        if (strcmp(rf_nodes[i].path, path) == 0) return &rf_nodes[i];
+    return NULL;
+}
+
+// Does some member live below directory `path` ("" = root)?
+static bool rf_has_children(const char* path) {
+    uint32_t len = strlen(path);
+    if (!len) return true;
+    for (uint32_t i = 0; i < rf_count; i++)
+        if (strncmp(rf_nodes[i].path, path, len) == 0 && rf_nodes[i].path[len] == '/') return true;
+    return false;
+}
+
+bool ramfs_open(const char* path, ramfs_file_t* f) {
+    char norm[RAMFS_PATH];
+    if (!rf_mounted || !rf_normalize(path, norm)) return false;
+    ramfs_node_t* node = rf_find(norm);
+    if (!node || node->dir) return false;
+    f->data = node->data;
+    f->size = node->size;
+    return true;
+}
+
+static void rf_entry(const char* name, uint32_t len, bool dir, uint32_t size,
+                     fat_dir_entry_t* out) {
+    char comp[13];
+    if (len > sizeof(comp) - 1) len = sizeof(comp) - 1;
+    memcpy(comp, name, len);
+    comp[len] = '\0';
+    memset(out, 0, sizeof(*out));
+    fat_name_to_83(comp, out->name);
+    out->attrs = dir ? FAT_ATTR_SUBDIR : FAT_ATTR_READONLY;
+    out->file_size = size;
+}
+
+bool ramfs_stat(const char* path, fat_dir_entry_t* out, bool* is_dir) {
+    char norm[RAMFS_PATH];
+    if (!rf_mounted || !rf_normalize(path, norm)) return false;
+
+    const char* base = norm;
+    for (const char* p = norm; *p; p++)
+        if (*p == '/') base = p + 1;
+
+    ramfs_node_t* node = norm[0] ? rf_find(norm) : NULL;
+    if (node) {
+        *is_dir = node->dir;
+        rf_entry(base, strlen(base), node->dir, node->size, out);
+        return true;
+    }
+    if (!rf_has_children(norm)) return false;
+    *is_dir = true;
+    rf_entry(base, strlen(base), true, 0, out);
+    return true;
+}
+
+uint32_t ramfs_list_path(const char* path, fat_dir_entry_t* entries, uint32_t max) {
+    char norm[RAMFS_PATH];
+    if (!rf_mounted || !rf_normalize(path, norm)) return 0;
+    uint32_t len = strlen(norm);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < rf_count && n < max; i++) {
+        const char* p = rf_nodes[i].path;
+        if (len) {
+            if (strncmp(p, norm, len) != 0 || p[len] != '/') continue;
+            p += len + 1;
+        }
+
+        // A member deeper down implies the subdirectory it lives in
+        uint32_t clen = 0;
+        while (p[clen] && p[clen] != '/') clen++;
+        bool dir = rf_nodes[i].dir || p[clen] == '/';
+
+        fat_dir_entry_t e;
+        rf_entry(p, clen, dir, rf_nodes[i].size, &e);
+        bool seen = false;
+        for (uint32_t k = 0; k < n && !seen; k++)
+            seen = memcmp(entries[k].name, e.name, 11) == 0;
+        if (!seen) entries[n++] = e;
+    }
+    return n;
+}
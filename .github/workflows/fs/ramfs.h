@@ -0,0 +1,24 @@
+// ramfs.h - Read-only filesystem over a tar archive in memory
+#ifndef RAMFS_H
+#define RAMFS_H
+#include "../kernel/kernel.h"
+#include "fat.h"
+
+#define RAMFS_MAX_FILES 1024
+#define RAMFS_PATH      128     // Longer member names are skipped
+
+typedef struct {
+    const uint8_t* data;        // Points into the archive, no copy
+    uint32_t       size;
+} ramfs_file_t;
+
+// Index the ustar archive at `base` (it must stay in memory)
+bool     ramfs_mount(const uint8_t* base, uint32_t size);
+bool     ramfs_is_mounted(void);
+// Paths as for FAT ("/BIN/TOOL.BIN", case-insensitive)
+bool     ramfs_open(const char* path, ramfs_file_t* f);
+// Directories listed in the archive or implied by a member's path count
+bool     ramfs_stat(const char* path, fat_dir_entry_t* out, bool* is_dir);
+// Directory contents as FAT entries (8.3 names, so `ls` prints them as is)
+uint32_t ramfs_list_path(const char* path, fat_dir_entry_t* entries, uint32_t max);
+#endif
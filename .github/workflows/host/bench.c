@@ -0,0 +1,482 @@
+// bench.c - Host microbenchmarks for the portable kernel modules
+//
+// Usage: myos-bench [filter] [--image path] [--min-time ms] [--queued] [--fat 12|16|32]
+//                   [--ramdisk]
+//
+// Each benchmark is a function that runs its body `iters` times. The runner
+// doubles the iteration count until a run takes at least --min-time, then
+// reports time per iteration (and throughput when the benchmark sets bytes).
+// Run under perf/valgrind directly: the whole binary is plain Linux code.
+
+#include "host.h"
+#include "../fs/fat.h"
+#include "../fs/bcache.h"
+#include "../fs/ramfs.h"
+#include "../drivers/ramdisk.h"
+#include "../kernel/kmem.h"
+#include "../kernel/vga.h"
+#include "../kernel/pe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const char* name;
+    void      (*fn)(uint64_t iters);
+    uint64_t    bytes;          // Bytes processed per iteration (0 = n/a)
+} bench_t;
+
+static volatile uint32_t bench_sink;    // Defeats dead-code elimination
+static blkdev_t*         bench_dev;     // Device the FAT volume is mounted from
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ──────────────────────────── test image ──────────────────────────────────
+
+#define NUM_FILES   200                 // In the root directory
+#define NUM_SUB     50                  // In /BIN, after the root files
+#define BIG_INDEX   (NUM_FILES - 1)
+#define BIG_SIZE    (1024 * 1024)
+#define SUB_DIR     "BIN        "
+
+static char        file_names[NUM_FILES + NUM_SUB][12];
+static host_file_t image_files[NUM_FILES + NUM_SUB];
+
+static bool setup_image(const char* path, uint32_t fat_bits) {
+    for (uint32_t i = 0; i < NUM_FILES + NUM_SUB; i++) {
+        snprintf(file_names[i], sizeof(file_names[i]), "FILE%04uBIN", i);
+        image_files[i].name83 = file_names[i];
+        image_files[i].size   = 1000 + i * 37;
+        image_files[i].dir83  = i < NUM_FILES ? NULL : SUB_DIR;
+    }
+    memcpy(file_names[BIG_INDEX], "BIG     BIN", 11);
+    image_files[BIG_INDEX].size = BIG_SIZE;
+    return host_mkfat(path, fat_bits, image_files, NUM_FILES + NUM_SUB);
+}
+
+static uint8_t file_buf[BIG_SIZE];
+
+// "/BIN/FILE0249.BIN" style path of an image file
+static const char* file_path(uint32_t index) {
+    static char path[32];
+    const char* n = image_files[index].name83;
+    snprintf(path, sizeof(path), "%s/%.8s.%.3s",
+             image_files[index].dir83 ? "/BIN" : "", n, n + 8);
+    for (char* p = path; *p; p++)
+        if (*p == ' ') memmove(p, p + 1, strlen(p)), p--;
+    return path;
+}
+
+static void verify_file(uint32_t index) {
+    uint32_t n = fat_read_path(file_path(index), file_buf, sizeof(file_buf));
+    if (n != image_files[index].size) {
+        fprintf(stderr, "verify: %.11s read %u bytes, want %u\n",
+                image_files[index].name83, n, image_files[index].size);
+        exit(1);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (file_buf[i] != host_file_byte(index, i)) {
+            fprintf(stderr, "verify: %.11s differs at byte %u\n",
+                    image_files[index].name83, i);
+            exit(1);
+        }
+    }
+}
+
+// Same through a file handle: odd-sized chunks, then a seek back
+static void verify_stream(uint32_t index) {
+    fat_file_t f;
+    uint8_t chunk[1000];
+    uint32_t size = image_files[index].size;
+    if (!fat_open(file_path(index), &f) || f.size != size) {
+        fprintf(stderr, "verify: cannot open %s\n", file_path(index));
+        exit(1);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t off = pass ? size / 3 : 0;
+        if (!fat_seek(&f, off)) exit(1);
+        uint32_t n;
+        while ((n = fat_read(&f, chunk, sizeof(chunk))) > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                if (chunk[i] != host_file_byte(index, off + i)) {
+                    fprintf(stderr, "verify: %s differs at byte %u (stream)\n",
+                            file_path(index), off + i);
+                    exit(1);
+                }
+            }
+            off += n;
+        }
+        if (off != size) {
+            fprintf(stderr, "verify: %s streamed %u bytes, want %u\n", file_path(index), off, size);
+            exit(1);
+        }
+    }
+    fat_close(&f);
+}
+
+static uint8_t write_byte(uint32_t off) { return (uint8_t)(off * 7 + (off >> 11)); }
+
+static void verify_contents(const char* path, uint32_t size) {
+    uint32_t n = fat_read_path(path, file_buf, sizeof(file_buf));
+    if (n != size) {
+        fprintf(stderr, "verify: %s read %u bytes, want %u\n", path, n, size);
+        exit(1);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (file_buf[i] != write_byte(i)) {
+            fprintf(stderr, "verify: %s differs at byte %u (write)\n", path, i);
+            exit(1);
+        }
+    }
+}
+
+// Create a file, write it in odd-sized chunks, shrink it, then remount
+// from a cold cache and check the contents and the free cluster count
+static void verify_write(const char* path) {
+    fat_info_t before, after;
+    fat_file_t f;
+    uint8_t chunk[1000];
+    const uint32_t size = 300 * 1024, cut = 5000;
+
+    fat_get_info(&before);
+    if (!fat_create(path, &f)) {
+        fprintf(stderr, "verify: cannot create %s\n", path);
+        exit(1);
+    }
+    for (uint32_t off = 0; off < size; off += sizeof(chunk)) {
+        uint32_t n = size - off < sizeof(chunk) ? size - off : sizeof(chunk);
+        for (uint32_t i = 0; i < n; i++) chunk[i] = write_byte(off + i);
+        if (fat_write(&f, chunk, n) != n) {
+            fprintf(stderr, "verify: %s write failed at %u\n", path, off);
+            exit(1);
+        }
+    }
+    fat_close(&f);
+    verify_contents(path, size);
+
+    if (!fat_open(path, &f) || !fat_truncate(&f, cut)) {
+        fprintf(stderr, "verify: cannot truncate %s\n", path);
+        exit(1);
+    }
+    fat_close(&f);
+
+    if (!fat_sync()) exit(1);
+    bcache_invalidate(bench_dev);
+    if (!fat_mount(bench_dev)) {
+        fprintf(stderr, "verify: remount after writing %s failed\n", path);
+        exit(1);
+    }
+    verify_contents(path, cut);
+
+    uint32_t used = (cut + before.cluster_bytes - 1) / before.cluster_bytes;
+    fat_get_info(&after);
+    if (after.free_clusters + used != before.free_clusters) {
+        fprintf(stderr, "verify: %s left %u free clusters, want %u\n",
+                path, after.free_clusters, before.free_clusters - used);
+        exit(1);
+    }
+}
+
+// A small ustar archive through the ramfs: nested paths, an implied
+// directory, lower-case names
+static void verify_ramfs(void) {
+    static uint8_t tar[512 * 8];
+    const char* names[] = { "./hello.txt", "bin/", "bin/tool.bin", "lib/deep/x.dat" };
+    const uint32_t sizes[] = { 5, 0, 700, 1 };
+    uint32_t off = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        uint8_t* h = tar + off;
+        strcpy((char*)h, names[i]);
+        snprintf((char*)h + 124, 12, "%011o", sizes[i]);
+        h[156] = names[i][strlen(names[i]) - 1] == '/' ? '5' : '0';
+        memcpy(h + 257, "ustar", 6);
+        off += 512;
+        for (uint32_t k = 0; k < sizes[i]; k++) tar[off + k] = (uint8_t)(i + k);
+        off += (sizes[i] + 511) & ~511u;
+    }
+
+    ramfs_file_t f;
+    fat_dir_entry_t e, list[8];
+    bool is_dir;
+    if (!ramfs_mount(tar, sizeof(tar)) || !ramfs_open("/BIN/TOOL.BIN", &f) ||
+        f.size != 700 || f.data[699] != (uint8_t)(2 + 699) ||
+        !ramfs_stat("/lib", &e, &is_dir) || !is_dir || ramfs_open("/BIN", &f) ||
+        ramfs_list_path("/", list, 8) != 3 || ramfs_list_path("lib/deep", list, 8) != 1 ||
+        memcmp(list[0].name, "X       DAT", 11) != 0) {
+        fprintf(stderr, "verify: ramfs lookup failed\n");
+        exit(1);
+    }
+}
+
+// ──────────────────────────── stdlib ──────────────────────────────────────
+
+static uint8_t mem_src[64 * 1024];
+static uint8_t mem_dst[64 * 1024];
+
+static void bm_memcpy_64(uint64_t it)  { while (it--) memcpy(mem_dst, mem_src, 64); }
+static void bm_memcpy_4k(uint64_t it)  { while (it--) memcpy(mem_dst, mem_src, 4096); }
+static void bm_memcpy_64k(uint64_t it) { while (it--) memcpy(mem_dst, mem_src, 65536); }
+static void bm_memset_4k(uint64_t it)  { while (it--) memset(mem_dst, (int)it, 4096); }
+
+static void bm_memcmp_name83(uint64_t it) {
+    while (it--) bench_sink += memcmp(file_names[it & 127], file_names[BIG_INDEX], 11) == 0;
+}
+
+// ──────────────────────────── vga ─────────────────────────────────────────
+
+static void bm_vga_print_line(uint64_t it) {
+    while (it--) vga_print("[INIT] Setting up PS/2 Keyboard...\n");
+}
+
+static void bm_vga_print_dec(uint64_t it) {
+    while (it--) vga_print_dec((uint32_t)it * 2654435761u);
+}
+
+static void bm_vga_print_hex(uint64_t it) {
+    while (it--) vga_print_hex((uint32_t)it);
+}
+
+// ──────────────────────────── pe ──────────────────────────────────────────
+
+static uint8_t pe_image[1024];
+
+static void setup_pe(void) {
+    mz_header_t* mz = (mz_header_t*)pe_image;
+    mz->magic    = MZ_MAGIC;
+    mz->e_lfanew = 0x80;
+    pe_file_header_t* pef = (pe_file_header_t*)(pe_image + 0x80);
+    pef->signature    = PE_MAGIC;
+    pef->machine      = PE_MACHINE_I386;
+    pef->num_sections = 3;
+    pe_opt_header_t* peo = (pe_opt_header_t*)(pef + 1);
+    peo->magic       = 0x010B;
+    peo->image_base  = 0x400000;
+    peo->entry_point = 0x1000;
+}
+
+static void bm_pe_parse(uint64_t it) {
+    pe_info_t info;
+    while (it--) {
+        pe_parse(pe_image, sizeof(pe_image), &info);
+        bench_sink += info.entry_rva;
+    }
+}
+
+// ──────────────────────────── fat ─────────────────────────────────────────
+
+static void bm_fat_lookup_first(uint64_t it) {
+    while (it--) bench_sink += fat_read_file(image_files[0].name83, file_buf, 1);
+}
+
+static void bm_fat_lookup_last(uint64_t it) {
+    while (it--) bench_sink += fat_read_file(image_files[BIG_INDEX - 1].name83, file_buf, 1);
+}
+
+static void bm_fat_lookup_missing(uint64_t it) {
+    while (it--) bench_sink += fat_read_file("MISSING BIN", file_buf, 1);
+}
+
+static void bm_fat_list_dir(uint64_t it) {
+    static fat_dir_entry_t entries[NUM_FILES];
+    while (it--) bench_sink += fat_list_dir(entries, NUM_FILES);
+}
+
+static void bm_fat_path_lookup(uint64_t it) {
+    static char path[32];
+    strcpy(path, file_path(NUM_FILES + NUM_SUB - 1));
+    while (it--) bench_sink += fat_read_path(path, file_buf, 1);
+}
+
+static void bm_fat_path_missing(uint64_t it) {
+    while (it--) bench_sink += fat_read_path("/BIN/MISSING.BIN", file_buf, 1);
+}
+
+static void bm_fat_read_1m(uint64_t it) {
+    while (it--) bench_sink += fat_read_file(image_files[BIG_INDEX].name83, file_buf, BIG_SIZE);
+}
+
+// 4 KB chunks through a handle, into a buffer that stays in cache
+static void bm_fat_read_1m_stream(uint64_t it) {
+    static char path[32];
+    strcpy(path, file_path(BIG_INDEX));
+    while (it--) {
+        fat_file_t f;
+        fat_open(path, &f);
+        uint32_t n;
+        while ((n = fat_read(&f, file_buf, 4096)) > 0) bench_sink += n;
+        fat_close(&f);
+    }
+}
+
+// Replace a 1 MB file in 4 KB chunks and sync it to disk
+static void bm_fat_write_1m(uint64_t it) {
+    while (it--) {
+        fat_file_t f;
+        if (!fat_create("/WBENCH.BIN", &f)) exit(1);
+        for (uint32_t off = 0; off < BIG_SIZE; off += 4096)
+            bench_sink += fat_write(&f, file_buf + off, 4096);
+        fat_close(&f);
+        fat_sync();
+    }
+}
+
+// Cold variants drop the buffer cache before every iteration
+static void bm_fat_lookup_last_cold(uint64_t it) {
+    while (it--) {
+        bcache_invalidate(bench_dev);
+        bench_sink += fat_read_file(image_files[BIG_INDEX - 1].name83, file_buf, 1);
+    }
+}
+
+static void bm_fat_read_1m_stream_cold(uint64_t it) {
+    while (it--) {
+        bcache_invalidate(bench_dev);
+        bm_fat_read_1m_stream(1);
+    }
+}
+
+static void bm_fat_read_1m_cold(uint64_t it) {
+    while (it--) {
+        bcache_invalidate(bench_dev);
+        bench_sink += fat_read_file(image_files[BIG_INDEX].name83, file_buf, BIG_SIZE);
+    }
+}
+
+static bench_t benches[] = {
+    { "memcpy/64",          bm_memcpy_64,          64 },
+    { "memcpy/4k",          bm_memcpy_4k,          4096 },
+    { "memcpy/64k",         bm_memcpy_64k,         65536 },
+    { "memset/4k",          bm_memset_4k,          4096 },
+    { "memcmp/name83",      bm_memcmp_name83,      0 },
+    { "vga/print_line",     bm_vga_print_line,     0 },
+    { "vga/print_dec",      bm_vga_print_dec,      0 },
+    { "vga/print_hex",      bm_vga_print_hex,      0 },
+    { "pe/parse",           bm_pe_parse,           0 },
+    { "fat/lookup_first",   bm_fat_lookup_first,   0 },
+    { "fat/lookup_last",    bm_fat_lookup_last,    0 },
+    { "fat/lookup_missing", bm_fat_lookup_missing, 0 },
+    { "fat/list_dir",       bm_fat_list_dir,       0 },
+    { "fat/path_lookup",    bm_fat_path_lookup,    0 },
+    { "fat/path_missing",   bm_fat_path_missing,   0 },
+    { "fat/read_1m",        bm_fat_read_1m,        BIG_SIZE },
+    { "fat/read_1m_stream", bm_fat_read_1m_stream, BIG_SIZE },
+    { "fat/lookup_last_cold", bm_fat_lookup_last_cold, 0 },
+    { "fat/read_1m_cold",   bm_fat_read_1m_cold,   BIG_SIZE },
+    { "fat/read_1m_stream_cold", bm_fat_read_1m_stream_cold, BIG_SIZE },
+    { "fat/write_1m",       bm_fat_write_1m,       BIG_SIZE },    // Skipped with --image
+};
+
+static void run_bench(const bench_t* b, uint64_t min_ns) {
+    uint64_t iters = 1, elapsed = 0;
+    host_disk_stats_t st;
+
+    for (;;) {
+        host_disk_reset_stats();
+        uint64_t t0 = now_ns();
+        b->fn(iters);
+        elapsed = now_ns() - t0;
+        if (elapsed >= min_ns || iters >= (1ull << 40)) break;
+        iters *= 2;
+    }
+    host_disk_get_stats(&st);
+
+    double ns_op = (double)elapsed / iters;
+    printf("%-24s %12llu %12.1f ns/op", b->name, (unsigned long long)iters, ns_op);
+    if (b->bytes)
+        printf(" %9.1f MB/s", (double)b->bytes * iters / elapsed * 1e3);
+    if (st.commands)
+        printf(" %8.1f cmds/op %8.1f sect/op",
+               (double)st.commands / iters, (double)st.sectors / iters);
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    const char* image = NULL;
+    bool queued = false;
+    bool ramdisk = false;
+    uint32_t fat_bits = 12;
+    uint64_t min_ns = 200 * 1000000ull;
+    char tmp_image[] = "/tmp/myos-bench-XXXXXX";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--image") == 0 && i + 1 < argc)         image = argv[++i];
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) min_ns = strtoull(argv[++i], NULL, 10) * 1000000ull;
+        else if (strcmp(argv[i], "--queued") == 0)                   queued = true;
+        else if (strcmp(argv[i], "--ramdisk") == 0)                  ramdisk = true;
+        else if (strcmp(argv[i], "--fat") == 0 && i + 1 < argc)      fat_bits = (uint32_t)atoi(argv[++i]);
+        else filter = argv[i];
+    }
+
+    // Same heap/cache setup as kernel_main, on a malloc'd arena
+    uint32_t heap_size = 32 * 1024 * 1024;
+    kmem_init(malloc(heap_size), heap_size);
+    bcache_init(bcache_default_size());
+
+    if (!image) {
+        int fd = mkstemp(tmp_image);
+        if (fd < 0 || !setup_image(tmp_image, fat_bits)) {
+            fprintf(stderr, "cannot build test image\n");
+            return 1;
+        }
+        close(fd);
+    }
+
+    // --ramdisk: the whole image in memory, as a boot module would be
+    bench_dev = host_disk_open(image ? image : tmp_image) ? blkdev_get(0) : NULL;
+    if (bench_dev && ramdisk) {
+        uint32_t size = bench_dev->sectors * 512;
+        uint8_t* mem = malloc(size);
+        bench_dev = mem && blk_read(bench_dev, 0, bench_dev->sectors, mem)
+                    ? ramdisk_create(mem, size) : NULL;
+    }
+    if (!bench_dev || !fat_mount(bench_dev)) {
+        fprintf(stderr, "cannot mount %s\n", image ? image : tmp_image);
+        return 1;
+    }
+    host_disk_set_queued(queued);
+    if (!image) {
+        verify_file(0);
+        verify_file(BIG_INDEX - 1);
+        verify_file(BIG_INDEX);
+        verify_file(NUM_FILES);
+        verify_file(NUM_FILES + NUM_SUB - 1);
+        verify_stream(BIG_INDEX);
+        verify_stream(NUM_FILES + NUM_SUB - 1);
+        verify_ramfs();
+        verify_write("/NEW.TXT");
+        verify_write("/BIN/NEW.TXT");
+        verify_file(BIG_INDEX);
+    }
+
+    setup_pe();
+    vga_init();
+
+    printf("%-24s %12s %15s\n", "benchmark", "iterations", "time");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (filter && !strstr(benches[i].name, filter)) continue;
+        if (image && strncmp(benches[i].name, "fat/write", 9) == 0) continue;
+        run_bench(&benches[i], min_ns);
+    }
+
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    printf("\nbcache: %u buffers, %u hits, %u misses, %u evictions, %u read ahead, %u written\n",
+           st.buffers, st.hits, st.misses, st.evictions, st.readahead, st.written);
+
+    fat_info_t fi;
+    if (fat_get_info(&fi))
+        printf("fat: FAT%u, %u clusters of %u bytes, %u free\n",
+               fi.fat_type, fi.clusters, fi.cluster_bytes, fi.free_clusters);
+
+    host_disk_close();
+    if (!image) unlink(tmp_image);
+    return 0;
+}
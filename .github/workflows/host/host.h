@@ -0,0 +1,38 @@
+// host.h - Shims for building kernel modules as a Linux program
+#ifndef HOST_H
+#define HOST_H
+#include "../kernel/kernel.h"
+
+// Fake VGA text buffer that vga.c writes to (80x25 cells)
+extern uint16_t host_vga_mem[];
+
+// File-backed disk, registered as block device "hda"
+bool     host_disk_open(const char* path);
+void     host_disk_close(void);
+// Switch "hda" to the queued start/poll interface (like AHCI NCQ)
+void     host_disk_set_queued(bool queued);
+
+// Disk statistics, reset by host_disk_reset_stats()
+typedef struct {
+    uint64_t commands;      // Driver calls
+    uint64_t sectors;       // Sectors transferred
+    uint64_t writes;        // Driver calls that wrote
+} host_disk_stats_t;
+
+void     host_disk_reset_stats(void);
+void     host_disk_get_stats(host_disk_stats_t* st);
+
+// FAT image builder (12, 16 or 32 bits): files are laid out back to back,
+// each in one contiguous cluster run, with contents from host_file_byte().
+typedef struct {
+    const char* name83;     // 11 chars, space padded
+    uint32_t    size;
+    const char* dir83;      // Subdirectory of the root, NULL = root
+} host_file_t;
+
+#define HOST_MAX_SUBDIRS 8
+
+bool     host_mkfat(const char* path, uint32_t fat_bits,
+                    const host_file_t* files, uint32_t nfiles);
+uint8_t  host_file_byte(uint32_t file_index, uint32_t offset);
+#endif
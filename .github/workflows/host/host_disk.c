@@ -0,0 +1,266 @@
+// host_disk.c - File-backed block device and a FAT image builder
+
+#include "host.h"
+#include "../drivers/blkdev.h"
+#include "../fs/fat.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static int disk_fd = -1;
+static host_disk_stats_t disk_stats;
+static blkdev_t* disk_dev = NULL;
+
+static bool host_disk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buf) {
+    (void)dev;
+    if (disk_fd < 0) return false;
+    size_t len = (size_t)count * 512;
+    ssize_t n = pread(disk_fd, buf, len, (off_t)lba * 512);
+    if (n != (ssize_t)len) return false;
+    disk_stats.commands++;
+    disk_stats.sectors += count;
+    return true;
+}
+
+static bool host_disk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buf) {
+    (void)dev;
+    if (disk_fd < 0) return false;
+    size_t len = (size_t)count * 512;
+    ssize_t n = pwrite(disk_fd, buf, len, (off_t)lba * 512);
+    if (n != (ssize_t)len) return false;
+    disk_stats.commands++;
+    disk_stats.sectors += count;
+    disk_stats.writes++;
+    return true;
+}
+
+static const blkdev_ops_t host_disk_ops = {
+    .read  = host_disk_read,
+    .write = host_disk_write,
+};
+
+// Queued mode: transfers pile up until poll(), which completes them
+// newest first, so the block layer sees out-of-order completion
+static blk_transfer_t* disk_queue[BLK_MAX_INFLIGHT];
+static uint32_t        disk_queued = 0;
+
+static bool host_disk_start(blkdev_t* dev, blk_transfer_t* x) {
+    (void)dev;
+    if (disk_queued == BLK_MAX_INFLIGHT) return false;
+    disk_queue[disk_queued++] = x;
+    return true;
+}
+
+static void host_disk_poll(blkdev_t* dev) {
+    while (disk_queued) {
+        blk_transfer_t* x = disk_queue[--disk_queued];
+        bool ok = x->write ? host_disk_write(dev, x->lba, x->count, x->buf)
+                           : host_disk_read(dev, x->lba, x->count, x->buf);
+        blk_transfer_done(x, ok);
+    }
+}
+
+static const blkdev_ops_t host_disk_queued_ops = {
+    .start = host_disk_start,
+    .poll  = host_disk_poll,
+};
+
+void host_disk_set_queued(bool queued) {
+    if (disk_dev) disk_dev->ops = queued ? &host_disk_queued_ops : &host_disk_ops;
+}
+
+bool host_disk_open(const char* path) {
+    host_disk_close();
+    disk_fd = open(path, O_RDWR);
+    if (disk_fd < 0) disk_fd = open(path, O_RDONLY);    // Writes will fail
+    if (disk_fd < 0) return false;
+
+    off_t size = lseek(disk_fd, 0, SEEK_END);
+    if (!disk_dev)
+        disk_dev = blkdev_register("hda", 0, 65536, &host_disk_ops, NULL);
+    disk_dev->sectors = (uint32_t)(size / 512);
+    return true;
+}
+
+void host_disk_close(void) {
+    if (disk_fd >= 0) close(disk_fd);
+    disk_fd = -1;
+}
+
+void host_disk_reset_stats(void) {
+    memset(&disk_stats, 0, sizeof(disk_stats));
+}
+
+void host_disk_get_stats(host_disk_stats_t* st) {
+    *st = disk_stats;
+}
+
+uint8_t host_file_byte(uint32_t file_index, uint32_t offset) {
+    return (uint8_t)(file_index * 31 + offset * 7 + (offset >> 9));
+}
+
+static void fat_set(uint8_t* fat, uint32_t fat_bits, uint32_t cluster, uint32_t val) {
+    if (fat_bits == 12) {
+        uint32_t off = cluster + cluster / 2;
+        uint16_t cur = fat[off] | (fat[off + 1] << 8);
+        if (cluster & 1) cur = (cur & 0x000F) | (uint16_t)(val << 4);
+        else             cur = (cur & 0xF000) | (uint16_t)(val & 0x0FFF);
+        fat[off]     = cur & 0xFF;
+        fat[off + 1] = cur >> 8;
+    } else if (fat_bits == 16) {
+        fat[cluster * 2]     = val & 0xFF;
+        fat[cluster * 2 + 1] = (val >> 8) & 0xFF;
+    } else {
+        for (int i = 0; i < 4; i++) fat[cluster * 4 + i] = (val >> (i * 8)) & 0xFF;
+    }
+}
+
+// Chain `n` clusters from `first` in the FAT
+static void fat_chain(uint8_t* fat, uint32_t fat_bits, uint32_t first, uint32_t n) {
+    uint32_t eoc = (fat_bits == 12) ? 0xFFF : (fat_bits == 16) ? 0xFFFF : 0x0FFFFFFF;
+    for (uint32_t c = 0; c < n; c++)
+        fat_set(fat, fat_bits, first + c, c + 1 < n ? first + c + 1 : eoc);
+}
+
+// Geometry: FAT12 = 4 MB / 2 KB clusters, FAT16 = 16 MB / 4 KB clusters,
+// FAT32 = 36 MB / 512-byte clusters (just above the FAT32 minimum), with
+// the root directory in a chain starting at cluster 2 and an FSInfo sector.
+// Files with a dir83 go into that subdirectory of the root.
+bool host_mkfat(const char* path, uint32_t fat_bits,
+                const host_file_t* files, uint32_t nfiles) {
+    if (fat_bits != 12 && fat_bits != 16 && fat_bits != 32) return false;
+
+    uint32_t total   = (fat_bits == 12) ? 8192 : (fat_bits == 16) ? 8192 * 4 : 73728;
+    uint32_t spc     = (fat_bits == 12) ? 4 : (fat_bits == 16) ? 8 : 1;
+    uint32_t rsvd    = (fat_bits == 32) ? 32 : 1;
+    uint32_t nfats   = 2;
+    uint32_t rootent = (fat_bits == 32) ? 0 : 512;
+    uint32_t rootsec = rootent * 32 / 512;
+    uint32_t clusters = total / spc;
+    uint32_t spf = (fat_bits == 12) ? (clusters * 3 / 2 + 511) / 512
+                                    : (clusters * (fat_bits / 8) + 511) / 512;
+    uint32_t data_lba = rsvd + nfats * spf + rootsec;
+    uint32_t max_cluster = (total - data_lba) / spc + 2;
+
+    uint8_t* img = calloc(total, 512);
+    if (!img) return false;
+
+    fat_bpb_t* bpb = (fat_bpb_t*)img;
+    bpb->jmp[0] = 0xEB; bpb->jmp[1] = 0x3C; bpb->jmp[2] = 0x90;
+    memcpy(bpb->oem, "MYOSHOST", 8);
+    bpb->bytes_per_sector    = 512;
+    bpb->sectors_per_cluster = spc;
+    bpb->reserved_sectors    = rsvd;
+    bpb->num_fats            = nfats;
+    bpb->root_entry_count    = rootent;
+    bpb->total_sectors16     = total < 0x10000 ? total : 0;
+    bpb->total_sectors32     = total < 0x10000 ? 0 : total;
+    bpb->media_type          = 0xF8;
+    bpb->sectors_per_fat     = (fat_bits == 32) ? 0 : spf;
+    img[510] = 0x55; img[511] = 0xAA;
+
+    uint8_t* fat = img + rsvd * 512;
+    fat_set(fat, fat_bits, 0, 0x0FFFFFF8);
+    fat_set(fat, fat_bits, 1, 0x0FFFFFFF);
+
+    // Subdirectories (one level) named by the files' dir83, and how many
+    // entries each directory needs
+    const char* subdirs[HOST_MAX_SUBDIRS];
+    uint32_t    sub_files[HOST_MAX_SUBDIRS] = {0};
+    uint32_t    nsub = 0;
+    uint32_t    root_files = 0;
+    uint32_t    file_dir[nfiles ? nfiles : 1];     // 0 = root, else subdir + 1
+    for (uint32_t i = 0; i < nfiles; i++) {
+        file_dir[i] = 0;
+        if (!files[i].dir83) { root_files++; continue; }
+        uint32_t d = 0;
+        while (d < nsub && memcmp(subdirs[d], files[i].dir83, 11)) d++;
+        if (d == nsub) {
+            if (nsub == HOST_MAX_SUBDIRS) { free(img); return false; }
+            subdirs[nsub++] = files[i].dir83;
+        }
+        sub_files[d]++;
+        file_dir[i] = d + 1;
+    }
+    uint32_t root_entries = root_files + nsub;
+    if (fat_bits != 32 && root_entries > rootent) { free(img); return false; }
+
+    uint32_t next = 2;
+    uint32_t cluster_bytes = spc * 512;
+    fat_dir_entry_t* dirs[HOST_MAX_SUBDIRS + 1];    // Entry arrays, [0] = root
+    uint32_t         used[HOST_MAX_SUBDIRS + 1] = {0};
+    if (fat_bits == 32) {
+        // Root directory chain: room for every entry plus the end marker
+        uint32_t root_clusters = ((root_entries + 1) * 32 + cluster_bytes - 1) / cluster_bytes;
+        fat32_bpb_ext_t* ext = (fat32_bpb_ext_t*)(img + sizeof(fat_bpb_t));
+        ext->sectors_per_fat32 = spf;
+        ext->root_cluster      = next;
+        ext->fs_info_sector    = 1;
+        ext->backup_boot_sector = 6;
+        fat_chain(fat, fat_bits, next, root_clusters);
+        dirs[0] = (fat_dir_entry_t*)(img + data_lba * 512);
+        next += root_clusters;
+    } else {
+        dirs[0] = (fat_dir_entry_t*)(img + (rsvd + nfats * spf) * 512);
+    }
+
+    for (uint32_t d = 0; d < nsub; d++) {
+        // ".", "..", the files and the end marker
+        uint32_t n = ((sub_files[d] + 3) * 32 + cluster_bytes - 1) / cluster_bytes;
+        if (next + n > max_cluster) { free(img); return false; }
+        fat_dir_entry_t* e = &dirs[0][used[0]++];
+        memcpy(e->name, subdirs[d], 11);
+        e->attrs = FAT_ATTR_SUBDIR;
+        e->start_cluster_lo = next & 0xFFFF;
+        e->start_cluster_hi = (fat_bits == 32) ? (next >> 16) : 0;
+
+        fat_dir_entry_t* sub = (fat_dir_entry_t*)(img + (data_lba + (next - 2) * spc) * 512);
+        sub[0] = *e;
+        memcpy(sub[0].name, ".          ", 11);
+        memset(&sub[1], 0, sizeof(sub[1]));
+        memcpy(sub[1].name, "..         ", 11);
+        sub[1].attrs = FAT_ATTR_SUBDIR;     // Parent is the root: cluster 0
+        dirs[d + 1] = sub;
+        used[d + 1] = 2;
+        fat_chain(fat, fat_bits, next, n);
+        next += n;
+    }
+
+    for (uint32_t i = 0; i < nfiles; i++) {
+        uint32_t n = (files[i].size + cluster_bytes - 1) / cluster_bytes;
+        if (next + n > max_cluster) { free(img); return false; }
+
+        fat_dir_entry_t* e = &dirs[file_dir[i]][used[file_dir[i]]++];
+        memcpy(e->name, files[i].name83, 11);
+        e->attrs = FAT_ATTR_ARCHIVE;
+        e->file_size = files[i].size;
+        e->start_cluster_lo = n ? (next & 0xFFFF) : 0;
+        e->start_cluster_hi = (fat_bits == 32 && n) ? (next >> 16) : 0;
+
+        uint8_t* data = img + (data_lba + (next - 2) * spc) * 512;
+        for (uint32_t b = 0; b < files[i].size; b++)
+            data[b] = host_file_byte(i, b);
+        fat_chain(fat, fat_bits, next, n);
+        next += n;
+    }
+    for (uint32_t f = 1; f < nfats; f++)
+        memcpy(fat + f * spf * 512, fat, spf * 512);
+
+    if (fat_bits == 32) {
+        fat_fsinfo_t* fsi = (fat_fsinfo_t*)(img + 512);
+        fsi->lead_sig   = FAT_FSINFO_LEAD_SIG;
+        fsi->struct_sig = FAT_FSINFO_STRUCT_SIG;
+        fsi->free_count = max_cluster - next;
+        fsi->next_free  = next;
+        fsi->trail_sig  = FAT_FSINFO_TRAIL_SIG;
+        memcpy(img + 6 * 512, img, 512);
+    }
+
+    FILE* fp = fopen(path, "wb");
+    bool ok = fp && fwrite(img, 512, total, fp) == total;
+    if (fp) fclose(fp);
+    free(img);
+    return ok;
+}
@@ -0,0 +1,23 @@
+// host_io.c - Port I/O and VGA stubs for the host build
+// Reads return 0xFF (floating bus), writes are discarded.
+
+#include "host.h"
+
+uint16_t host_vga_mem[80 * 25];
+
+void outb(uint16_t port, uint8_t val)   { (void)port; (void)val; }
+uint8_t inb(uint16_t port)              { (void)port; return 0xFF; }
+void outw(uint16_t port, uint16_t val)  { (void)port; (void)val; }
+uint16_t inw(uint16_t port)             { (void)port; return 0xFFFF; }
+void outl(uint16_t port, uint32_t val)  { (void)port; (void)val; }
+uint32_t inl(uint16_t port)             { (void)port; return 0xFFFFFFFF; }
+bool interrupts_enabled(void)           { return false; }
+
+void insw(uint16_t port, void* buf, uint32_t count) {
+    (void)port;
+    memset(buf, 0xFF, count * 2);
+}
+
+void outsw(uint16_t port, const void* buf, uint32_t count) {
+    (void)port; (void)buf; (void)count;
+}
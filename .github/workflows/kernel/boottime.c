@@ -0,0 +1,112 @@
+// boottime.c - Boot stage timestamps
+//
+// boot.asm stores the TSC the moment GRUB jumps to the kernel, and the
+// init runner records a start/end pair for each init step. Steps that
+// finish after the shell came up ran in the background and may overlap
+// (the mouse handshake waits on interrupts while disks are probed), so
+// each is reported as its own interval. Cycles are converted with the TSC
+// rate the PIT measures when the report is printed (so calibration is not
+// billed to any stage). Since the TSC starts at CPU reset, the handoff
+// stamp also tells how long firmware and the boot loader took.
+
+#include "boottime.h"
+#include "kernel.h"
+#include "vga.h"
+#include "../drivers/serial.h"
+#include "../drivers/timer.h"
+
+typedef struct {
+    const char* name;
+    uint64_t    start;
+    uint64_t    end;
+    bool        background;
+} boot_mark_t;
+
+extern uint64_t boot_tsc;                   // boot.asm
+
+static boot_mark_t bt_marks[BOOT_MAX_STAGES];
+static uint32_t    bt_count = 0;
+static uint64_t    bt_shell_tsc = 0;
+static uint64_t    bt_done_tsc = 0;
+
+void boot_record(const char* name, uint64_t start) {
+    if (bt_count == BOOT_MAX_STAGES || bt_done_tsc) return;
+    bt_marks[bt_count].name  = name;
+    bt_marks[bt_count].start = start;
+    bt_marks[bt_count].end   = rdtsc();
+    bt_marks[bt_count].background = bt_shell_tsc != 0;
+    bt_count++;
+}
+
+void boot_shell_ready(void) {
+    if (!bt_shell_tsc) bt_shell_tsc = rdtsc();
+}
+
+// One report line: name padded to a column, then "1234.567 ms"
+static void bt_line(void (*print)(const char*), const char* name, uint64_t cycles,
+                    uint32_t khz, const char* note) {
+    char line[64];
+    uint32_t n = 0;
+    line[n++] = ' ';
+    line[n++] = ' ';
+    while (*name && n < 24) line[n++] = *name++;
+    while (n < 24) line[n++] = ' ';
+
+    // Microseconds when the rate is known, else thousands of cycles
+    uint32_t v = (uint32_t)(khz ? udiv64(cycles * 1000, khz) : udiv64(cycles, 1000));
+    char digits[10];
+    int d = 0;
+    do {
+        digits[d++] = '0' + (char)(v % 10);
+        v /= 10;
+    } while (v || (khz && d < 4));
+    for (int pad = d; pad < 10; pad++) line[n++] = ' ';
+    while (d > 0) {
+        line[n++] = digits[--d];
+        if (khz && d == 3) line[n++] = '.';
+    }
+    const char* unit = khz ? " ms" : "k cycles";
+    while (*unit) line[n++] = *unit++;
+    while (*note && n < sizeof(line) - 2) line[n++] = *note++;
+    line[n++] = '\n';
+    line[n] = '\0';
+    print(line);
+}
+
+static void bt_report(void (*print)(const char*)) {
+    uint32_t khz = timer_tsc_khz();         // 0 without PIT channel 2
+    if (!bt_count) return;
+
+    uint32_t slowest = 0;
+    uint64_t slowest_len = 0;
+    for (uint32_t i = 0; i < bt_count; i++) {
+        if (bt_marks[i].end - bt_marks[i].start > slowest_len) {
+            slowest_len = bt_marks[i].end - bt_marks[i].start;
+            slowest = i;
+        }
+    }
+
+    print("Boot stages:\n");
+    bt_line(print, "Firmware + loader", boot_tsc, khz, "  (from CPU reset)");
+    bt_line(print, "Kernel entry", bt_marks[0].start - boot_tsc, khz, "");
+    for (uint32_t i = 0; i < bt_count; i++) {
+        const boot_mark_t* m = &bt_marks[i];
+        bt_line(print, m->name, m->end - m->start, khz,
+                i == slowest ? (m->background ? "  (background) <- slowest" : "  <- slowest")
+                             : (m->background ? "  (background)" : ""));
+    }
+    if (bt_shell_tsc) bt_line(print, "Total to shell", bt_shell_tsc - boot_tsc, khz, "");
+    if (bt_done_tsc)  bt_line(print, "Total to all done", bt_done_tsc - boot_tsc, khz, "");
+    else              print("  Background init still running\n");
+}
+
+void boot_done(void) {
+    if (bt_done_tsc) return;
+    boot_shell_ready();
+    bt_done_tsc = rdtsc();
+    bt_report(serial_print);
+}
+
+void boottime_print(void) {
+    bt_report(vga_print);
+}
@@ -0,0 +1,16 @@
+// boottime.h - Boot stage timestamps
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+#include "kernel.h"
+
+#define BOOT_MAX_STAGES 24
+
+// Init step `name` (a string literal) ran from TSC `start` until now
+void boot_record(const char* name, uint64_t start);
+// The shell is taking input; steps recorded after this ran in the background
+void boot_shell_ready(void);
+// Background init finished too: dumps the report to serial
+void boot_done(void);
+// Per-stage report on the console (shell `boottime`)
+void boottime_print(void);
+#endif
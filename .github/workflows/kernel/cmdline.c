@@ -0,0 +1,212 @@
+// cmdline.c - Kernel command line (Multiboot) parameters
+//
+// GRUB passes everything after the kernel path on the "multiboot" line,
+// e.g. "/boot/myos.bin nosmp hz=1000 console=both trace=exec". kernel_main
+// registers a table of typed parameters with defaults and hands the line
+// to cmdline_parse(), which runs once before the init steps, so runtime
+// modes (timer rate, cache sizes, console, tracing, an autorun session)
+// can be changed by editing the boot entry instead of rebuilding.
+//
+// GRUB wraps an argument that contains spaces in double quotes, so quotes
+// may surround a whole word ("autorun=run X.EXE") or just the value.
+
+#include "cmdline.h"
+#include "kernel.h"
+#include "vga.h"
+
+static char             cl_line[CMDLINE_MAX];
+static char             cl_word[CMDLINE_MAX];
+static cmdline_param_t* cl_params = NULL;
+static uint32_t         cl_count = 0;
+
+static void cl_warn(const char* msg, const char* word) {
+    vga_set_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK);
+    vga_print("[CMDLINE] ");
+    vga_print(msg);
+    vga_print(word);
+    vga_putchar('\n');
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+}
+
+// Copy the next word at *p into cl_word without its quotes; false at the end
+static bool cl_next_word(const char** p) {
+    const char* s = *p;
+    while (*s == ' ' || *s == '\t') s++;
+    if (!*s) return false;
+
+    uint32_t n = 0;
+    bool quoted = false;
+    for (; *s && (quoted || (*s != ' ' && *s != '\t')); s++) {
+        if (*s == '"') {
+            quoted = !quoted;
+            continue;
+        }
+        if (*s == '\\' && s[1]) s++;
+        if (n < sizeof(cl_word) - 1) cl_word[n++] = *s;
+    }
+    cl_word[n] = '\0';
+    *p = s;
+    return true;
+}
+
+// Decimal or 0x-prefixed hex; false on anything else or overflow
+static bool cl_parse_uint(const char* s, uint32_t* out) {
+    uint32_t v = 0, base = 10;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    }
+    if (!*s) return false;
+    for (; *s; s++) {
+        uint32_t d;
+        if (*s >= '0' && *s <= '9')                    d = *s - '0';
+        else if (base == 16 && *s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+        else if (base == 16 && *s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+        else return false;
+        if (v > (0xFFFFFFFF - d) / base) return false;
+        v = v * base + d;
+    }
+    *out = v;
+    return true;
+}
+
+static int32_t cl_choice(const cmdline_param_t* p, const char* s) {
+    for (uint32_t i = 0; i < CMDLINE_MAX_CHOICES && p->choices[i]; i++)
+        if (strcmp(p->choices[i], s) == 0) return (int32_t)i;
+    return -1;
+}
+
+// Store `val` (NULL for a bare word) in `p`; false if it does not fit the type
+static bool cl_set(cmdline_param_t* p, char* val) {
+    if (!val) {
+        if (p->type != CMDLINE_BOOL) return false;
+        *(bool*)p->value = true;
+        return true;
+    }
+
+    switch (p->type) {
+    case CMDLINE_UINT: {
+        uint32_t v;
+        if (!cl_parse_uint(val, &v) || v < p->min || v > p->max) return false;
+        *(uint32_t*)p->value = v;
+        return true;
+    }
+    case CMDLINE_BOOL:
+        if (!strcmp(val, "1") || !strcmp(val, "on") || !strcmp(val, "yes")) {
+            *(bool*)p->value = true;
+            return true;
+        }
+        if (!strcmp(val, "0") || !strcmp(val, "off") || !strcmp(val, "no")) {
+            *(bool*)p->value = false;
+            return true;
+        }
+        return false;
+    case CMDLINE_CHOICE: {
+        int32_t i = cl_choice(p, val);
+        if (i < 0) return false;
+        *(uint32_t*)p->value = (uint32_t)i;
+        return true;
+    }
+    case CMDLINE_FLAGS: {
+        uint32_t mask = 0;
+        if (cl_parse_uint(val, &mask)) {
+            *(uint32_t*)p->value = mask;
+            return true;
+        }
+        while (*val) {
+            char* end = strchr(val, ',');
+            if (end) *end = '\0';
+            int32_t i = cl_choice(p, val);
+            if (i < 0) return false;
+            mask |= 1u << i;
+            if (!end) break;
+            val = end + 1;
+        }
+        *(uint32_t*)p->value = mask;
+        return true;
+    }
+    case CMDLINE_STRING:
+        if (strlen(val) >= p->max) return false;
+        strcpy((char*)p->value, val);
+        return true;
+    }
+    return false;
+}
+
+void cmdline_parse(const char* line, cmdline_param_t* params, uint32_t count) {
+    cl_params = params;
+    cl_count = count;
+    for (uint32_t i = 0; i < count; i++) params[i].given = false;
+    strncpy(cl_line, line ? line : "", sizeof(cl_line) - 1);
+    cl_line[sizeof(cl_line) - 1] = '\0';
+
+    const char* p = cl_line;
+    while (cl_next_word(&p)) {
+        char* val = strchr(cl_word, '=');
+        if (val) *val++ = '\0';
+
+        cmdline_param_t* param = NULL;
+        for (uint32_t i = 0; i < count && !param; i++)
+            if (strcmp(params[i].name, cl_word) == 0) param = &params[i];
+        if (!param) {
+            if (val) cl_warn("Unknown parameter: ", cl_word);
+            continue;
+        }
+        if (!cl_set(param, val)) {
+            cl_warn("Bad value, using the default: ", param->name);
+            continue;
+        }
+        param->given = true;
+    }
+}
+
+const char* cmdline_get(void) {
+    return cl_line;
+}
+
+static void cl_print_value(const cmdline_param_t* p) {
+    uint32_t v = p->type == CMDLINE_BOOL || p->type == CMDLINE_STRING ? 0 : *(uint32_t*)p->value;
+    switch (p->type) {
+    case CMDLINE_UINT:
+        vga_print_dec(v);
+        break;
+    case CMDLINE_BOOL:
+        vga_print(*(bool*)p->value ? "on" : "off");
+        break;
+    case CMDLINE_CHOICE:
+        vga_print(v < CMDLINE_MAX_CHOICES && p->choices[v] ? p->choices[v] : "?");
+        break;
+    case CMDLINE_FLAGS: {
+        bool any = false;
+        for (uint32_t i = 0; i < CMDLINE_MAX_CHOICES && p->choices[i]; i++) {
+            if (!(v & (1u << i))) continue;
+            if (any) vga_putchar(',');
+            vga_print(p->choices[i]);
+            any = true;
+        }
+        if (!any) vga_print("none");
+        break;
+    }
+    case CMDLINE_STRING:
+        vga_putchar('"');
+        vga_print((const char*)p->value);
+        vga_putchar('"');
+        break;
+    }
+}
+
+void cmdline_print(void) {
+    vga_print("Command line: ");
+    vga_print(cl_line[0] ? cl_line : "(none)");
+    vga_putchar('\n');
+    for (uint32_t i = 0; i < cl_count; i++) {
+        const cmdline_param_t* p = &cl_params[i];
+        vga_print("  ");
+        vga_print(p->name);
+        for (uint32_t n = strlen(p->name); n < 10; n++) vga_putchar(' ');
+        cl_print_value(p);
+        vga_print(p->given ? "  - " : "  (default) - ");
+        vga_print(p->help);
+        vga_putchar('\n');
+    }
+}
@@ -0,0 +1,40 @@
+// cmdline.h - Kernel command line (Multiboot) parameters
+#ifndef CMDLINE_H
+#define CMDLINE_H
+#include "kernel.h"
+
+#define CMDLINE_MAX          512    // Longer command lines are cut
+#define CMDLINE_MAX_CHOICES  8
+
+typedef enum {
+    CMDLINE_UINT,       // uint32_t, decimal or 0x hex, within [min, max]
+    CMDLINE_BOOL,       // bool: bare name = true, or name=0/1/off/on/no/yes
+    CMDLINE_CHOICE,     // uint32_t: index of the value in choices[]
+    CMDLINE_FLAGS,      // uint32_t: choices joined by ',', bit i = choices[i]
+                        // (a number is taken as the mask itself)
+    CMDLINE_STRING,     // char[max], including the terminator
+} cmdline_type_t;
+
+// One registered parameter. `value` holds the default on entry and is
+// only changed when the command line sets a valid value.
+typedef struct {
+    const char*    name;
+    cmdline_type_t type;
+    void*          value;
+    uint32_t       min, max;    // UINT: range; STRING: buffer size
+    const char*    choices[CMDLINE_MAX_CHOICES];
+    const char*    help;
+    bool           given;       // Set by cmdline_parse()
+} cmdline_param_t;
+
+// Parse `line` (NULL = empty) as space separated name=value words; double
+// quotes group words ("autorun=ls /BIN") and backslash escapes the next
+// character. Words without '=' that are not a parameter name (the kernel
+// path, GRUB's own flags) are ignored; bad values and unknown names are
+// reported and leave the default. The table must stay valid for
+// cmdline_print().
+void cmdline_parse(const char* line, cmdline_param_t* params, uint32_t count);
+// Command line as given, and every parameter's current value
+const char* cmdline_get(void);
+void cmdline_print(void);
+#endif
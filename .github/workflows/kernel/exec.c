@@ -1,165 +1,251 @@
 // exec.c - Simple EXE/Binary loader
-// Supports flat 32-bit binaries (.bin) loaded from FAT filesystem
+// Supports flat 32-bit binaries (.bin) loaded from the FAT filesystem, or
+// from the tar ramfs when no FAT volume is mounted
 // For proper PE/EXE support the loader detects the MZ header.
 //
 // NOTE: Full PE parsing is complex. This loader handles:
 //   1. Flat binary (.bin) - just executes at load address
 //   2. MZ/PE detection    - extracts entry point and jumps
 //
-// Programs run in RING 0 (kernel mode) for simplicity.
-// A proper OS would use ring 3 + paging for user programs.
+// Programs run in ring 3 on their own stack above the load area, entered
+// with iret. They reach the kernel only through system calls (syscall.c);
+// interrupts and faults switch to the kernel stack in the TSS. SYS_EXIT,
+// a fault in the program, or Ctrl+C unwinds back here from any depth, so
+// a crashing program ends instead of halting the machine. There is no
+// paging yet: a program cannot run privileged instructions or touch I/O
+// ports, but it can still write anywhere in memory.
+//
+// Images loaded from FAT are kept by the image cache (imgcache.c), so
+// running a program again copies it from memory instead of the disk.
 
 #include "exec.h"
 #include "../kernel/kernel.h"
 #include "../kernel/vga.h"
+#include "../kernel/pe.h"
+#include "../kernel/imgcache.h"
+#include "../kernel/syscall.h"
+#include "../kernel/gdt.h"
+#include "../kernel/trace.h"
+#include "../drivers/serial.h"
+#include "../drivers/keyboard.h"
 #include "../fs/fat.h"
+#include "../fs/ramfs.h"
 
-// Load address for user programs
-#define PROG_LOAD_ADDR 0x400000    // 4 MB
-
-// MZ DOS header magic
-#define MZ_MAGIC   0x5A4D
-
-// PE signature
-#define PE_MAGIC   0x00004550
-
-typedef struct {
-    uint16_t magic;         // MZ
-    uint16_t e_cblp;
-    uint16_t e_cp;
-    uint16_t e_crlc;
-    uint16_t e_cparhdr;
-    uint16_t e_minalloc;
-    uint16_t e_maxalloc;
-    uint16_t e_ss;
-    uint16_t e_sp;
-    uint16_t e_csum;
-    uint16_t e_ip;
-    uint16_t e_cs;
-    uint16_t e_lfarlc;
-    uint16_t e_ovno;
-    uint16_t e_res[4];
-    uint16_t e_oemid;
-    uint16_t e_oeminfo;
-    uint16_t e_res2[10];
-    uint32_t e_lfanew;      // Offset to PE header
-} __attribute__((packed)) mz_header_t;
-
-typedef struct {
-    uint32_t signature;     // PE\0\0
-    uint16_t machine;       // 0x014C = x86
-    uint16_t num_sections;
-    uint32_t timestamp;
-    uint32_t symbol_table;
-    uint32_t num_symbols;
-    uint16_t opt_header_size;
-    uint16_t characteristics;
-} __attribute__((packed)) pe_file_header_t;
-
-typedef struct {
-    uint16_t magic;         // 0x010B = PE32
-    uint8_t  major_linker;
-    uint8_t  minor_linker;
-    uint32_t code_size;
-    uint32_t init_data_size;
-    uint32_t uninit_data_size;
-    uint32_t entry_point;   // RVA of entry point
-    uint32_t base_of_code;
-    uint32_t base_of_data;
-    uint32_t image_base;    // Default load address
-    uint32_t section_align;
-    uint32_t file_align;
-    // ... more fields follow
-} __attribute__((packed)) pe_opt_header_t;
-
-#define MAX_PROG_SIZE (1024 * 1024)   // 1 MB max program
+// The file is streamed straight to the load address in chunks of this size
+#define EXEC_CHUNK (64 * 1024)
 
-exec_result_t exec_load(const char* filename) {
-    exec_result_t result = {0};
-    static uint8_t prog_buf[MAX_PROG_SIZE];
+static void exec_error(const char* msg, const char* arg) {
+    vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
+    vga_print(msg);
+    vga_print(arg);
+    vga_print("\n");
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+}
 
-    if (!fat_is_mounted()) {
-        vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
-        vga_print("[EXEC] Filesystem not mounted!\n");
-        vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-        result.error = EXEC_ERR_NO_FS;
-        return result;
+// Stream a FAT file to the load address; returns an EXEC_ error code
+static int32_t exec_read_fat(const char* filename, uint8_t* load_addr, uint32_t* size) {
+    // Open file on FAT ("TOOL.EXE" or a path such as "/BIN/TOOL.EXE")
+    fat_file_t file;
+    if (!fat_open(filename, &file) || file.size == 0) {
+        exec_error("[EXEC] File not found: ", filename);
+        return EXEC_ERR_NOT_FOUND;
+    }
+    if (file.size > MAX_PROG_SIZE) {
+        fat_close(&file);
+        exec_error("[EXEC] Program too large (max 1 MB)", "");
+        return EXEC_ERR_NO_MEM;
+    }
+
+    // Load it in place
+    *size = 0;
+    while (*size < file.size) {
+        uint32_t n = fat_read(&file, load_addr + *size, EXEC_CHUNK);
+        if (n == 0) break;
+        *size += n;
+    }
+    fat_close(&file);
+    if (*size != file.size) {
+        exec_error("[EXEC] Read error: ", filename);
+        return EXEC_ERR_NOT_FOUND;
+    }
+    return EXEC_OK;
+}
+
+// Copy a file of the tar ramfs to the load address: one memcpy straight
+// out of the boot module
+static int32_t exec_read_ramfs(const char* filename, uint8_t* load_addr, uint32_t* size) {
+    ramfs_file_t file;
+    if (!ramfs_open(filename, &file) || file.size == 0) {
+        exec_error("[EXEC] File not found: ", filename);
+        return EXEC_ERR_NOT_FOUND;
+    }
+    if (file.size > MAX_PROG_SIZE) {
+        exec_error("[EXEC] Program too large (max 1 MB)", "");
+        return EXEC_ERR_NO_MEM;
+    }
+    memcpy(load_addr, file.data, file.size);
+    *size = file.size;
+    return EXEC_OK;
+}
+
+#define EXEC_KSTACK_SIZE 16384
+
+// syscall_asm.asm
+extern void exec_enter_user(uint32_t entry, uint32_t esp) __attribute__((noreturn));
+extern void exec_user_return(void);
+
+// Kernel stack for the program's interrupts, faults and int 0x80
+static uint8_t exec_kstack[EXEC_KSTACK_SIZE] __attribute__((aligned(16)));
+
+// Where the program ends up: exec_call's frame, saved by __builtin_setjmp
+static void*   exec_jmp[5];
+static bool    exec_running = false;
+static bool    exec_killed;
+static int32_t exec_exit_code;
+
+static int32_t exec_call(uint32_t entry) {
+    // Returning from the entry point goes to a stub that calls SYS_EXIT
+    uint32_t* sp = (uint32_t*)PROG_STACK_TOP;
+    *--sp = (uint32_t)exec_user_return;
+
+    exec_running = true;
+    exec_killed = false;
+    keyboard_take_break();                  // Forget an old Ctrl+C
+    tss_set_kernel_stack((uint32_t)(exec_kstack + EXEC_KSTACK_SIZE));
+    syscall_user_mode = 1;
+    if (__builtin_setjmp(exec_jmp) == 0)
+        exec_enter_user(entry, (uint32_t)sp);
+
+    // Back from SYS_EXIT or a fault; the latter arrives with IF clear
+    __asm__ volatile ("sti");
+    syscall_user_mode = 0;
+    exec_running = false;
+    syscall_reset();
+    return exec_exit_code;
+}
+
+void exec_exit(int32_t code) {
+    if (!exec_running) return;
+    exec_exit_code = code;
+    __builtin_longjmp(exec_jmp, 1);
+}
+
+static void exec_kill(const char* what, const char* detail, uint32_t eip) {
+    vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
+    vga_print("\n[EXEC] Program killed: ");
+    vga_print(what);
+    vga_print(detail);
+    if (eip) {
+        vga_print(" at EIP ");
+        vga_print_hex(eip);
+    }
+    vga_putchar('\n');
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    exec_killed = true;
+    exec_exit(-1);
+}
+
+void exec_fault(const char* what, uint32_t eip) {
+    exec_kill(what, "", eip);
+}
+
+void exec_preempt(void) {
+    if (exec_running && keyboard_take_break()) exec_kill("Ctrl+C", "", 0);
+}
+
+static void exec_trace(const char* filename, const char* what) {
+    serial_print("[TRACE] exec ");
+    serial_print(filename);
+    serial_print(": ");
+    serial_print(what);
+}
+
+static exec_result_t exec_start(const char* filename, uint32_t entry) {
+    exec_result_t result;
+    result.exit_code = exec_call(entry);
+    result.error = exec_killed ? EXEC_ERR_KILLED : EXEC_OK;
+    if (trace_on(TRACE_EXEC)) {
+        int32_t code = result.exit_code;
+        exec_trace(filename, exec_killed ? "killed\n" : code < 0 ? "exit -" : "exit ");
+        if (!exec_killed) {
+            serial_print_dec(code < 0 ? (uint32_t)-code : (uint32_t)code);
+            serial_putchar('\n');
+        }
     }
+    return result;
+}
 
-    // Convert filename to 8.3 format
-    char name83[12];
-    fat_name_to_83(filename, name83);
-
-    // Load file from FAT
-    uint32_t size = fat_read_file(name83, prog_buf, MAX_PROG_SIZE);
-    if (size == 0) {
-        vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
-        vga_print("[EXEC] File not found: ");
-        vga_print(filename);
-        vga_print("\n");
-        vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-        result.error = EXEC_ERR_NOT_FOUND;
-        return result;
+exec_result_t exec_load(const char* filename) {
+    exec_result_t result = {0};
+    uint8_t* load_addr = (uint8_t*)PROG_LOAD_ADDR;
+    uint32_t size = 0;
+    uint64_t start = rdtsc();
+    pe_info_t pe;
+    bool cached = false;
+
+    // FAT programs are cached by directory entry (imgcache.c); the ramfs
+    // already holds its files in memory
+    fat_dir_entry_t dirent;
+    fat_loc_t loc;
+    bool cacheable = false;
+
+    if (fat_is_mounted()) {
+        cacheable = fat_locate(filename, &dirent, &loc) && !(dirent.attrs & FAT_ATTR_SUBDIR);
+        cached = cacheable && imgcache_lookup(&dirent, loc, load_addr, &size, &pe);
+        if (!cached) result.error = exec_read_fat(filename, load_addr, &size);
+    } else if (ramfs_is_mounted()) {
+        result.error = exec_read_ramfs(filename, load_addr, &size);
+    } else {
+        exec_error("[EXEC] Filesystem not mounted!", "");
+        result.error = EXEC_ERR_NO_FS;
     }
+    if (result.error != EXEC_OK) return result;
 
     vga_print("[EXEC] Loaded ");
     vga_print(filename);
     vga_print(" (");
     vga_print_dec(size);
-    vga_print(" bytes)\n");
+    vga_print(cached ? " bytes, cached)\n" : " bytes)\n");
 
     // Check for MZ/PE header
-    mz_header_t* mz = (mz_header_t*)prog_buf;
-
-    if (mz->magic == MZ_MAGIC && size >= sizeof(mz_header_t)) {
-        // Check for PE
-        uint32_t pe_offset = mz->e_lfanew;
-        if (pe_offset + sizeof(pe_file_header_t) + 4 < size) {
-            uint32_t* pe_sig = (uint32_t*)(prog_buf + pe_offset);
-            if (*pe_sig == PE_MAGIC) {
-                pe_file_header_t* pef = (pe_file_header_t*)(prog_buf + pe_offset);
-                pe_opt_header_t* peo = (pe_opt_header_t*)(prog_buf + pe_offset + sizeof(pe_file_header_t));
-
-                if (pef->machine != 0x014C) {
-                    vga_print("[EXEC] Not an x86 PE binary!\n");
-                    result.error = EXEC_ERR_BAD_FORMAT;
-                    return result;
-                }
-
-                // Copy to load address
-                uint8_t* load_addr = (uint8_t*)PROG_LOAD_ADDR;
-                memcpy(load_addr, prog_buf, size);
-
-                uint32_t entry = peo->image_base + peo->entry_point;
-
-                vga_print("[EXEC] PE entry point: ");
-                vga_print_hex(entry);
-                vga_print("\n[EXEC] Executing...\n");
-
-                // Execute the program (call as function)
-                typedef int (*prog_func_t)(void);
-                prog_func_t prog = (prog_func_t)entry;
-                result.exit_code = prog();
-                result.error = EXEC_OK;
-                return result;
-            }
+    if (!cached) {
+        int rc = pe_parse(load_addr, size, &pe);
+        if (rc == PE_ERR_NOT_X86) {
+            vga_print("[EXEC] Not an x86 PE binary!\n");
+            result.error = EXEC_ERR_BAD_FORMAT;
+            return result;
+        }
+        if (rc != PE_OK) {
+            vga_print("[EXEC] MZ but no PE header - not supported\n");
+            result.error = EXEC_ERR_BAD_FORMAT;
+            return result;
         }
-        vga_print("[EXEC] MZ but no PE header - not supported\n");
-        result.error = EXEC_ERR_BAD_FORMAT;
-        return result;
+        // Keep the image as loaded, before the program can change it
+        if (cacheable) imgcache_insert(&dirent, loc, load_addr, size, &pe);
+    }
+    if (trace_on(TRACE_EXEC)) {
+        exec_trace(filename, cached ? "cached, " : cacheable ? "read from FAT, " : "read from ramfs, ");
+        serial_print_dec(size);
+        serial_print(" bytes, ");
+        serial_print_dec((uint32_t)udiv64(rdtsc() - start, 1000));
+        serial_print(" kcycles\n");
     }
 
-    // Treat as flat binary - copy and execute
-    uint8_t* load_addr = (uint8_t*)PROG_LOAD_ADDR;
-    memcpy(load_addr, prog_buf, size);
+    if (pe.kind == PE_KIND_PE32) {
+        uint32_t entry = pe.image_base + pe.entry_rva;
+
+        vga_print("[EXEC] PE entry point: ");
+        vga_print_hex(entry);
+        vga_print("\n[EXEC] Executing...\n");
 
+        // Execute the program in ring 3
+        return exec_start(filename, entry);
+    }
+
+    // Treat as flat binary - already in place, execute
     vga_print("[EXEC] Flat binary, executing at ");
     vga_print_hex(PROG_LOAD_ADDR);
     vga_print("\n");
 
-    typedef int (*prog_func_t)(void);
-    prog_func_t prog = (prog_func_t)PROG_LOAD_ADDR;
-    result.exit_code = prog();
-    result.error = EXEC_OK;
-    return result;
+    return exec_start(filename, PROG_LOAD_ADDR);
 }
@@ -3,11 +3,22 @@
 #define EXEC_H
 #include "kernel.h"
 
+// Load address for user programs
+#define PROG_LOAD_ADDR 0x400000    // 4 MB
+
+#define MAX_PROG_SIZE (1024 * 1024)   // 1 MB max program
+
+// Program stack, right above the largest program
+#define PROG_STACK_SIZE (256 * 1024)
+#define PROG_STACK_TOP  (PROG_LOAD_ADDR + MAX_PROG_SIZE + PROG_STACK_SIZE)
+#define PROG_AREA_END   PROG_STACK_TOP
+
 #define EXEC_OK             0
 #define EXEC_ERR_NOT_FOUND  1
 #define EXEC_ERR_BAD_FORMAT 2
 #define EXEC_ERR_NO_FS      3
 #define EXEC_ERR_NO_MEM     4
+#define EXEC_ERR_KILLED     5   // Crashed or interrupted (Ctrl+C)
 
 typedef struct {
     int32_t exit_code;
@@ -15,4 +26,11 @@ typedef struct {
 } exec_result_t;
 
 exec_result_t exec_load(const char* filename);
+// End the running program with `code` (SYS_EXIT); returns only when no
+// program is running
+void exec_exit(int32_t code);
+// A ring 3 program faulted (isr_handler): report it and end it
+void exec_fault(const char* what, uint32_t eip);
+// An IRQ interrupted the program: end it if Ctrl+C was pressed
+void exec_preempt(void);
 #endif
@@ -3,10 +3,11 @@
 #include "gdt.h"
 #include "kernel.h"
 
-#define GDT_ENTRIES 5
+#define GDT_ENTRIES 6
 
 static gdt_entry_t gdt[GDT_ENTRIES];
 static gdt_ptr_t   gdt_ptr;
+static tss_t       tss;
 
 extern void gdt_flush(uint32_t);
 
@@ -30,6 +31,17 @@ void gdt_init(void) {
     gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);   // Kernel data
     gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);   // User code
     gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);   // User data
+    gdt_set_gate(5, (uint32_t)&tss, sizeof(tss_t) - 1, 0x89, 0x00);  // TSS (32-bit, available)
+
+    // No I/O permission bitmap: in/out from ring 3 fault
+    memset(&tss, 0, sizeof(tss_t));
+    tss.ss0 = GDT_KERNEL_DATA;
+    tss.iomap_base = sizeof(tss_t);
 
     gdt_flush((uint32_t)&gdt_ptr);
+    __asm__ volatile ("ltr %0" : : "r"((uint16_t)GDT_TSS));
+}
+
+void tss_set_kernel_stack(uint32_t esp0) {
+    tss.esp0 = esp0;
 }
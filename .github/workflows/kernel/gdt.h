@@ -17,5 +17,29 @@ typedef struct {
     uint32_t base;
 } __attribute__((packed)) gdt_ptr_t;
 
+// Task state segment: only esp0/ss0 are used, the stack the CPU switches
+// to when an interrupt or fault arrives from ring 3
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+// Selectors (GDT index * 8 | RPL)
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x1B
+#define GDT_USER_DATA   0x23
+#define GDT_TSS         0x28
+
 void gdt_init(void);
+// Kernel stack for the running program's interrupts, faults and int 0x80
+void tss_set_kernel_stack(uint32_t esp0);
 #endif
@@ -3,6 +3,7 @@
 #include "idt.h"
 #include "kernel.h"
 #include "vga.h"
+#include "exec.h"
 
 #define IDT_ENTRIES 256
 
@@ -67,15 +68,11 @@ static const char* exception_names[] = {
 // IRQ handler table
 static irq_handler_t irq_handlers[16];
 
-// Register CPU state for interrupt handler
-typedef struct {
-    uint32_t ds;
-    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
-    uint32_t int_no, err_code;
-    uint32_t eip, cs, eflags, useresp, ss;
-} registers_t;
-
 void isr_handler(registers_t regs) {
+    // A program crashed: end it and go back to the shell
+    if (regs.int_no < 32 && (regs.cs & 3) == 3)
+        exec_fault(exception_names[regs.int_no], regs.eip);
+
     if (regs.int_no < 32) {
         vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_RED);
         vga_print("\n[EXCEPTION] ");
@@ -98,6 +95,9 @@ void irq_handler(registers_t regs) {
     }
 
     pic_send_eoi(irq);
+
+    // Interrupted a program: it may have been asked to stop
+    if ((regs.cs & 3) == 3) exec_preempt();
 }
 
 void irq_install_handler(uint8_t irq, irq_handler_t handler) {
@@ -108,6 +108,10 @@ void irq_uninstall_handler(uint8_t irq) {
     irq_handlers[irq] = 0;
 }
 
+void idt_set_handler(uint8_t num, void (*stub)(void), uint8_t flags) {
+    idt_set_gate(num, (uint32_t)stub, 0x08, flags);
+}
+
 void idt_init(void) {
     idt_ptr.limit = sizeof(idt_entry_t) * IDT_ENTRIES - 1;
     idt_ptr.base  = (uint32_t)&idt;
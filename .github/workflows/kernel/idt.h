@@ -28,5 +28,7 @@ typedef void (*irq_handler_t)(registers_t*);
 void idt_init(void);
 void irq_install_handler(uint8_t irq, irq_handler_t handler);
 void irq_uninstall_handler(uint8_t irq);
+// Point vector `num` at an assembly stub (flags: type and DPL, e.g. 0xEF)
+void idt_set_handler(uint8_t num, void (*stub)(void), uint8_t flags);
 
 #endif
@@ -0,0 +1,158 @@
+// imgcache.c - Resident cache of prepared program images
+//
+// Loading a program reads the whole file through the filesystem and parses
+// its headers. The result, the image as it sits at the load address before
+// the program first runs, is kept here in a heap copy together with the
+// parsed header, so launching the same program again is one memcpy with no
+// disk access and no parsing.
+//
+// An image is keyed by where its directory entry is stored and validated
+// against the entry's first cluster, size and modification time, all of
+// which the directory index answers from memory. FAT writes do not set
+// the modification time (there is no clock), so the filesystem also
+// reports every rewritten entry through fat_set_change_hook() and the
+// image for it is dropped. Images are evicted in least recently used order
+// when the byte budget or the heap runs out.
+
+#include "imgcache.h"
+#include "kernel.h"
+#include "kmem.h"
+
+typedef struct {
+    bool      used;
+    fat_loc_t loc;
+    uint32_t  first_cluster;
+    uint32_t  size;
+    uint16_t  modify_time;
+    uint16_t  modify_date;
+    pe_info_t pe;
+    uint8_t*  image;
+    uint32_t  last_use;
+} imgcache_entry_t;
+
+static imgcache_entry_t ic_entries[IMGCACHE_MAX_ENTRIES];
+static uint32_t         ic_clock = 0;
+static imgcache_stats_t ic_stats;
+
+static uint32_t ic_cluster(const fat_dir_entry_t* e) {
+    return ((uint32_t)e->start_cluster_hi << 16) | e->start_cluster_lo;
+}
+
+static void ic_free(imgcache_entry_t* c) {
+    if (!c->used) return;
+    kfree(c->image);
+    ic_stats.entries--;
+    ic_stats.bytes -= c->size;
+    memset(c, 0, sizeof(*c));
+}
+
+static imgcache_entry_t* ic_find(fat_loc_t loc) {
+    for (uint32_t i = 0; i < IMGCACHE_MAX_ENTRIES; i++) {
+        imgcache_entry_t* c = &ic_entries[i];
+        if (c->used && c->loc.dir == loc.dir && c->loc.slot == loc.slot) return c;
+    }
+    return NULL;
+}
+
+// Least recently used entry, or a free one; NULL when the cache is empty
+// and `want_free` is false
+static imgcache_entry_t* ic_victim(bool want_free) {
+    imgcache_entry_t* victim = NULL;
+    for (uint32_t i = 0; i < IMGCACHE_MAX_ENTRIES; i++) {
+        imgcache_entry_t* c = &ic_entries[i];
+        if (!c->used) {
+            if (want_free) return c;
+            continue;
+        }
+        if (!victim || c->last_use < victim->last_use) victim = c;
+    }
+    return victim;
+}
+
+static bool ic_evict_one(void) {
+    imgcache_entry_t* c = ic_victim(false);
+    if (!c) return false;
+    ic_free(c);
+    ic_stats.evictions++;
+    return true;
+}
+
+static void ic_on_change(const fat_loc_t* loc) {
+    imgcache_invalidate(loc);
+}
+
+void imgcache_init(void) {
+    imgcache_invalidate(NULL);
+    ic_stats.budget = kmem_total_bytes() / 4;
+    if (ic_stats.budget > IMGCACHE_MAX_BYTES) ic_stats.budget = IMGCACHE_MAX_BYTES;
+    fat_set_change_hook(ic_on_change);
+}
+
+bool imgcache_lookup(const fat_dir_entry_t* entry, fat_loc_t loc, uint8_t* dest,
+                     uint32_t* size, pe_info_t* pe) {
+    imgcache_entry_t* c = ic_find(loc);
+    if (!c) {
+        ic_stats.misses++;
+        return false;
+    }
+    if (c->first_cluster != ic_cluster(entry) || c->size != entry->file_size ||
+        c->modify_time != entry->modify_time || c->modify_date != entry->modify_date) {
+        ic_free(c);
+        ic_stats.invalidations++;
+        ic_stats.misses++;
+        return false;
+    }
+
+    memcpy(dest, c->image, c->size);
+    *size = c->size;
+    *pe = c->pe;
+    c->last_use = ++ic_clock;
+    ic_stats.hits++;
+    return true;
+}
+
+void imgcache_insert(const fat_dir_entry_t* entry, fat_loc_t loc, const uint8_t* image,
+                     uint32_t size, const pe_info_t* pe) {
+    if (!size || size > ic_stats.budget) return;
+
+    imgcache_entry_t* old = ic_find(loc);
+    if (old) ic_free(old);
+    while (ic_stats.bytes + size > ic_stats.budget)
+        if (!ic_evict_one()) return;
+
+    // Under heap pressure older images give way to the new one
+    uint8_t* copy;
+    while (!(copy = kmalloc(size)))
+        if (!ic_evict_one()) return;
+
+    imgcache_entry_t* c = ic_victim(true);
+    if (c->used) {
+        ic_free(c);
+        ic_stats.evictions++;
+    }
+    memcpy(copy, image, size);
+    c->used          = true;
+    c->loc           = loc;
+    c->first_cluster = ic_cluster(entry);
+    c->size          = size;
+    c->modify_time   = entry->modify_time;
+    c->modify_date   = entry->modify_date;
+    c->pe            = *pe;
+    c->image         = copy;
+    c->last_use      = ++ic_clock;
+    ic_stats.entries++;
+    ic_stats.bytes += size;
+}
+
+void imgcache_invalidate(const fat_loc_t* loc) {
+    for (uint32_t i = 0; i < IMGCACHE_MAX_ENTRIES; i++) {
+        imgcache_entry_t* c = &ic_entries[i];
+        if (!c->used || (loc && (c->loc.dir != loc->dir || c->loc.slot != loc->slot))) continue;
+        ic_free(c);
+        ic_stats.invalidations++;
+    }
+}
+
+void imgcache_get_stats(imgcache_stats_t* st) {
+    *st = ic_stats;
+}
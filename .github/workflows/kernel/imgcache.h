@@ -0,0 +1,35 @@
+// imgcache.h - Resident cache of prepared program images
+#ifndef IMGCACHE_H
+#define IMGCACHE_H
+#include "kernel.h"
+#include "pe.h"
+#include "../fs/fat.h"
+
+#define IMGCACHE_MAX_ENTRIES 8
+#define IMGCACHE_MAX_BYTES   (4 * 1024 * 1024)  // Lowered to a quarter of a small heap
+
+typedef struct {
+    uint32_t entries;
+    uint32_t bytes;             // Image bytes held
+    uint32_t budget;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;         // Dropped to make room
+    uint32_t invalidations;     // Dropped because the file changed
+} imgcache_stats_t;
+
+// Size the budget from the heap and watch the FAT volume for changes
+void imgcache_init(void);
+// Image of the file whose directory entry `entry` is stored at `loc`:
+// copies it to `dest` and fills `pe`. False when not cached or when the
+// entry (first cluster, size, modification time) no longer matches.
+bool imgcache_lookup(const fat_dir_entry_t* entry, fat_loc_t loc, uint8_t* dest,
+                     uint32_t* size, pe_info_t* pe);
+// Keep a copy of a freshly loaded and parsed image, evicting the least
+// recently used ones to stay within budget. Best effort.
+void imgcache_insert(const fat_dir_entry_t* entry, fat_loc_t loc, const uint8_t* image,
+                     uint32_t size, const pe_info_t* pe);
+// Drop the image stored for `loc`, or every image when NULL
+void imgcache_invalidate(const fat_loc_t* loc);
+void imgcache_get_stats(imgcache_stats_t* st);
+#endif
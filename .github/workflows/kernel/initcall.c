@@ -0,0 +1,152 @@
+// initcall.c - Dependency-ordered, partly asynchronous init
+//
+// kernel_main hands over a table of init steps. Each names the steps it
+// must follow; the runner starts a step once all of those have finished
+// (a failed step still counts as finished, so e.g. the FAT mount runs
+// whether or not the ATA probe found a disk).
+//
+// Foreground steps run before the shell. Background steps are left to
+// initcall_poll(), which the shell calls while it waits for keys, so the
+// prompt is up as soon as the console and keyboard are. There are no
+// threads: a background step runs to completion when polled, except those
+// with a poll() hook (e.g. the mouse), which are interrupt-driven state
+// machines and only get checked on each step.
+
+#include "initcall.h"
+#include "kernel.h"
+#include "vga.h"
+#include "boottime.h"
+#include "trace.h"
+#include "../drivers/serial.h"
+
+static initcall_t* ic_calls = NULL;
+static uint32_t    ic_count = 0;
+static bool        ic_all_done = false;
+
+static initcall_t* ic_find(const char* name) {
+    for (uint32_t i = 0; i < ic_count; i++)
+        if (strcmp(ic_calls[i].name, name) == 0) return &ic_calls[i];
+    return NULL;
+}
+
+static bool ic_finished(const initcall_t* ic) {
+    return ic->state == INITCALL_DONE || ic->state == INITCALL_FAILED;
+}
+
+static bool ic_ready(const initcall_t* ic) {
+    for (uint32_t d = 0; d < INITCALL_MAX_DEPS && ic->deps[d]; d++) {
+        initcall_t* dep = ic_find(ic->deps[d]);
+        if (dep && !ic_finished(dep)) return false;     // Unknown names are ignored
+    }
+    return true;
+}
+
+static void ic_trace(const initcall_t* ic) {
+    static const char* const states[] = { "pending", "running", "done", "failed" };
+    serial_print("[TRACE] init ");
+    serial_print(ic->name);
+    serial_print(": ");
+    serial_print(states[ic->state]);
+    serial_print(", ");
+    serial_print_dec((uint32_t)udiv64(rdtsc() - ic->started, 1000));
+    serial_print(" kcycles\n");
+}
+
+static void ic_start(initcall_t* ic) {
+    ic->started = rdtsc();
+    bool ok = ic->start();
+    ic->state = !ok ? INITCALL_FAILED : ic->poll ? INITCALL_RUNNING : INITCALL_DONE;
+    // Async calls are timed until poll() reports the outcome
+    if (ic->state != INITCALL_RUNNING) boot_record(ic->name, ic->started);
+    if (trace_on(TRACE_INIT)) ic_trace(ic);
+}
+
+// Check the async calls that are still running. poll() hooks do not
+// print; a failure is reported here.
+static bool ic_poll_running(void (*before)(void)) {
+    bool progress = false;
+    for (uint32_t i = 0; i < ic_count; i++) {
+        initcall_t* ic = &ic_calls[i];
+        if (ic->state != INITCALL_RUNNING) continue;
+        initcall_state_t st = ic->poll();
+        if (st == INITCALL_RUNNING) continue;
+        ic->state = st;
+        boot_record(ic->name, ic->started);
+        if (trace_on(TRACE_INIT)) ic_trace(ic);
+        if (st == INITCALL_FAILED) {
+            if (before) before();
+            vga_print("[INIT] ");
+            vga_print(ic->name);
+            vga_print(" not responding\n");
+        }
+        progress = true;
+    }
+    return progress;
+}
+
+void initcall_run(initcall_t* calls, uint32_t count) {
+    ic_calls = calls;
+    ic_count = count;
+    ic_all_done = false;
+    for (uint32_t i = 0; i < count; i++) calls[i].state = INITCALL_PENDING;
+
+    for (;;) {
+        bool waiting = false, progress = ic_poll_running(NULL);
+        for (uint32_t i = 0; i < count; i++) {
+            initcall_t* ic = &calls[i];
+            if (ic->background) continue;
+            if (ic->state == INITCALL_RUNNING) waiting = true;
+            if (ic->state != INITCALL_PENDING) continue;
+            if (!ic_ready(ic)) {
+                waiting = true;
+                continue;
+            }
+            ic_start(ic);
+            progress = true;
+        }
+        if (!waiting) break;
+        if (!progress && !ic_poll_running(NULL)) {
+            // Everything left waits on a background call: a table bug
+            for (uint32_t i = 0; i < count; i++) {
+                if (calls[i].background || ic_finished(&calls[i])) continue;
+                if (calls[i].state == INITCALL_RUNNING) continue;
+                vga_print("[INIT] Unmet dependency: ");
+                vga_print(calls[i].name);
+                vga_putchar('\n');
+                calls[i].state = INITCALL_FAILED;
+            }
+        }
+    }
+}
+
+bool initcall_poll(void (*before)(void)) {
+    if (ic_poll_running(before)) return true;
+
+    bool left = false;
+    for (uint32_t i = 0; i < ic_count; i++) {
+        initcall_t* ic = &ic_calls[i];
+        if (ic->state == INITCALL_RUNNING) left = true;
+        if (ic->state != INITCALL_PENDING) continue;
+        left = true;
+        if (!ic_ready(ic)) continue;
+        if (before) before();
+        ic_start(ic);
+        return true;
+    }
+    if (!left && !ic_all_done) {
+        ic_all_done = true;
+        if (before) before();
+        vga_print("[INIT] All systems nominal!\n");
+        boot_done();
+    }
+    return false;
+}
+
+bool initcall_all_done(void) {
+    return ic_all_done;
+}
+
+initcall_state_t initcall_state(const char* name) {
+    initcall_t* ic = ic_find(name);
+    return ic ? ic->state : INITCALL_FAILED;
+}
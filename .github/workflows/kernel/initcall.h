@@ -0,0 +1,42 @@
+// initcall.h - Dependency-ordered, partly asynchronous init
+#ifndef INITCALL_H
+#define INITCALL_H
+#include "kernel.h"
+
+#define INITCALL_MAX_DEPS 6
+
+typedef enum {
+    INITCALL_PENDING,
+    INITCALL_RUNNING,           // Started, poll() not finished yet
+    INITCALL_DONE,
+    INITCALL_FAILED,
+} initcall_state_t;
+
+typedef struct {
+    const char* name;
+    // Calls that must have finished (done or failed) before this one starts
+    const char* deps[INITCALL_MAX_DEPS];
+    // Synchronous part; false = failed
+    bool      (*start)(void);
+    // Optional, for interrupt-driven probes: INITCALL_RUNNING until the
+    // device is ready, then INITCALL_DONE or INITCALL_FAILED
+    initcall_state_t (*poll)(void);
+    // May finish after the shell is up (see initcall_poll())
+    bool        background;
+
+    initcall_state_t state;     // Owned by the runner
+    uint64_t    started;        // TSC
+} initcall_t;
+
+// Run every foreground call in dependency order and wait for them; the
+// table must stay valid for the background calls
+void initcall_run(initcall_t* calls, uint32_t count);
+// One step of background init: finishes an async call or starts the next
+// ready one. `before` (may be NULL) is called first whenever the step may
+// print, so the caller can get its own output out of the way. Returns
+// false when it did nothing: all done, or only waiting on interrupts.
+bool initcall_poll(void (*before)(void));
+// Every call has finished, background ones included
+bool initcall_all_done(void);
+initcall_state_t initcall_state(const char* name);
+#endif
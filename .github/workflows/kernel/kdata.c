@@ -0,0 +1,71 @@
+// kdata.c - Kernel data page shared with programs
+//
+// One page-aligned page that programs read directly (user/kdata.h) to
+// get the time without entering the kernel. There is no paging yet, so
+// "read-only" is by contract; the page is kept apart from other kernel
+// data so it can be mapped read-only into programs once there is.
+//
+// Writers bracket each update with two increments of `seq` (a seqlock).
+// All writes happen in the timer interrupt or with interrupts off, so
+// there is only ever one writer.
+
+#include "kdata.h"
+#include "kernel.h"
+#include "../drivers/timer.h"
+
+#define KDATA_NS_SHIFT 22
+
+static union {
+    myos_kdata_t kd;
+    uint8_t      page[4096];
+} kdata __attribute__((aligned(4096)));
+
+#define kd_barrier() __asm__ volatile ("" ::: "memory")
+
+static inline void kd_write_begin(void) {
+    kdata.kd.seq++;
+    kd_barrier();
+}
+
+static inline void kd_write_end(void) {
+    kd_barrier();
+    kdata.kd.seq++;
+}
+
+void kdata_tick(uint32_t ticks) {
+    kd_write_begin();
+    kdata.kd.ticks    = ticks;
+    kdata.kd.tick_tsc = rdtsc();
+    kd_write_end();
+}
+
+void kdata_set_rate(uint32_t hz) {
+    bool irq = interrupts_enabled();
+    __asm__ volatile ("cli");
+    kd_write_begin();
+    kdata.kd.version     = MYOS_KDATA_VERSION;
+    kdata.kd.tick_hz     = hz;
+    kdata.kd.ns_per_tick = hz ? 1000000000u / hz : 0;
+    kd_write_end();
+    if (irq) __asm__ volatile ("sti");
+}
+
+bool kdata_calibrate(void) {
+    uint32_t khz = timer_tsc_khz();     // Measures once, 10 ms
+    // ns per cycle in 22-bit fixed point: fits 32 bits down to ~1 MHz
+    uint32_t mult = khz ? (uint32_t)udiv64(1000000ull << KDATA_NS_SHIFT, khz) : 0;
+
+    bool irq = interrupts_enabled();
+    __asm__ volatile ("cli");
+    kd_write_begin();
+    kdata.kd.tsc_khz     = khz;
+    kdata.kd.ns_mult     = mult;
+    kdata.kd.ns_shift    = KDATA_NS_SHIFT;
+    kd_write_end();
+    if (irq) __asm__ volatile ("sti");
+    return khz != 0;
+}
+
+const myos_kdata_t* kdata_get(void) {
+    return &kdata.kd;
+}
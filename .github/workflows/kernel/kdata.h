@@ -0,0 +1,15 @@
+// kdata.h - Kernel data page shared with programs
+#ifndef KDATA_H
+#define KDATA_H
+#include "kernel.h"
+#include "../user/kdata.h"
+
+// Timer interrupt: publish the new tick count and its TSC
+void kdata_tick(uint32_t ticks);
+// Timer started at `hz`: tick resolution is available from now on
+void kdata_set_rate(uint32_t hz);
+// Fill in the TSC rate (measures it if not done yet)
+bool kdata_calibrate(void);
+// Address handed to programs (SYS_KDATA)
+const myos_kdata_t* kdata_get(void);
+#endif
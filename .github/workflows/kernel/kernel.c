@@ -4,67 +4,276 @@
 #include "gdt.h"
 #include "idt.h"
 #include "vga.h"
+#include "kmem.h"
+#include "boottime.h"
+#include "initcall.h"
+#include "syscall.h"
+#include "kdata.h"
+#include "imgcache.h"
+#include "cmdline.h"
+#include "trace.h"
 #include "../drivers/keyboard.h"
 #include "../drivers/mouse.h"
 #include "../drivers/timer.h"
+#include "../drivers/ata.h"
+#include "../drivers/ahci.h"
+#include "../drivers/virtio_blk.h"
+#include "../drivers/ramdisk.h"
+#include "../drivers/pci.h"
+#include "../drivers/serial.h"
 #include "../fs/fat.h"
+#include "../fs/bcache.h"
 #include "../shell/shell.h"
 
 // Multiboot magic number
 #define MULTIBOOT_MAGIC 0x2BADB002
+#define MULTIBOOT_FLAG_MEM  0x001
+#define MULTIBOOT_FLAG_CMDLINE 0x004
 
-void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
-    // Initialize VGA text mode first
-    vga_init();
-    vga_clear();
+// Kernel heap starts above the program load area (exec.c: 4 MB + 1 MB)
+#define KHEAP_START 0x800000
 
-    vga_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-    vga_print("  __  __       ___  ____  \n");
-    vga_print(" |  \\/  |_   _/ _ \\/ ___| \n");
-    vga_print(" | |\\/| | | | | | | |     \n");
-    vga_print(" | |  | | |_| | |_| | |__ \n");
-    vga_print(" |_|  |_|\\__, |\\___/ \\____|\n");
-    vga_print("          |___/             \n");
-    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-    vga_print("\n  MyOS v0.1 - x86 32-bit\n\n");
+static multiboot_info_t* boot_mbi;
+static blkdev_t* ramdisk = NULL;
+static bool have_disk = false;
 
-    // Verify multiboot
-    if (magic != MULTIBOOT_MAGIC) {
-        vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
-        vga_print("[PANIC] Not booted by a Multiboot-compliant bootloader!\n");
-        for(;;) __asm__("hlt");
+// Boot parameters: defaults here, overridden on the GRUB "multiboot" line
+// (cmdline.c), e.g. "hz=1000 console=both trace=exec,syscall"
+#define CONSOLE_VGA     0
+#define CONSOLE_SERIAL  1
+#define CONSOLE_BOTH    2
+
+static uint32_t boot_hz = 100;
+static uint32_t boot_console = CONSOLE_VGA;
+static uint32_t boot_bcache_kb = 0;                     // 0 = sized from the free heap
+static uint32_t boot_readahead_kb = FAT_RA_DEFAULT / 1024;
+static char     boot_autorun[256];
+static char     boot_script[128];
+uint32_t        trace_mask = 0;                         // trace.h
+
+static cmdline_param_t boot_params[] = {
+    { .name = "hz",        .type = CMDLINE_UINT,   .value = &boot_hz, .min = 20, .max = 1000,
+      .help = "Timer ticks per second" },
+    { .name = "console",   .type = CMDLINE_CHOICE, .value = &boot_console,
+      .choices = { "vga", "serial", "both" }, .help = "Where console output goes" },
+    { .name = "bcache",    .type = CMDLINE_UINT,   .value = &boot_bcache_kb, .max = 256 * 1024,
+      .help = "Buffer cache size in KB (0 = auto, at least 128)" },
+    { .name = "readahead", .type = CMDLINE_UINT,   .value = &boot_readahead_kb, .max = 4096,
+      .help = "Read-ahead window per file in KB (0 = off)" },
+    { .name = "trace",     .type = CMDLINE_FLAGS,  .value = &trace_mask,
+      .choices = { "init", "syscall", "exec" }, .help = "Trace groups sent to serial" },
+    { .name = "autorun",   .type = CMDLINE_STRING, .value = boot_autorun,
+      .max = sizeof(boot_autorun), .help = "Shell commands run after boot, ';' between" },
+    { .name = "script",    .type = CMDLINE_STRING, .value = boot_script,
+      .max = sizeof(boot_script), .help = "File of shell commands run after boot" },
+};
+
+// Parse the command line and apply what must be in place before the init
+// steps; the rest is read by the steps themselves
+static void boot_parse_cmdline(bool have_serial) {
+    const char* line = boot_mbi->flags & MULTIBOOT_FLAG_CMDLINE ?
+                       (const char*)boot_mbi->cmdline : NULL;
+    cmdline_parse(line, boot_params, sizeof(boot_params) / sizeof(boot_params[0]));
+
+    fat_set_readahead(boot_readahead_kb * 1024);
+    if (boot_console == CONSOLE_VGA) return;
+    if (!have_serial) {
+        vga_print("[BOOT] No serial port, console stays on screen\n");
+        return;
     }
+    if (boot_console == CONSOLE_SERIAL) vga_print("[BOOT] Console moved to serial\n");
+    vga_set_output(boot_console == CONSOLE_BOTH, serial_putchar);
+}
 
-    // Initialize core systems
+// Kernel heap: everything between KHEAP_START and the top of upper
+// memory, minus any boot modules GRUB placed up there
+static bool init_heap(void) {
+    if (!(boot_mbi->flags & MULTIBOOT_FLAG_MEM)) return false;
+    uint32_t mem_top = 0x100000 + boot_mbi->mem_upper * 1024;
+    uint32_t heap = KHEAP_START;
+    uint32_t mods_end = ramdisk_modules_end(boot_mbi);
+    if (mods_end > heap) heap = (mods_end + 0xFFF) & ~0xFFFu;
+    if (mem_top <= heap) return false;
+    kmem_init((void*)heap, mem_top - heap);
+    return true;
+}
+
+static bool init_gdt(void) {
     vga_print("[INIT] Setting up GDT...\n");
     gdt_init();
+    return true;
+}
 
+static bool init_idt(void) {
     vga_print("[INIT] Setting up IDT & ISRs...\n");
     idt_init();
+    return true;
+}
+
+static bool init_syscalls(void) {
+    vga_print("[INIT] Setting up system calls...\n");
+    syscall_init();
+    if (syscall_fast_available()) vga_print("[INIT] SYSENTER fast path enabled\n");
+    return true;
+}
 
+static bool init_pic(void) {
     vga_print("[INIT] Setting up PIC...\n");
     pic_remap(0x20, 0x28);
+    return true;
+}
 
+static bool init_timer(void) {
     vga_print("[INIT] Setting up Timer (PIT)...\n");
-    timer_init(100);    // 100 Hz
+    timer_init(boot_hz);
+    return true;
+}
+
+static bool init_kdata(void) {
+    return kdata_calibrate();           // 10 ms TSC measurement
+}
 
+static bool init_imgcache(void) {
+    imgcache_init();
+    return true;
+}
+
+static bool init_keyboard(void) {
     vga_print("[INIT] Setting up PS/2 Keyboard...\n");
     keyboard_init();
+    return true;
+}
 
+static bool init_mouse(void) {
     vga_print("[INIT] Setting up PS/2 Mouse...\n");
-    mouse_init();
+    return mouse_start();
+}
 
+static bool init_pci(void) {
+    vga_print("[INIT] Scanning PCI bus...\n");
+    pci_init();
+    return true;
+}
+
+static bool init_ramdisk(void) {
+    vga_print("[INIT] Setting up RAM disk...\n");
+    ramdisk = ramdisk_init(boot_mbi);
+    return ramdisk != NULL;
+}
+
+static bool init_ata(void) {
+    vga_print("[INIT] Setting up ATA disk...\n");
+    if (!ata_init()) return false;
+    have_disk = true;
+    return true;
+}
+
+static bool init_ahci(void) {
+    vga_print("[INIT] Setting up AHCI controller...\n");
+    if (!ahci_init()) return false;
+    have_disk = true;
+    return true;
+}
+
+static bool init_virtio_blk(void) {
+    vga_print("[INIT] Setting up virtio block devices...\n");
+    if (!virtio_blk_init()) return false;
+    have_disk = true;
+    return true;
+}
+
+static bool init_bcache(void) {
+    vga_print("[INIT] Setting up buffer cache...\n");
+    uint32_t nbufs = bcache_default_size();
+    if (boot_bcache_kb) {
+        nbufs = boot_bcache_kb * 2;
+        if (nbufs < BCACHE_MIN_BUFS) nbufs = BCACHE_MIN_BUFS;
+    }
+    if (bcache_init(nbufs)) return true;
+    vga_print("[INIT] Not enough memory, disk reads are uncached\n");
+    return false;
+}
+
+static bool init_fat(void) {
     vga_print("[INIT] Setting up FAT filesystem...\n");
-    // fat_init() would need ATA driver; placeholder for now
-    // fat_init();
+    // A FAT image passed as a boot module is the root; else the first disk
+    if (ramdisk)   return fat_mount(ramdisk);
+    if (have_disk) return fat_init();
+    return false;
+}
+
+// Init steps and what each must follow. The foreground ones bring up the
+// console and keyboard and run before the shell; the rest (mouse
+// handshake, bus scan, disk probes, mount) run in the background while
+// the shell waits for input, each as soon as its dependencies are done.
+static initcall_t init_table[] = {
+    { .name = "Heap",         .start = init_heap },
+    { .name = "GDT",          .start = init_gdt },
+    { .name = "IDT",          .start = init_idt,        .deps = { "GDT" } },
+    { .name = "Syscalls",     .start = init_syscalls,   .deps = { "GDT", "IDT" } },
+    { .name = "PIC",          .start = init_pic,        .deps = { "IDT" } },
+    { .name = "Timer",        .start = init_timer,      .deps = { "PIC" } },
+    { .name = "Keyboard",     .start = init_keyboard,   .deps = { "PIC" } },
+    { .name = "Kernel data",  .start = init_kdata,      .deps = { "Timer" },
+      .background = true },
+    { .name = "Mouse",        .start = init_mouse,      .deps = { "Keyboard", "Timer" },
+      .poll = mouse_poll, .background = true },
+    { .name = "PCI",          .start = init_pci,        .background = true },
+    { .name = "RAM disk",     .start = init_ramdisk,    .deps = { "Heap" },
+      .background = true },
+    { .name = "ATA",          .start = init_ata,        .deps = { "Timer", "PCI" },
+      .background = true },
+    { .name = "AHCI",         .start = init_ahci,       .deps = { "PCI", "Heap", "Timer" },
+      .background = true },
+    { .name = "virtio-blk",   .start = init_virtio_blk, .deps = { "PCI", "Heap", "Timer" },
+      .background = true },
+    { .name = "Buffer cache", .start = init_bcache,     .deps = { "Heap" },
+      .background = true },
+    { .name = "Image cache",  .start = init_imgcache,   .deps = { "Heap" } },
+    { .name = "FAT mount",    .start = init_fat,
+      .deps = { "RAM disk", "ATA", "AHCI", "virtio-blk", "Buffer cache" },
+      .background = true },
+};
+
+void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
+    // Initialize VGA text mode first
+    uint64_t start = rdtsc();
+    bool have_serial = serial_init();
+    vga_init();
+    vga_clear();
+
+    vga_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+    vga_print("  __  __       ___  ____  \n");
+    vga_print(" |  \\/  |_   _/ _ \\/ ___| \n");
+    vga_print(" | |\\/| | | | | | | |     \n");
+    vga_print(" | |  | | |_| | |_| | |__ \n");
+    vga_print(" |_|  |_|\\__, |\\___/ \\____|\n");
+    vga_print("          |___/             \n");
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print("\n  MyOS v0.1 - x86 32-bit\n\n");
+    boot_record("Console", start);
+
+    // Verify multiboot
+    if (magic != MULTIBOOT_MAGIC) {
+        vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
+        vga_print("[PANIC] Not booted by a Multiboot-compliant bootloader!\n");
+        for(;;) __asm__("hlt");
+    }
+    boot_mbi = mbi;
+    start = rdtsc();
+    boot_parse_cmdline(have_serial);
+    boot_record("Command line", start);
 
-    vga_print("[INIT] All systems nominal!\n\n");
+    // Core systems; drivers and disks follow in the background
+    initcall_run(init_table, sizeof(init_table) / sizeof(init_table[0]));
 
     // Enable interrupts
     __asm__("sti");
 
     // Start shell
     shell_init();
+    shell_set_autorun(boot_autorun, boot_script);
+    boot_shell_ready();
     shell_run();
 
     // Should never reach here
@@ -3,6 +3,13 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
+#ifdef MYOS_HOST
+// Host build (see host/): take the integer types from the host toolchain so
+// size_t and pointers match the C library the test harness links against.
+#include <stdint.h>
+#include <stddef.h>
+typedef int                bool;
+#else
 // Standard integer types (no stdlib)
 typedef unsigned char      uint8_t;
 typedef unsigned short     uint16_t;
@@ -12,11 +19,15 @@ typedef signed char        int8_t;
 typedef signed short       int16_t;
 typedef signed int         int32_t;
 typedef unsigned int       size_t;
+typedef unsigned int       uintptr_t;
 typedef int                bool;
+#endif
 
 #define true  1
 #define false 0
+#ifndef NULL
 #define NULL  0
+#endif
 
 // Multiboot info structure (partial)
 typedef struct {
@@ -32,7 +43,27 @@ typedef struct {
     uint32_t mmap_addr;
 } __attribute__((packed)) multiboot_info_t;
 
+// Boot module loaded by GRUB ("module" line), mbi->mods_addr points to an array
+typedef struct {
+    uint32_t mod_start;
+    uint32_t mod_end;           // First byte past the module
+    uint32_t cmdline;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
 // I/O port access
+#ifdef MYOS_HOST
+// Host build: port I/O is routed to stubs in host/host_io.c
+void     outb(uint16_t port, uint8_t val);
+uint8_t  inb(uint16_t port);
+void     outw(uint16_t port, uint16_t val);
+uint16_t inw(uint16_t port);
+void     outl(uint16_t port, uint32_t val);
+uint32_t inl(uint16_t port);
+void     insw(uint16_t port, void* buf, uint32_t count);
+void     outsw(uint16_t port, const void* buf, uint32_t count);
+bool     interrupts_enabled(void);
+#else
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
 }
@@ -53,6 +84,40 @@ static inline uint16_t inw(uint16_t port) {
     return ret;
 }
 
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Read `count` 16-bit words from a port into buf (rep insw)
+static inline void insw(uint16_t port, void* buf, uint32_t count) {
+    __asm__ volatile ("rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+// Write `count` 16-bit words from buf to a port (rep outsw)
+static inline void outsw(uint16_t port, const void* buf, uint32_t count) {
+    __asm__ volatile ("rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline bool interrupts_enabled(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
+}
+#endif
+
+// CPU time-stamp counter (cycles since reset)
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 static inline void io_wait(void) {
     outb(0x80, 0);  // Write to unused port to create small delay
 }
@@ -67,6 +132,8 @@ int   strncmp(const char* a, const char* b, size_t n);
 char* strcpy(char* dest, const char* src);
 char* strncpy(char* dest, const char* src, size_t n);
 char* strchr(const char* s, int c);
+// 64-by-32 division without libgcc
+uint64_t udiv64(uint64_t n, uint32_t d);
 
 // PIC
 void pic_remap(uint8_t offset1, uint8_t offset2);
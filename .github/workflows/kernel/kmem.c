@@ -0,0 +1,102 @@
+// kmem.c - Kernel heap
+// First-fit allocator over one contiguous region. Free blocks are kept in
+// an address-ordered list so neighbours can be merged on kfree().
+
+#include "kmem.h"
+#include "kernel.h"
+
+#define KMEM_ALIGN  16
+#define KMEM_USED   0x4B4D5553  // "KMUS"
+#define KMEM_FREE   0x4B4D4652  // "KMFR"
+
+typedef struct kmem_block {
+    uint32_t size;              // Bytes including header
+    uint32_t magic;
+    struct kmem_block* next;    // Free list link (free blocks only)
+} kmem_block_t;
+
+#define KMEM_HDR ((sizeof(kmem_block_t) + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1))
+
+static kmem_block_t* kmem_free_list = NULL;
+static uint32_t kmem_total = 0;
+static uint32_t kmem_free = 0;
+
+void kmem_init(void* base, uint32_t size) {
+    uintptr_t start = ((uintptr_t)base + KMEM_ALIGN - 1) & ~(uintptr_t)(KMEM_ALIGN - 1);
+    size -= (uint32_t)(start - (uintptr_t)base);
+    size &= ~(KMEM_ALIGN - 1);
+
+    kmem_free_list = NULL;
+    kmem_total = kmem_free = 0;
+    if (size <= KMEM_HDR) return;
+
+    kmem_free_list = (kmem_block_t*)start;
+    kmem_free_list->size  = size;
+    kmem_free_list->magic = KMEM_FREE;
+    kmem_free_list->next  = NULL;
+    kmem_total = kmem_free = size;
+}
+
+void* kmalloc(uint32_t size) {
+    if (size == 0) return NULL;
+    uint32_t need = (size + KMEM_HDR + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1);
+
+    kmem_block_t** pp = &kmem_free_list;
+    while (*pp) {
+        kmem_block_t* b = *pp;
+        if (b->size >= need) {
+            if (b->size - need >= KMEM_HDR + KMEM_ALIGN) {
+                // Split: the tail stays on the free list
+                kmem_block_t* rest = (kmem_block_t*)((uint8_t*)b + need);
+                rest->size  = b->size - need;
+                rest->magic = KMEM_FREE;
+                rest->next  = b->next;
+                *pp = rest;
+                b->size = need;
+            } else {
+                *pp = b->next;
+            }
+            b->magic = KMEM_USED;
+            b->next  = NULL;
+            kmem_free -= b->size;
+            return (uint8_t*)b + KMEM_HDR;
+        }
+        pp = &b->next;
+    }
+    return NULL;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+    kmem_block_t* b = (kmem_block_t*)((uint8_t*)ptr - KMEM_HDR);
+    if (b->magic != KMEM_USED) return;     // Double free or wild pointer
+
+    b->magic = KMEM_FREE;
+    kmem_free += b->size;
+
+    // Insert in address order
+    kmem_block_t* prev = NULL;
+    kmem_block_t* cur = kmem_free_list;
+    while (cur && cur < b) { prev = cur; cur = cur->next; }
+    b->next = cur;
+    if (prev) prev->next = b;
+    else      kmem_free_list = b;
+
+    // Merge with the following block, then with the preceding one
+    if (cur && (uint8_t*)b + b->size == (uint8_t*)cur) {
+        b->size += cur->size;
+        b->next  = cur->next;
+    }
+    if (prev && (uint8_t*)prev + prev->size == (uint8_t*)b) {
+        prev->size += b->size;
+        prev->next  = b->next;
+    }
+}
+
+uint32_t kmem_total_bytes(void) {
+    return kmem_total;
+}
+
+uint32_t kmem_free_bytes(void) {
+    return kmem_free;
+}
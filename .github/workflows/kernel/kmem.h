@@ -0,0 +1,11 @@
+// kmem.h - Kernel heap (first-fit free list)
+#ifndef KMEM_H
+#define KMEM_H
+#include "kernel.h"
+
+void     kmem_init(void* base, uint32_t size);
+void*    kmalloc(uint32_t size);
+void     kfree(void* ptr);
+uint32_t kmem_total_bytes(void);
+uint32_t kmem_free_bytes(void);
+#endif
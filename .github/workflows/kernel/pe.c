@@ -0,0 +1,36 @@
+// pe.c - MZ/PE32 header parsing
+// Kept free of loader side effects so it can also run in the host build.
+
+#include "pe.h"
+#include "kernel.h"
+
+int pe_parse(const uint8_t* buf, uint32_t size, pe_info_t* info) {
+    memset(info, 0, sizeof(*info));
+
+    const mz_header_t* mz = (const mz_header_t*)buf;
+    if (size < sizeof(mz_header_t) || mz->magic != MZ_MAGIC) {
+        info->kind = PE_KIND_FLAT;
+        return PE_OK;
+    }
+
+    // Need the PE signature, file header and the optional header fields we use
+    uint32_t pe_offset = mz->e_lfanew;
+    uint32_t need = sizeof(pe_file_header_t) + sizeof(pe_opt_header_t);
+    if (pe_offset > size || size - pe_offset < need)
+        return PE_ERR_NO_PE;
+
+    const pe_file_header_t* pef = (const pe_file_header_t*)(buf + pe_offset);
+    if (pef->signature != PE_MAGIC)
+        return PE_ERR_NO_PE;
+    if (pef->machine != PE_MACHINE_I386)
+        return PE_ERR_NOT_X86;
+
+    const pe_opt_header_t* peo =
+        (const pe_opt_header_t*)(buf + pe_offset + sizeof(pe_file_header_t));
+
+    info->kind         = PE_KIND_PE32;
+    info->image_base   = peo->image_base;
+    info->entry_rva    = peo->entry_point;
+    info->num_sections = pef->num_sections;
+    return PE_OK;
+}
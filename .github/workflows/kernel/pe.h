@@ -0,0 +1,82 @@
+// pe.h - MZ/PE32 executable header parsing
+#ifndef PE_H
+#define PE_H
+#include "kernel.h"
+
+// MZ DOS header magic
+#define MZ_MAGIC   0x5A4D
+
+// PE signature
+#define PE_MAGIC   0x00004550
+
+#define PE_MACHINE_I386 0x014C
+
+typedef struct {
+    uint16_t magic;         // MZ
+    uint16_t e_cblp;
+    uint16_t e_cp;
+    uint16_t e_crlc;
+    uint16_t e_cparhdr;
+    uint16_t e_minalloc;
+    uint16_t e_maxalloc;
+    uint16_t e_ss;
+    uint16_t e_sp;
+    uint16_t e_csum;
+    uint16_t e_ip;
+    uint16_t e_cs;
+    uint16_t e_lfarlc;
+    uint16_t e_ovno;
+    uint16_t e_res[4];
+    uint16_t e_oemid;
+    uint16_t e_oeminfo;
+    uint16_t e_res2[10];
+    uint32_t e_lfanew;      // Offset to PE header
+} __attribute__((packed)) mz_header_t;
+
+typedef struct {
+    uint32_t signature;     // PE\0\0
+    uint16_t machine;       // 0x014C = x86
+    uint16_t num_sections;
+    uint32_t timestamp;
+    uint32_t symbol_table;
+    uint32_t num_symbols;
+    uint16_t opt_header_size;
+    uint16_t characteristics;
+} __attribute__((packed)) pe_file_header_t;
+
+typedef struct {
+    uint16_t magic;         // 0x010B = PE32
+    uint8_t  major_linker;
+    uint8_t  minor_linker;
+    uint32_t code_size;
+    uint32_t init_data_size;
+    uint32_t uninit_data_size;
+    uint32_t entry_point;   // RVA of entry point
+    uint32_t base_of_code;
+    uint32_t base_of_data;
+    uint32_t image_base;    // Default load address
+    uint32_t section_align;
+    uint32_t file_align;
+    // ... more fields follow
+} __attribute__((packed)) pe_opt_header_t;
+
+// Image kinds reported by pe_parse()
+#define PE_KIND_FLAT    0   // No MZ header: flat binary
+#define PE_KIND_PE32    1   // MZ + PE32 image
+
+// pe_parse() results
+#define PE_OK           0
+#define PE_ERR_NO_PE    1   // MZ stub without a usable PE header
+#define PE_ERR_NOT_X86  2   // PE header for another machine
+
+typedef struct {
+    uint32_t kind;          // PE_KIND_*
+    uint32_t image_base;    // PE32: preferred load address
+    uint32_t entry_rva;     // PE32: entry point relative to image_base
+    uint16_t num_sections;
+} pe_info_t;
+
+// Inspect the first `size` bytes of an executable. Does not touch memory
+// outside the buffer, so it is safe on truncated or hostile files.
+int pe_parse(const uint8_t* buf, uint32_t size, pe_info_t* info);
+#endif
@@ -37,9 +37,9 @@ int strcmp(const char* a, const char* b) {
 }
 
 int strncmp(const char* a, const char* b, size_t n) {
-    while (n-- && *a && *a == *b) { a++; b++; }
-    if (!n) return 0;
-    return (int)(uint8_t)*a - (int)(uint8_t)*b;
+    for (; n; n--, a++, b++)
+        if (*a != *b || !*a) return (int)(uint8_t)*a - (int)(uint8_t)*b;
+    return 0;
 }
 
 char* strcpy(char* dest, const char* src) {
@@ -62,3 +62,15 @@ char* strchr(const char* s, int c) {
     }
     return NULL;
 }
+
+uint64_t udiv64(uint64_t n, uint32_t d) {
+    uint64_t q = 0, r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if (r >= d) {
+            r -= d;
+            q |= 1ull << i;
+        }
+    }
+    return q;
+}
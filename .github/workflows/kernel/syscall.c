@@ -0,0 +1,203 @@
+// syscall.c - System calls (int 0x80 and SYSENTER)
+//
+// Programs ask the kernel for console output, files, time and sleep
+// through one table indexed by the call number (user/syscall.h). There
+// are two ways in: int 0x80 works everywhere, SYSENTER skips the IDT and
+// the privilege checks of an interrupt gate and is what the user stubs
+// take when CPUID reports it. Both stubs save the same registers, so one
+// dispatcher serves both. The time can also be read without a call, from
+// the kernel data page (kdata.c).
+//
+// SYSENTER switches to a dedicated kernel stack (this is a single-CPU
+// kernel, so one stack is the per-CPU stack). Its return instruction,
+// SYSEXIT, always lands in ring 3; for a ring 0 caller (syscall_user_mode
+// clear, no program running) the stub jumps back instead.
+
+#include "syscall.h"
+#include "kernel.h"
+#include "idt.h"
+#include "vga.h"
+#include "exec.h"
+#include "kdata.h"
+#include "trace.h"
+#include "../drivers/serial.h"
+#include "../drivers/timer.h"
+#include "../fs/fat.h"
+#include "../fs/ramfs.h"
+
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
+
+extern void syscall_int80(void);      // syscall_asm.asm
+extern void syscall_sysenter(void);
+
+uint32_t syscall_user_mode = 0;
+
+static uint8_t syscall_stack[SYSCALL_STACK_SIZE] __attribute__((aligned(16)));
+static bool    syscall_fast = false;
+
+typedef struct {
+    bool         used;
+    bool         ram;           // ramfs member instead of a FAT file
+    fat_file_t   fat;
+    ramfs_file_t rf;
+    uint32_t     pos;           // ramfs read position
+} sys_file_t;
+
+static sys_file_t sys_files[SYSCALL_MAX_FILES];
+
+static inline void wrmsr(uint32_t msr, uint32_t lo, uint32_t hi) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"(lo), "d"(hi));
+}
+
+// Reject NULL and ranges that wrap around the address space
+static bool sys_check(uint32_t ptr, uint32_t len) {
+    return ptr != 0 && ptr + len >= ptr;
+}
+
+static sys_file_t* sys_file(uint32_t fd) {
+    if (fd < SYSCALL_FD_BASE || fd >= SYSCALL_FD_BASE + SYSCALL_MAX_FILES) return NULL;
+    sys_file_t* f = &sys_files[fd - SYSCALL_FD_BASE];
+    return f->used ? f : NULL;
+}
+
+static int32_t sys_exit(uint32_t code, uint32_t b, uint32_t c) {
+    (void)b; (void)c;
+    exec_exit((int32_t)code);           // Returns only if no program runs
+    return -1;
+}
+
+static int32_t sys_write(uint32_t fd, uint32_t buf, uint32_t len) {
+    if (fd != 1 && fd != 2) return -1;
+    if (!sys_check(buf, len)) return -1;
+    const char* s = (const char*)buf;
+    for (uint32_t i = 0; i < len; i++) vga_putchar(s[i]);
+    return (int32_t)len;
+}
+
+static int32_t sys_open(uint32_t path, uint32_t b, uint32_t c) {
+    (void)b; (void)c;
+    if (!sys_check(path, 1)) return -1;
+    uint32_t fd;
+    for (fd = 0; fd < SYSCALL_MAX_FILES && sys_files[fd].used; fd++);
+    if (fd == SYSCALL_MAX_FILES) return -1;
+
+    sys_file_t* f = &sys_files[fd];
+    if (fat_is_mounted()) {
+        if (!fat_open((const char*)path, &f->fat)) return -1;
+        f->ram = false;
+    } else {
+        if (!ramfs_open((const char*)path, &f->rf)) return -1;
+        f->ram = true;
+        f->pos = 0;
+    }
+    f->used = true;
+    return (int32_t)(fd + SYSCALL_FD_BASE);
+}
+
+static int32_t sys_read(uint32_t fd, uint32_t buf, uint32_t len) {
+    sys_file_t* f = sys_file(fd);
+    if (!f || !sys_check(buf, len)) return -1;
+    if (!f->ram) return (int32_t)fat_read(&f->fat, (void*)buf, len);
+
+    uint32_t left = f->rf.size - f->pos;
+    if (len > left) len = left;
+    memcpy((void*)buf, f->rf.data + f->pos, len);
+    f->pos += len;
+    return (int32_t)len;
+}
+
+static int32_t sys_close(uint32_t fd, uint32_t b, uint32_t c) {
+    (void)b; (void)c;
+    sys_file_t* f = sys_file(fd);
+    if (!f) return -1;
+    if (!f->ram) fat_close(&f->fat);
+    f->used = false;
+    return 0;
+}
+
+static int32_t sys_seek(uint32_t fd, uint32_t offset, uint32_t c) {
+    (void)c;
+    sys_file_t* f = sys_file(fd);
+    if (!f) return -1;
+    if (!f->ram) return fat_seek(&f->fat, offset) ? 0 : -1;
+    if (offset > f->rf.size) return -1;
+    f->pos = offset;
+    return 0;
+}
+
+static int32_t sys_time(uint32_t a, uint32_t b, uint32_t c) {
+    (void)a; (void)b; (void)c;
+    return (int32_t)timer_get_ms();
+}
+
+static int32_t sys_sleep(uint32_t ms, uint32_t b, uint32_t c) {
+    (void)b; (void)c;
+    timer_sleep(ms);
+    return 0;
+}
+
+static int32_t sys_kdata(uint32_t a, uint32_t b, uint32_t c) {
+    (void)a; (void)b; (void)c;
+    return (int32_t)(uint32_t)kdata_get();
+}
+
+typedef int32_t (*syscall_fn_t)(uint32_t a, uint32_t b, uint32_t c);
+
+static const syscall_fn_t syscall_table[SYS_COUNT] = {
+    [SYS_EXIT]  = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_OPEN]  = sys_open,
+    [SYS_READ]  = sys_read,
+    [SYS_CLOSE] = sys_close,
+    [SYS_SEEK]  = sys_seek,
+    [SYS_TIME]  = sys_time,
+    [SYS_SLEEP] = sys_sleep,
+    [SYS_KDATA] = sys_kdata,
+};
+
+void syscall_dispatch(syscall_frame_t* frame) {
+    uint32_t nr = frame->eax;
+    if (nr >= SYS_COUNT || !syscall_table[nr]) {
+        frame->eax = (uint32_t)-1;
+        return;
+    }
+    frame->eax = (uint32_t)syscall_table[nr](frame->ebx, frame->esi, frame->edi);
+
+    // SYS_EXIT does not come back here; exec.c traces the exit
+    if (trace_on(TRACE_SYSCALL)) {
+        serial_print("[TRACE] syscall ");
+        serial_print_dec(nr);
+        serial_print(" (");
+        serial_print_dec(frame->ebx);
+        serial_print(", ");
+        serial_print_dec(frame->esi);
+        serial_print(", ");
+        serial_print_dec(frame->edi);
+        serial_print(") = ");
+        serial_print_dec(frame->eax);
+        serial_putchar('\n');
+    }
+}
+
+void syscall_reset(void) {
+    for (uint32_t fd = 0; fd < SYSCALL_MAX_FILES; fd++)
+        sys_close(fd + SYSCALL_FD_BASE, 0, 0);
+}
+
+void syscall_init(void) {
+    // DPL 3 trap gate: callable from ring 3, interrupts stay enabled
+    idt_set_handler(MYOS_SYSCALL_VECTOR, syscall_int80, 0xEF);
+
+    syscall_fast = myos_has_sysenter();       // Same test as the user stubs
+    if (!syscall_fast) return;
+    // Kernel CS; SS = CS + 8, and SYSEXIT uses CS + 16 / CS + 24 (GDT 3, 4)
+    wrmsr(MSR_SYSENTER_CS, 0x08, 0);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)(syscall_stack + SYSCALL_STACK_SIZE), 0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)syscall_sysenter, 0);
+}
+
+bool syscall_fast_available(void) {
+    return syscall_fast;
+}
@@ -0,0 +1,28 @@
+// syscall.h - System calls (int 0x80 and SYSENTER)
+#ifndef SYSCALL_H
+#define SYSCALL_H
+#include "kernel.h"
+#include "../user/syscall.h"
+
+#define SYSCALL_MAX_FILES   8       // Open files per program
+#define SYSCALL_FD_BASE     3       // First file descriptor (0-2 = console)
+#define SYSCALL_STACK_SIZE  8192    // Kernel stack for SYSENTER
+
+// Registers as the entry stubs save them (syscall_asm.asm); the handler's
+// result goes back in eax
+typedef struct {
+    uint32_t ds;
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+} syscall_frame_t;
+
+// Non-zero while a ring 3 program runs: SYSENTER returns with SYSEXIT
+extern uint32_t syscall_user_mode;
+
+// Install the int 0x80 gate and, when the CPU has it, the SYSENTER MSRs
+void syscall_init(void);
+bool syscall_fast_available(void);
+// Called from the entry stubs
+void syscall_dispatch(syscall_frame_t* frame);
+// Close everything the finished program left open
+void syscall_reset(void);
+#endif
@@ -0,0 +1,94 @@
+; syscall_asm.asm - System call entry stubs (int 0x80 and SYSENTER)
+
+[EXTERN syscall_dispatch]
+[EXTERN syscall_user_mode]
+
+; int 0x80: a DPL 3 trap gate, so interrupts stay as the caller had them
+[GLOBAL syscall_int80]
+syscall_int80:
+    pusha
+    mov ax, ds
+    push eax            ; syscall_frame_t starts here
+
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    push esp
+    call syscall_dispatch
+    add esp, 4
+
+    pop eax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    popa                ; eax = result
+    iret
+
+; SYSENTER: CS/SS come from the MSR, ESP is the syscall stack, IF is
+; clear. The caller passed its stack in ecx and return address in edx.
+[GLOBAL syscall_sysenter]
+syscall_sysenter:
+    pusha
+    mov ax, ds
+    push eax
+
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    sti
+
+    push esp
+    call syscall_dispatch
+    add esp, 4
+
+    cli
+    mov eax, [syscall_user_mode]
+    test eax, eax
+    pop eax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    popa                ; eax = result, ecx = caller's stack, edx = return address
+    jnz .user
+
+    ; Ring 0 caller: SYSEXIT would drop it to ring 3, jump back instead
+    mov esp, ecx
+    sti
+    jmp edx
+
+.user:
+    sti                 ; Takes effect after SYSEXIT
+    sysexit
+
+; Drop to ring 3 at `entry` with stack `esp` (exec.c). Does not return:
+; the program leaves through SYS_EXIT or a fault.
+[GLOBAL exec_enter_user]
+exec_enter_user:
+    mov ecx, [esp+4]    ; entry
+    mov edx, [esp+8]    ; user stack
+    mov ax, 0x23        ; User data, RPL 3
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    push 0x23           ; ss
+    push edx            ; esp
+    push 0x202          ; eflags: IF, IOPL 0
+    push 0x1B           ; cs: user code, RPL 3
+    push ecx            ; eip
+    iret
+
+; A program's entry point returns here: exit with its return value
+[GLOBAL exec_user_return]
+exec_user_return:
+    mov ebx, eax
+    mov eax, 0          ; SYS_EXIT
+    int 0x80
@@ -0,0 +1,19 @@
+// trace.h - Trace points selected at boot (trace= parameter)
+//
+// Each set bit turns on one group of trace messages. They go to the
+// serial port only, so they neither scroll the screen nor cost anything
+// but a test when off.
+#ifndef TRACE_H
+#define TRACE_H
+#include "kernel.h"
+
+#define TRACE_INIT      0x01    // Init steps as they start and finish
+#define TRACE_SYSCALL   0x02    // Every system call with its result
+#define TRACE_EXEC      0x04    // Program loads (cache or disk) and exits
+
+extern uint32_t trace_mask;     // kernel.c
+
+static inline bool trace_on(uint32_t what) {
+    return (trace_mask & what) != 0;
+}
+#endif
@@ -5,13 +5,22 @@
 
 #define VGA_WIDTH   80
 #define VGA_HEIGHT  25
+#ifdef MYOS_HOST
+extern uint16_t host_vga_mem[];     // Fake text buffer (host/host_io.c)
+#define VGA_MEMORY  host_vga_mem
+#else
 #define VGA_MEMORY  0xB8000
+#endif
 
 static uint16_t* vga_buf = (uint16_t*)VGA_MEMORY;
 static uint8_t   vga_color = 0;
 static uint32_t  vga_col = 0;
 static uint32_t  vga_row = 0;
 
+// Console targets (console= boot parameter)
+static bool      vga_screen = true;
+static void    (*vga_mirror)(char c) = NULL;
+
 static inline uint16_t vga_entry(uint8_t c, uint8_t color) {
     return (uint16_t)c | ((uint16_t)color << 8);
 }
@@ -68,7 +77,15 @@ uint8_t vga_make_color(vga_color_t fg, vga_color_t bg) {
     return fg | (bg << 4);
 }
 
+void vga_set_output(bool screen, void (*mirror)(char c)) {
+    vga_screen = screen;
+    vga_mirror = mirror;
+}
+
 void vga_putchar(char c) {
+    if (vga_mirror) vga_mirror(c);
+    if (!vga_screen) return;
+
     if (c == '\n') {
         vga_col = 0;
         vga_row++;
@@ -26,6 +26,9 @@ void    vga_init(void);
 void    vga_clear(void);
 void    vga_set_color(vga_color_t fg, vga_color_t bg);
 uint8_t vga_make_color(vga_color_t fg, vga_color_t bg);
+// Where console output goes: the screen, and/or a copy of every
+// character to `mirror` (e.g. serial_putchar; NULL = none)
+void    vga_set_output(bool screen, void (*mirror)(char c));
 void    vga_putchar(char c);
 void    vga_print(const char* str);
 void    vga_print_hex(uint32_t val);
@@ -4,10 +4,19 @@
 #include "../kernel/kernel.h"
 #include "../kernel/vga.h"
 #include "../kernel/exec.h"
+#include "../kernel/imgcache.h"
 #include "../drivers/keyboard.h"
 #include "../drivers/mouse.h"
 #include "../drivers/timer.h"
 #include "../fs/fat.h"
+#include "../fs/bcache.h"
+#include "../fs/dcache.h"
+#include "../fs/diridx.h"
+#include "../fs/ramfs.h"
+#include "../kernel/kmem.h"
+#include "../kernel/boottime.h"
+#include "../kernel/initcall.h"
+#include "../kernel/cmdline.h"
 
 #define CMD_BUF_SIZE 256
 #define MAX_ARGS 16
@@ -42,11 +51,18 @@ static void cmd_help(void) {
     vga_print("  help     - Show this help\n");
     vga_print("  cls      - Clear screen\n");
     vga_print("  echo <t> - Print text\n");
-    vga_print("  info     - System information\n");
+    vga_print("  info     - System information and boot parameters\n");
     vga_print("  mouse    - Show mouse state\n");
     vga_print("  time     - Show system uptime\n");
-    vga_print("  ls       - List files on disk\n");
-    vga_print("  run <f>  - Execute a .bin or .exe file\n");
+    vga_print("  boottime - Time spent in each boot stage\n");
+    vga_print("  input    - Keyboard queue, latency and idle time\n");
+    vga_print("  ls [dir] - List files (e.g. ls /BIN)\n");
+    vga_print("  run <f>  - Execute a .bin or .exe file (path)\n");
+    vga_print("  cat <f>  - Print a file\n");
+    vga_print("  write <f> <t> - Create or replace a file with text\n");
+    vga_print("  sync     - Write cached changes to disk\n");
+    vga_print("  cache    - Disk cache statistics\n");
+    vga_print("  df       - Filesystem type and free space\n");
     vga_print("  color    - Test VGA colors\n");
     vga_print("  reboot   - Reboot system\n");
     vga_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
@@ -71,11 +87,19 @@ static void cmd_info(void) {
     vga_print("MyOS v0.1  |  x86 32-bit Protected Mode\n");
     vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     vga_print("Bootloader  : GRUB Multiboot\n");
-    vga_print("CPU Mode    : Protected Mode (Ring 0)\n");
+    vga_print("CPU Mode    : Protected Mode, kernel in ring 0, programs in ring 3\n");
     vga_print("VGA Mode    : Text 80x25\n");
     vga_print("Drivers     : PIT, PS/2 Keyboard, PS/2 Mouse\n");
-    vga_print("Filesystem  : FAT12/FAT16\n");
+    vga_print("Filesystem  : FAT12/FAT16/FAT32");
+    fat_info_t fi;
+    if (fat_get_info(&fi)) {
+        vga_print(" (mounted: FAT");
+        shell_print_dec(fi.fat_type);
+        vga_putchar(')');
+    }
+    vga_putchar('\n');
     vga_print("Exec        : Flat binary (.bin), PE32 (.exe)\n");
+    cmdline_print();
 }
 
 static void cmd_mouse(void) {
@@ -92,11 +116,65 @@ static void cmd_mouse(void) {
     if (mb & 0x04) vga_print("[M] ");
     if (!mb)       vga_print("none");
     vga_putchar('\n');
+
+    mouse_stats_t st;
+    mouse_get_stats(&st);
+    vga_print(mouse_has_wheel() ? "Wheel: yes" : "Wheel: no");
+    vga_print("  Packets: ");
+    shell_print_dec(st.packets);
+    vga_print(" in ");
+    shell_print_dec(st.irqs);
+    vga_print(" IRQs, ");
+    shell_print_dec(st.updates);
+    vga_print(" cursor updates\n");
+}
+
+// Cycles as microseconds at `khz` (0 = unknown rate: prints cycles)
+static void shell_print_us(uint64_t cycles, uint32_t khz) {
+    if (!khz) {
+        shell_print_dec((uint32_t)udiv64(cycles, 1000));
+        vga_print("k cycles");
+        return;
+    }
+    shell_print_dec((uint32_t)udiv64(cycles * 1000, khz));
+    vga_print(" us");
+}
+
+static void cmd_input(void) {
+    kb_stats_t st;
+    keyboard_get_stats(&st);
+    uint32_t khz = timer_tsc_khz();
+
+    vga_print("Keyboard: ");
+    shell_print_dec(st.events);
+    vga_print(" events, ");
+    shell_print_dec(st.dropped);
+    vga_print(" dropped, ");
+    shell_print_dec(st.delivered);
+    vga_print(" chars read\n");
+    if (st.delivered) {
+        vga_print("Latency (IRQ to read): avg ");
+        shell_print_us(udiv64(st.latency_total, st.delivered), khz);
+        vga_print(", max ");
+        shell_print_us(st.latency_max, khz);
+        vga_putchar('\n');
+    }
+    if (st.idle_since) {
+        // Scale both down until the span fits the 32-bit divisor
+        uint64_t span = rdtsc() - st.idle_since, idle = st.idle_cycles;
+        while (span >> 32) {
+            span >>= 1;
+            idle >>= 1;
+        }
+        vga_print("CPU idle: ");
+        shell_print_dec((uint32_t)udiv64(idle * 100, (uint32_t)span));
+        vga_print("% since the shell started\n");
+    }
 }
 
 static void cmd_time(void) {
     uint32_t ticks = timer_get_ticks();
-    uint32_t seconds = ticks / 100;
+    uint32_t seconds = timer_get_ms() / 1000;
     vga_print("Uptime: ");
     shell_print_dec(seconds / 3600); vga_print("h ");
     shell_print_dec((seconds % 3600) / 60); vga_print("m ");
@@ -104,16 +182,30 @@ static void cmd_time(void) {
     shell_print_dec(ticks); vga_print(" ticks)\n");
 }
 
-static void cmd_ls(void) {
-    if (!fat_is_mounted()) {
+static void cmd_ls(int argc, char* argv[]) {
+    bool ram = !fat_is_mounted();   // The tar ramfs stands in for a FAT root
+    if (ram && !ramfs_is_mounted()) {
         vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
         vga_print("Filesystem not mounted.\n");
         vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
         return;
     }
 
+    const char* path = argc > 1 ? argv[1] : "/";
+    fat_dir_entry_t dir;
+    bool is_dir = false;
+    bool found = ram ? ramfs_stat(path, &dir, &is_dir) : fat_stat(path, &dir, &is_dir);
+    if (!found || !is_dir) {
+        vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
+        vga_print(found ? "Not a directory: " : "No such directory: ");
+        vga_print(path);
+        vga_putchar('\n');
+        vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+        return;
+    }
+
     fat_dir_entry_t entries[64];
-    uint32_t count = fat_list_dir(entries, 64);
+    uint32_t count = ram ? ramfs_list_path(path, entries, 64) : fat_list_path(path, entries, 64);
 
     if (count == 0) {
         vga_print("(empty)\n");
@@ -167,6 +259,140 @@ static void cmd_run(int argc, char* argv[]) {
     }
 }
 
+static void shell_error(const char* msg, const char* arg) {
+    vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
+    vga_print(msg);
+    vga_print(arg);
+    vga_putchar('\n');
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+}
+
+static void cmd_cat(int argc, char* argv[]) {
+    if (argc < 2) {
+        vga_print("Usage: cat <file>\n");
+        return;
+    }
+    char chunk[257];
+    if (!fat_is_mounted()) {
+        ramfs_file_t rf;
+        if (!ramfs_open(argv[1], &rf)) {
+            shell_error("No such file: ", argv[1]);
+            return;
+        }
+        for (uint32_t off = 0; off < rf.size; off += 256) {
+            uint32_t n = rf.size - off < 256 ? rf.size - off : 256;
+            memcpy(chunk, rf.data + off, n);
+            chunk[n] = '\0';
+            vga_print(chunk);
+        }
+        return;
+    }
+
+    fat_file_t f;
+    if (!fat_open(argv[1], &f)) {
+        shell_error("No such file: ", argv[1]);
+        return;
+    }
+    uint32_t n;
+    while ((n = fat_read(&f, chunk, 256)) > 0) {
+        chunk[n] = '\0';
+        vga_print(chunk);
+    }
+    if (f.offset != f.size) shell_error("Read error: ", argv[1]);
+    fat_close(&f);
+}
+
+static void cmd_write(int argc, char* argv[]) {
+    if (argc < 2) {
+        vga_print("Usage: write <file> <text...>\n");
+        return;
+    }
+    fat_file_t f;
+    if (!fat_create(argv[1], &f)) {
+        shell_error("Cannot create: ", argv[1]);
+        return;
+    }
+    for (int i = 2; i < argc; i++) {
+        uint32_t len = strlen(argv[i]);
+        if (fat_write(&f, argv[i], len) != len ||
+            fat_write(&f, i + 1 < argc ? " " : "\n", 1) != 1) {
+            shell_error("Write failed: ", argv[1]);
+            break;
+        }
+    }
+    fat_close(&f);
+}
+
+static void cmd_sync(void) {
+    if (!fat_sync()) shell_error("Sync failed", "");
+}
+
+static void cmd_cache(void) {
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    uint32_t lookups = st.hits + st.misses;
+    uint32_t rate = 0;
+    if (lookups)    // Avoid 64-bit division: scale down large counters instead
+        rate = st.hits < 0x1000000 ? st.hits * 100 / lookups : st.hits / (lookups / 100);
+
+    vga_print("Buffers   : "); shell_print_dec(st.buffers);
+    vga_print(" sectors ("); shell_print_dec(st.buffers / 2); vga_print(" KB)\n");
+    vga_print("Hits      : "); shell_print_dec(st.hits); vga_putchar('\n');
+    vga_print("Misses    : "); shell_print_dec(st.misses); vga_putchar('\n');
+    vga_print("Hit rate  : ");
+    shell_print_dec(rate);
+    vga_print("%\n");
+    vga_print("Evictions : "); shell_print_dec(st.evictions); vga_putchar('\n');
+    vga_print("Read-ahead: "); shell_print_dec(st.readahead); vga_print(" sectors\n");
+    vga_print("Dirty     : "); shell_print_dec(st.dirty);
+    vga_print(" sectors, "); shell_print_dec(st.written); vga_print(" written\n");
+
+    dcache_stats_t ds;
+    dcache_get_stats(&ds);
+    vga_print("Dentries  : "); shell_print_dec(ds.entries);
+    vga_print(" cached, "); shell_print_dec(ds.hits); vga_print(" hits, ");
+    shell_print_dec(ds.negative_hits); vga_print(" negative, ");
+    shell_print_dec(ds.misses); vga_print(" misses\n");
+
+    diridx_stats_t is;
+    diridx_get_stats(&is);
+    vga_print("Dir index : "); shell_print_dec(is.dirs);
+    vga_print(" dirs, "); shell_print_dec(is.entries); vga_print(" entries, ");
+    shell_print_dec(is.lookups); vga_print(" lookups\n");
+    imgcache_stats_t ic;
+    imgcache_get_stats(&ic);
+    vga_print("Images    : "); shell_print_dec(ic.entries);
+    vga_print(" ("); shell_print_dec(ic.bytes / 1024); vga_print(" / ");
+    shell_print_dec(ic.budget / 1024); vga_print(" KB), "); shell_print_dec(ic.hits);
+    vga_print(" hits, "); shell_print_dec(ic.misses); vga_print(" misses, ");
+    shell_print_dec(ic.evictions + ic.invalidations); vga_print(" dropped\n");
+    vga_print("Heap free : "); shell_print_dec(kmem_free_bytes() / 1024);
+    vga_print(" / "); shell_print_dec(kmem_total_bytes() / 1024); vga_print(" KB\n");
+}
+
+// Clusters to KB without 64-bit math (cluster sizes are multiples of 512)
+static uint32_t clusters_to_kb(uint32_t clusters, uint32_t cluster_bytes) {
+    uint32_t half_kb = cluster_bytes / 512;
+    return clusters / 2 * half_kb + (clusters & 1) * half_kb / 2;
+}
+
+static void cmd_df(void) {
+    fat_info_t info;
+    if (!fat_get_info(&info)) {
+        vga_set_color(VGA_COLOR_RED, VGA_COLOR_BLACK);
+        vga_print("Filesystem not mounted.\n");
+        vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+        return;
+    }
+
+    vga_print("Type      : FAT"); shell_print_dec(info.fat_type); vga_putchar('\n');
+    vga_print("Cluster   : "); shell_print_dec(info.cluster_bytes); vga_print(" bytes\n");
+    vga_print("Size      : "); shell_print_dec(clusters_to_kb(info.clusters, info.cluster_bytes));
+    vga_print(" KB ("); shell_print_dec(info.clusters); vga_print(" clusters)\n");
+    vga_print("Free      : "); shell_print_dec(clusters_to_kb(info.free_clusters, info.cluster_bytes));
+    vga_print(" KB ("); shell_print_dec(info.free_clusters); vga_print(" clusters)\n");
+}
+
 static void cmd_color(void) {
     vga_print("VGA Color test:\n");
     for (int fg = 0; fg < 16; fg++) {
@@ -181,6 +407,7 @@ static void cmd_color(void) {
 
 static void cmd_reboot(void) {
     vga_print("Rebooting...\n");
+    if (fat_is_mounted()) fat_sync();
     // PS/2 controller reset line
     while (inb(0x64) & 0x02);
     outb(0x64, 0xFE);
@@ -222,9 +449,16 @@ static void shell_execute(char* line) {
     else if (strcmp(argv[0], "info") == 0)   cmd_info();
     else if (strcmp(argv[0], "mouse") == 0)  cmd_mouse();
     else if (strcmp(argv[0], "time") == 0)   cmd_time();
-    else if (strcmp(argv[0], "ls") == 0)     cmd_ls();
-    else if (strcmp(argv[0], "dir") == 0)    cmd_ls();
+    else if (strcmp(argv[0], "boottime") == 0) boottime_print();
+    else if (strcmp(argv[0], "input") == 0)  cmd_input();
+    else if (strcmp(argv[0], "ls") == 0)     cmd_ls(argc, argv);
+    else if (strcmp(argv[0], "dir") == 0)    cmd_ls(argc, argv);
     else if (strcmp(argv[0], "run") == 0)    cmd_run(argc, argv);
+    else if (strcmp(argv[0], "cat") == 0)    cmd_cat(argc, argv);
+    else if (strcmp(argv[0], "write") == 0)  cmd_write(argc, argv);
+    else if (strcmp(argv[0], "sync") == 0)   cmd_sync();
+    else if (strcmp(argv[0], "cache") == 0)  cmd_cache();
+    else if (strcmp(argv[0], "df") == 0)     cmd_df();
     else if (strcmp(argv[0], "color") == 0)  cmd_color();
     else if (strcmp(argv[0], "reboot") == 0) cmd_reboot();
     else {
@@ -236,11 +470,141 @@ static void shell_execute(char* line) {
     }
 }
 
+// Background init is about to print: take the prompt and the typed text
+// off the screen, its lines go in their place
+static bool shell_input_hidden = false;
+
+static void shell_hide_input(void) {
+    uint32_t col, row;
+    vga_get_cursor(&col, &row);
+    uint32_t pos = row * 80 + col;
+    uint32_t len = 6 + cmd_len;                 // "MyOS> " + input
+    uint32_t start = pos >= len ? pos - len : 0;
+    vga_set_cursor(start % 80, start / 80);
+    for (uint32_t i = start; i < pos; i++) vga_putchar(' ');
+    vga_set_cursor(start % 80, start / 80);
+    shell_input_hidden = true;
+}
+
+// ──────────────────────────── boot-time autorun ────────────────────────────
+
+#define SHELL_SCRIPT_MAX (16 * 1024)
+
+// From the autorun= and script= boot parameters; run once background init
+// has finished, so the disks are mounted
+static const char* autorun_cmds = "";
+static const char* autorun_script = "";
+static bool        autorun_pending = false;
+
+void shell_set_autorun(const char* commands, const char* script) {
+    autorun_cmds = commands;
+    autorun_script = script;
+    autorun_pending = commands[0] || script[0];
+}
+
+// Show `text` at the prompt and run it as if it had been typed
+static void shell_type_line(const char* text, uint32_t len) {
+    if (len >= CMD_BUF_SIZE) len = CMD_BUF_SIZE - 1;
+    memcpy(cmd_buf, text, len);
+    cmd_buf[len] = '\0';
+    cmd_len = (int)len;
+    vga_print(cmd_buf);
+    vga_putchar('\n');
+    shell_execute(cmd_buf);
+    cmd_len = 0;
+    shell_prompt();
+}
+
+// Run each command of `text`, separated by ';' or newlines; lines that
+// start with '#' are comments
+static void shell_type_lines(const char* text, uint32_t size) {
+    uint32_t i = 0;
+    while (i < size && text[i]) {
+        uint32_t s = i;
+        while (i < size && text[i] && text[i] != ';' && text[i] != '\n') i++;
+        uint32_t e = i;
+        if (i < size && text[i]) i++;
+        while (s < e && (text[s] == ' ' || text[s] == '\t')) s++;
+        while (e > s && (text[e - 1] == ' ' || text[e - 1] == '\t' || text[e - 1] == '\r')) e--;
+        if (e > s && text[s] != '#') shell_type_line(text + s, e - s);
+    }
+}
+
+// Scripts longer than SHELL_SCRIPT_MAX are cut; false if it cannot be read
+static bool shell_run_script(const char* path) {
+    if (!fat_is_mounted()) {
+        ramfs_file_t rf;
+        if (!ramfs_open(path, &rf)) {
+            shell_error("No such script: ", path);
+            return false;
+        }
+        shell_type_lines((const char*)rf.data, rf.size);
+        return true;
+    }
+
+    fat_file_t f;
+    if (!fat_open(path, &f)) {
+        shell_error("No such script: ", path);
+        return false;
+    }
+    uint32_t size = f.size < SHELL_SCRIPT_MAX ? f.size : SHELL_SCRIPT_MAX;
+    char* buf = kmalloc(size + 1);
+    uint32_t n = buf ? fat_read(&f, buf, size) : 0;
+    fat_close(&f);
+    if (!buf) {
+        shell_error("Not enough memory for script: ", path);
+        return false;
+    }
+    shell_type_lines(buf, n);
+    kfree(buf);
+    return true;
+}
+
+static void shell_autorun(void) {
+    autorun_pending = false;
+    char typed[CMD_BUF_SIZE];
+    int typed_len = cmd_len;
+    memcpy(typed, cmd_buf, (uint32_t)cmd_len);
+
+    shell_hide_input();
+    shell_prompt();
+    shell_type_lines(autorun_cmds, strlen(autorun_cmds));
+    if (autorun_script[0] && !shell_run_script(autorun_script)) shell_prompt();
+
+    memcpy(cmd_buf, typed, (uint32_t)typed_len);
+    cmd_len = typed_len;
+    for (int i = 0; i < cmd_len; i++) vga_putchar(cmd_buf[i]);
+}
+
+// Background work while waiting for a key; false when there is none
+static bool shell_idle(void) {
+    // Drivers and disks still coming up, one step at a time
+    shell_input_hidden = false;
+    bool busy = initcall_poll(shell_hide_input);
+    if (shell_input_hidden) {
+        shell_prompt();
+        for (int i = 0; i < cmd_len; i++) vga_putchar(cmd_buf[i]);
+    }
+    if (!busy && autorun_pending && initcall_all_done()) {
+        shell_autorun();
+        return true;
+    }
+    // One cursor update for however many mouse packets came in
+    mouse_read_motion(NULL);
+    // Flush write-back buffers that have aged while waiting for input
+    bcache_writeback(timer_get_ms());
+    return busy;
+}
+
 void shell_run(void) {
     cmd_len = 0;
     shell_prompt();
 
     while (1) {
+        // Sleep until the next interrupt (a key, or the timer tick that
+        // ages the write-back buffers) when there is nothing to do
+        while (!keyboard_has_key())
+            if (!shell_idle()) keyboard_wait();
         char c = keyboard_getchar();
 
         if (c == '\n') {
@@ -3,4 +3,7 @@
 #define SHELL_H
 void shell_init(void);
 void shell_run(void);
+// Commands (';' between) and a script file to run once init is done;
+// either may be empty. The strings must stay valid.
+void shell_set_autorun(const char* commands, const char* script);
 #endif
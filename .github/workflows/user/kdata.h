@@ -0,0 +1,68 @@
+// kdata.h - Kernel data page: time without a system call
+//
+// The kernel keeps one page of data that every program may read (and
+// must not write): the timer tick count with the TSC at that tick, and
+// the TSC rate. myos_kdata() asks for its address once; after that
+// myos_time_ns() is a few loads and an rdtsc.
+//
+// The kernel updates the page from the timer interrupt under a seqlock:
+// `seq` is odd while an update is in progress, so a reader copies what it
+// needs and retries if `seq` was odd or changed meanwhile.
+#ifndef MYOS_USER_KDATA_H
+#define MYOS_USER_KDATA_H
+#include "syscall.h"
+
+#define MYOS_KDATA_VERSION 1
+
+typedef struct {
+    unsigned int       version;     // MYOS_KDATA_VERSION
+    unsigned int       seq;         // Seqlock generation, odd = updating
+    unsigned int       ticks;       // Timer ticks since boot
+    unsigned int       tick_hz;
+    unsigned long long tick_tsc;    // TSC when `ticks` last changed
+    unsigned int       ns_per_tick;
+    unsigned int       tsc_khz;     // 0 until calibrated: tick resolution only
+    unsigned int       ns_mult;     // ns = (cycles * ns_mult) >> ns_shift
+    unsigned int       ns_shift;
+} myos_kdata_t;
+
+static inline const volatile myos_kdata_t* myos_kdata(void) {
+    static const volatile myos_kdata_t* kd = 0;
+    if (!kd) kd = (const volatile myos_kdata_t*)myos_syscall(SYS_KDATA, 0, 0, 0);
+    return kd;
+}
+
+static inline unsigned long long myos_rdtsc(void) {
+    unsigned int lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+// Nanoseconds since boot: the last tick, plus the TSC time since it
+// (capped below one tick, so the result never runs backwards)
+static inline unsigned long long myos_time_ns(void) {
+    const volatile myos_kdata_t* kd = myos_kdata();
+    unsigned int seq, ticks, per_tick, mult, shift;
+    unsigned long long tsc0, now;
+    do {
+        seq      = kd->seq;
+        __asm__ volatile ("" ::: "memory");
+        ticks    = kd->ticks;
+        tsc0     = kd->tick_tsc;
+        per_tick = kd->ns_per_tick;
+        mult     = kd->ns_mult;
+        shift    = kd->ns_shift;
+        now      = myos_rdtsc();
+        __asm__ volatile ("" ::: "memory");
+    } while ((seq & 1) || seq != kd->seq);
+
+    unsigned long long ns = (unsigned long long)ticks * per_tick;
+    if (mult && now > tsc0) {
+        unsigned long long delta = now - tsc0;
+        if (delta >> 32) delta = 0xFFFFFFFFu;
+        unsigned long long frac = (delta * mult) >> shift;
+        ns += frac < per_tick ? frac : per_tick - 1;
+    }
+    return ns;
+}
+#endif
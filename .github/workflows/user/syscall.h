@@ -0,0 +1,102 @@
+// syscall.h - MyOS system call interface for programs
+//
+// Include this in a program built freestanding for i386 (no kernel
+// headers needed). Calls go through SYSENTER when the CPU has it and
+// through int 0x80 otherwise; both take the number in eax and up to three
+// arguments in ebx, esi and edi, and return in eax. ecx and edx are
+// clobbered: the fast path passes the return stack and address in them.
+//
+//     #include "syscall.h"
+//     int main(void) {
+//         myos_print("Hello\n");
+//         return 0;
+//     }
+#ifndef MYOS_USER_SYSCALL_H
+#define MYOS_USER_SYSCALL_H
+
+#define SYS_EXIT    0   // (code)                  never returns
+#define SYS_WRITE   1   // (fd, buf, len)          bytes written; fd 1/2 = console
+#define SYS_OPEN    2   // (path)                  fd, -1 if not found
+#define SYS_READ    3   // (fd, buf, len)          bytes read, 0 at end of file
+#define SYS_CLOSE   4   // (fd)
+#define SYS_SEEK    5   // (fd, offset)            0, -1 past the end
+#define SYS_TIME    6   // ()                      milliseconds since boot
+#define SYS_SLEEP   7   // (ms)
+#define SYS_KDATA   8   // ()                      address of the kernel data page (kdata.h)
+#define SYS_COUNT   9
+
+#define MYOS_SYSCALL_VECTOR 0x80
+#define MYOS_STDOUT 1
+
+static inline int myos_syscall_int(int nr, int a, int b, int c) {
+    int ret;
+    __asm__ volatile ("int $0x80"
+                      : "=a"(ret) : "a"(nr), "b"(a), "S"(b), "D"(c) : "ecx", "edx", "memory");
+    return ret;
+}
+
+static inline int myos_syscall_fast(int nr, int a, int b, int c) {
+    int ret;
+    __asm__ volatile ("movl %%esp, %%ecx\n\t"
+                      "movl $1f, %%edx\n\t"
+                      "sysenter\n"
+                      "1:"
+                      : "=a"(ret) : "a"(nr), "b"(a), "S"(b), "D"(c) : "ecx", "edx", "memory");
+    return ret;
+}
+
+// SYSENTER is usable when CPUID reports SEP, except on the first Pentium
+// Pro steppings, which set the bit without implementing the instruction
+static inline int myos_has_sysenter(void) {
+    unsigned int eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    unsigned int family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    if (!(edx & (1u << 11))) return 0;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+static inline int myos_syscall(int nr, int a, int b, int c) {
+    static int fast = -1;
+    if (fast < 0) fast = myos_has_sysenter();
+    return fast ? myos_syscall_fast(nr, a, b, c) : myos_syscall_int(nr, a, b, c);
+}
+
+static inline void myos_exit(int code) {
+    myos_syscall(SYS_EXIT, code, 0, 0);
+    for (;;) ;
+}
+
+static inline int myos_write(int fd, const void* buf, unsigned int len) {
+    return myos_syscall(SYS_WRITE, fd, (int)buf, (int)len);
+}
+
+static inline int myos_print(const char* s) {
+    unsigned int len = 0;
+    while (s[len]) len++;
+    return myos_write(MYOS_STDOUT, s, len);
+}
+
+static inline int myos_open(const char* path) {
+    return myos_syscall(SYS_OPEN, (int)path, 0, 0);
+}
+
+static inline int myos_read(int fd, void* buf, unsigned int len) {
+    return myos_syscall(SYS_READ, fd, (int)buf, (int)len);
+}
+
+static inline int myos_close(int fd) {
+    return myos_syscall(SYS_CLOSE, fd, 0, 0);
+}
+
+static inline int myos_seek(int fd, unsigned int offset) {
+    return myos_syscall(SYS_SEEK, fd, (int)offset, 0);
+}
+
+static inline unsigned int myos_time(void) {
+    return (unsigned int)myos_syscall(SYS_TIME, 0, 0, 0);
+}
+
+static inline void myos_sleep(unsigned int ms) {
+    myos_syscall(SYS_SLEEP, (int)ms, 0, 0);
+}
+#endif